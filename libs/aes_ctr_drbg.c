@@ -0,0 +1,315 @@
+/*
+ * An AES-256 CTR_DRBG (NIST SP 800-90A, no derivation function) using AES-NI.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * The state is an AES-256 key and a 128-bit counter V. Generating output
+ * encrypts V+1, V+2, ... under the key, and then runs the SP 800-90A Update
+ * function, which replaces both the key and V with fresh keystream. So, like
+ * the ChaCha20 generator, the key that produced some output is gone by the time
+ * the caller sees that output.
+ *
+ * There is deliberately no table-based software AES here, because table
+ * lookups indexed by key bytes leak through the cache. The generator is only
+ * usable when the CPU has AES-NI, which aes_ctr_drbg_supported() checks at
+ * runtime. Callers must fall back to something else (the ChaCha20 generator)
+ * when it returns 0.
+ *
+ * This file contains no I/O. The caller provides the seed (see entropy.c) and
+ * is responsible for calling aes_ctr_drbg_reseed() when
+ * aes_ctr_drbg_needs_reseed() says so.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aes_ctr_drbg.h"
+#include "memset_s.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+/* Every CPU with AES-NI also has SSSE3, which we use to byte-swap counters. */
+#define AES_TARGET __attribute__((target("aes,ssse3")))
+#define AES256_ROUNDS 14
+/* How many counter blocks are encrypted in parallel. */
+#define AES_CTR_LANES 8
+
+static uint64_t load64_be(const unsigned char *p);
+static void store64_be(unsigned char *p, uint64_t v);
+static void aes256_expand_key(const unsigned char key[AES256_KEY_LENGTH], __m128i rk[AES256_ROUNDS + 1]);
+static void aes_ctr_keystream(const __m128i rk[AES256_ROUNDS + 1], unsigned char v[AES_BLOCK_LENGTH],
+                              unsigned char *out, size_t length);
+static void aes_ctr_drbg_update(aes_ctr_drbg *drbg, const __m128i rk[AES256_ROUNDS + 1],
+                                const unsigned char *provided);
+
+/*
+ * Returns 1 if the CPU supports AES-NI, 0 otherwise.
+ */
+int aes_ctr_drbg_supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (ecx & bit_AES) != 0;
+}
+
+static uint64_t load64_be(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static void store64_be(unsigned char *p, uint64_t v)
+{
+    for (int i = 7; i >= 0; i--) {
+        p[i] = v & 0xFF;
+        v >>= 8;
+    }
+}
+
+/* One step of the AES-256 key schedule, from Intel's AES-NI white paper. The
+ * round constant has to be an immediate, hence the macro. */
+#define AES256_EXPAND_STEP(prev_even, prev_odd, even, odd, rcon) do {        \
+    __m128i t_, u_;                                                          \
+    t_ = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(prev_odd, rcon), 0xff); \
+    u_ = prev_even;                                                          \
+    u_ = _mm_xor_si128(u_, _mm_slli_si128(u_, 4));                           \
+    u_ = _mm_xor_si128(u_, _mm_slli_si128(u_, 4));                           \
+    u_ = _mm_xor_si128(u_, _mm_slli_si128(u_, 4));                           \
+    even = _mm_xor_si128(u_, t_);                                            \
+    t_ = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(even, 0x00), 0xaa);     \
+    u_ = prev_odd;                                                           \
+    u_ = _mm_xor_si128(u_, _mm_slli_si128(u_, 4));                           \
+    u_ = _mm_xor_si128(u_, _mm_slli_si128(u_, 4));                           \
+    u_ = _mm_xor_si128(u_, _mm_slli_si128(u_, 4));                           \
+    odd = _mm_xor_si128(u_, t_);                                             \
+} while (0)
+
+AES_TARGET
+static void aes256_expand_key(const unsigned char key[AES256_KEY_LENGTH], __m128i rk[AES256_ROUNDS + 1])
+{
+    __m128i unused;
+    rk[0] = _mm_loadu_si128((const __m128i *)key);
+    rk[1] = _mm_loadu_si128((const __m128i *)(key + 16));
+    AES256_EXPAND_STEP(rk[0],  rk[1],  rk[2],  rk[3],  0x01);
+    AES256_EXPAND_STEP(rk[2],  rk[3],  rk[4],  rk[5],  0x02);
+    AES256_EXPAND_STEP(rk[4],  rk[5],  rk[6],  rk[7],  0x04);
+    AES256_EXPAND_STEP(rk[6],  rk[7],  rk[8],  rk[9],  0x08);
+    AES256_EXPAND_STEP(rk[8],  rk[9],  rk[10], rk[11], 0x10);
+    AES256_EXPAND_STEP(rk[10], rk[11], rk[12], rk[13], 0x20);
+    /* The last step only needs the even half. */
+    AES256_EXPAND_STEP(rk[12], rk[13], rk[14], unused, 0x40);
+    (void)unused;
+}
+
+/*
+ * Encrypts a single block. Used by the self-tests.
+ */
+AES_TARGET
+void aes256_encrypt_block(const unsigned char key[AES256_KEY_LENGTH],
+                          const unsigned char in[AES_BLOCK_LENGTH],
+                          unsigned char out[AES_BLOCK_LENGTH])
+{
+    __m128i rk[AES256_ROUNDS + 1];
+    aes256_expand_key(key, rk);
+
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), rk[0]);
+    for (int r = 1; r < AES256_ROUNDS; r++) {
+        x = _mm_aesenc_si128(x, rk[r]);
+    }
+    x = _mm_aesenclast_si128(x, rk[AES256_ROUNDS]);
+    _mm_storeu_si128((__m128i *)out, x);
+
+    memset_s(rk, 0, sizeof(rk));
+}
+
+/*
+ * Writes 'length' bytes of CTR keystream to 'out', incrementing the big-endian
+ * counter 'v' before each block as SP 800-90A requires.
+ */
+AES_TARGET
+static void aes_ctr_keystream(const __m128i rk[AES256_ROUNDS + 1], unsigned char v[AES_BLOCK_LENGTH],
+                              unsigned char *out, size_t length)
+{
+    uint64_t hi = load64_be(v);
+    uint64_t lo = load64_be(v + 8);
+    unsigned char counter[AES_BLOCK_LENGTH];
+    __m128i x[AES_CTR_LANES];
+    /* Reverses the bytes of each 64-bit half. */
+    const __m128i bswap64 = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+
+    while (length > 0) {
+        for (int l = 0; l < AES_CTR_LANES; l++) {
+            lo++;
+            hi += (lo == 0);
+            x[l] = _mm_shuffle_epi8(_mm_set_epi64x((long long)lo, (long long)hi), bswap64);
+            x[l] = _mm_xor_si128(x[l], rk[0]);
+        }
+        for (int r = 1; r < AES256_ROUNDS; r++) {
+            for (int l = 0; l < AES_CTR_LANES; l++) {
+                x[l] = _mm_aesenc_si128(x[l], rk[r]);
+            }
+        }
+        for (int l = 0; l < AES_CTR_LANES; l++) {
+            x[l] = _mm_aesenclast_si128(x[l], rk[AES256_ROUNDS]);
+        }
+
+        /* Store whole blocks, and back the counter up for any we didn't use. */
+        for (int l = 0; l < AES_CTR_LANES; l++) {
+            if (length >= AES_BLOCK_LENGTH) {
+                _mm_storeu_si128((__m128i *)out, x[l]);
+                out += AES_BLOCK_LENGTH;
+                length -= AES_BLOCK_LENGTH;
+            } else if (length > 0) {
+                _mm_storeu_si128((__m128i *)counter, x[l]);
+                memcpy(out, counter, length);
+                length = 0;
+            } else {
+                hi -= (lo == 0);
+                lo--;
+            }
+        }
+    }
+
+    store64_be(v, hi);
+    store64_be(v + 8, lo);
+    memset_s(counter, 0, sizeof(counter));
+    memset_s(x, 0, sizeof(x));
+}
+
+/*
+ * The CTR_DRBG_Update function. 'provided' is AES_CTR_DRBG_SEED_LENGTH bytes,
+ * or NULL for all zeroes.
+ */
+AES_TARGET
+static void aes_ctr_drbg_update(aes_ctr_drbg *drbg, const __m128i rk[AES256_ROUNDS + 1],
+                                const unsigned char *provided)
+{
+    unsigned char temp[AES_CTR_DRBG_SEED_LENGTH];
+    aes_ctr_keystream(rk, drbg->v, temp, sizeof(temp));
+    if (provided != NULL) {
+        for (size_t i = 0; i < sizeof(temp); i++) {
+            temp[i] ^= provided[i];
+        }
+    }
+    memcpy(drbg->key, temp, AES256_KEY_LENGTH);
+    memcpy(drbg->v, temp + AES256_KEY_LENGTH, AES_BLOCK_LENGTH);
+    memset_s(temp, 0, sizeof(temp));
+}
+
+/*
+ * CTR_DRBG_Instantiate with a 48-byte seed from a trusted source and no
+ * personalization string.
+ */
+void aes_ctr_drbg_init(aes_ctr_drbg *drbg, const unsigned char seed[AES_CTR_DRBG_SEED_LENGTH])
+{
+    memset(drbg->key, 0, sizeof(drbg->key));
+    memset(drbg->v, 0, sizeof(drbg->v));
+    aes_ctr_drbg_reseed(drbg, seed);
+}
+
+/*
+ * CTR_DRBG_Reseed with no additional input.
+ */
+void aes_ctr_drbg_reseed(aes_ctr_drbg *drbg, const unsigned char seed[AES_CTR_DRBG_SEED_LENGTH])
+{
+    __m128i rk[AES256_ROUNDS + 1];
+    aes256_expand_key(drbg->key, rk);
+    aes_ctr_drbg_update(drbg, rk, seed);
+    memset_s(rk, 0, sizeof(rk));
+    drbg->output_since_reseed = 0;
+}
+
+/*
+ * Returns 1 if the generator has output AES_CTR_DRBG_RESEED_INTERVAL bytes
+ * since it was last seeded, 0 otherwise.
+ */
+int aes_ctr_drbg_needs_reseed(const aes_ctr_drbg *drbg)
+{
+    return drbg->output_since_reseed >= AES_CTR_DRBG_RESEED_INTERVAL;
+}
+
+/*
+ * CTR_DRBG_Generate with no additional input. Fills 'out' with 'length' bytes,
+ * which must be at most AES_CTR_DRBG_MAX_REQUEST.
+ */
+void aes_ctr_drbg_generate(aes_ctr_drbg *drbg, unsigned char *out, size_t length)
+{
+    __m128i rk[AES256_ROUNDS + 1];
+
+    if (length > AES_CTR_DRBG_MAX_REQUEST) {
+        abort();
+    }
+
+    aes256_expand_key(drbg->key, rk);
+    aes_ctr_keystream(rk, drbg->v, out, length);
+    aes_ctr_drbg_update(drbg, rk, NULL);
+    memset_s(rk, 0, sizeof(rk));
+    drbg->output_since_reseed += length;
+}
+
+#else /* Not x86: there is no AES-NI, and no software fallback (see above). */
+
+int aes_ctr_drbg_supported(void)
+{
+    return 0;
+}
+
+void aes256_encrypt_block(const unsigned char key[AES256_KEY_LENGTH],
+                          const unsigned char in[AES_BLOCK_LENGTH],
+                          unsigned char out[AES_BLOCK_LENGTH])
+{
+    abort();
+}
+
+void aes_ctr_drbg_init(aes_ctr_drbg *drbg, const unsigned char seed[AES_CTR_DRBG_SEED_LENGTH])
+{
+    abort();
+}
+
+void aes_ctr_drbg_reseed(aes_ctr_drbg *drbg, const unsigned char seed[AES_CTR_DRBG_SEED_LENGTH])
+{
+    abort();
+}
+
+int aes_ctr_drbg_needs_reseed(const aes_ctr_drbg *drbg)
+{
+    abort();
+}
+
+void aes_ctr_drbg_generate(aes_ctr_drbg *drbg, unsigned char *out, size_t length)
+{
+    abort();
+}
+
+#endif
+
+/*
+ * Erases the generator's state.
+ */
+void aes_ctr_drbg_wipe(aes_ctr_drbg *drbg)
+{
+    memset_s(drbg->key, 0, sizeof(drbg->key));
+    memset_s(drbg->v, 0, sizeof(drbg->v));
+    memset_s(&(drbg->output_since_reseed), 0, sizeof(drbg->output_since_reseed));
+}
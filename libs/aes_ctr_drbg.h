@@ -0,0 +1,32 @@
+#ifndef AES_CTR_DRBG_H
+#define AES_CTR_DRBG_H
+
+#include <stddef.h>
+
+#define AES256_KEY_LENGTH 32
+#define AES_BLOCK_LENGTH 16
+/* SP 800-90A seedlen for AES-256 without a derivation function. */
+#define AES_CTR_DRBG_SEED_LENGTH (AES256_KEY_LENGTH + AES_BLOCK_LENGTH)
+/* SP 800-90A limits a single request to 2^19 bits. */
+#define AES_CTR_DRBG_MAX_REQUEST 65536
+/* Fresh kernel randomness is mixed in after this many output bytes. */
+#define AES_CTR_DRBG_RESEED_INTERVAL (1ul << 24)
+
+typedef struct AesCtrDrbg {
+    unsigned char key[AES256_KEY_LENGTH];
+    unsigned char v[AES_BLOCK_LENGTH];
+    unsigned long output_since_reseed;
+} aes_ctr_drbg;
+
+int aes_ctr_drbg_supported(void);
+void aes256_encrypt_block(const unsigned char key[AES256_KEY_LENGTH],
+                          const unsigned char in[AES_BLOCK_LENGTH],
+                          unsigned char out[AES_BLOCK_LENGTH]);
+
+void aes_ctr_drbg_init(aes_ctr_drbg *drbg, const unsigned char seed[AES_CTR_DRBG_SEED_LENGTH]);
+void aes_ctr_drbg_reseed(aes_ctr_drbg *drbg, const unsigned char seed[AES_CTR_DRBG_SEED_LENGTH]);
+int aes_ctr_drbg_needs_reseed(const aes_ctr_drbg *drbg);
+void aes_ctr_drbg_generate(aes_ctr_drbg *drbg, unsigned char *out, size_t length);
+void aes_ctr_drbg_wipe(aes_ctr_drbg *drbg);
+
+#endif
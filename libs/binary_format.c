@@ -0,0 +1,136 @@
+/*
+ * The header of passgen's binary output format.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * With --binary, passwords aren't written one per line. They are written as
+ * fixed-width records with nothing between them, after a header saying what
+ * they are, so a program can mmap() the file and find password i at
+ * header_length + i * record_length without parsing anything. All of the
+ * numbers are little-endian:
+ *
+ *   offset  size  field
+ *        0     8  "PASSGENB"
+ *        8     4  version (1)
+ *       12     4  header_length: where the first record starts
+ *       16     4  flags: BINARY_FORMAT_INDICES (1) if records hold indices
+ *       20     4  record_length: bytes per record (one per character)
+ *       24     4  charset_length: how many symbols there are (1 to 256)
+ *       28     4  zero
+ *       32     8  count: how many records there should be
+ *       40     -  the character set, charset_length bytes
+ *
+ * and then zeros up to header_length, a multiple of BINARY_FORMAT_ALIGN. With
+ * BINARY_FORMAT_INDICES, each byte of a record is a symbol's position in the
+ * character set (0 to charset_length - 1) instead of the symbol itself.
+ *
+ * The count is written before the passwords are made. If a run fails part of
+ * the way through (without --atomic), the file holds fewer records than it
+ * says, which is how a reader can tell it was cut short.
+ */
+
+#include <string.h>
+
+#include "binary_format.h"
+
+static void binary_format_put32(unsigned char *out, uint32_t value);
+static uint32_t binary_format_get32(const unsigned char *in);
+
+/*
+ * Fills 'header' for 'count' records of 'record_length' symbols from
+ * 'charset' (indices into it, if 'indices' is set). Returns 1 on success, 0
+ * if the character set is empty or too long.
+ */
+int binary_format_init(binary_format_header *header, const char *charset, uint32_t record_length,
+                       uint64_t count, int indices)
+{
+    size_t charset_length = strlen(charset);
+
+    if (charset_length < 1 || charset_length > BINARY_FORMAT_MAX_CHARSET) {
+        return 0;
+    }
+
+    memset(header, 0, sizeof(*header));
+    header->header_length = (uint32_t)((BINARY_FORMAT_FIXED_LENGTH + charset_length + BINARY_FORMAT_ALIGN - 1) /
+                                       BINARY_FORMAT_ALIGN * BINARY_FORMAT_ALIGN);
+    header->flags = indices ? BINARY_FORMAT_INDICES : 0;
+    header->record_length = record_length;
+    header->charset_length = (uint32_t)charset_length;
+    header->count = count;
+    memcpy(header->charset, charset, charset_length);
+    return 1;
+}
+
+/*
+ * Writes 'header' to 'out', which must have room for BINARY_FORMAT_MAX_HEADER
+ * bytes. Returns its length, header->header_length.
+ */
+size_t binary_format_write(const binary_format_header *header, unsigned char *out)
+{
+    memset(out, 0, header->header_length);
+    memcpy(out, BINARY_FORMAT_MAGIC, BINARY_FORMAT_MAGIC_LENGTH);
+    binary_format_put32(out + 8, BINARY_FORMAT_VERSION);
+    binary_format_put32(out + 12, header->header_length);
+    binary_format_put32(out + 16, header->flags);
+    binary_format_put32(out + 20, header->record_length);
+    binary_format_put32(out + 24, header->charset_length);
+    binary_format_put32(out + 32, (uint32_t)header->count);
+    binary_format_put32(out + 36, (uint32_t)(header->count >> 32));
+    memcpy(out + BINARY_FORMAT_FIXED_LENGTH, header->charset, header->charset_length);
+    return header->header_length;
+}
+
+/*
+ * Reads a header from the first 'length' bytes of 'data'. Returns 1 on
+ * success, 0 if it isn't a header we understand.
+ */
+int binary_format_read(binary_format_header *header, const unsigned char *data, size_t length)
+{
+    memset(header, 0, sizeof(*header));
+
+    if (length < BINARY_FORMAT_FIXED_LENGTH ||
+        memcmp(data, BINARY_FORMAT_MAGIC, BINARY_FORMAT_MAGIC_LENGTH) != 0 ||
+        binary_format_get32(data + 8) != BINARY_FORMAT_VERSION) {
+        return 0;
+    }
+
+    header->header_length = binary_format_get32(data + 12);
+    header->flags = binary_format_get32(data + 16);
+    header->record_length = binary_format_get32(data + 20);
+    header->charset_length = binary_format_get32(data + 24);
+    header->count = binary_format_get32(data + 32) | (uint64_t)binary_format_get32(data + 36) << 32;
+
+    if (header->charset_length < 1 || header->charset_length > BINARY_FORMAT_MAX_CHARSET ||
+        header->header_length < BINARY_FORMAT_FIXED_LENGTH + header->charset_length ||
+        header->header_length > length || header->record_length == 0 ||
+        (header->flags & ~(uint32_t)BINARY_FORMAT_INDICES) != 0) {
+        return 0;
+    }
+
+    memcpy(header->charset, data + BINARY_FORMAT_FIXED_LENGTH, header->charset_length);
+    return 1;
+}
+
+static void binary_format_put32(unsigned char *out, uint32_t value)
+{
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+    out[2] = (unsigned char)(value >> 16);
+    out[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t binary_format_get32(const unsigned char *in)
+{
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
@@ -0,0 +1,39 @@
+#ifndef BINARY_FORMAT_H
+#define BINARY_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The first bytes of a binary output file (see binary_format.c). */
+#define BINARY_FORMAT_MAGIC "PASSGENB"
+#define BINARY_FORMAT_MAGIC_LENGTH 8
+#define BINARY_FORMAT_VERSION 1
+
+/* Set in 'flags' if records hold symbol indices instead of characters. */
+#define BINARY_FORMAT_INDICES 1
+
+/* The header's length is a multiple of this, so records start aligned. */
+#define BINARY_FORMAT_ALIGN 64
+/* The fixed fields, before the character set. */
+#define BINARY_FORMAT_FIXED_LENGTH 40
+#define BINARY_FORMAT_MAX_CHARSET 256
+#define BINARY_FORMAT_MAX_HEADER 320
+
+typedef struct BinaryFormatHeader {
+    /* Bytes before the first record. */
+    uint32_t header_length;
+    uint32_t flags;
+    /* Bytes in each record: one per character (or index). */
+    uint32_t record_length;
+    uint32_t charset_length;
+    /* How many records the file should hold. */
+    uint64_t count;
+    unsigned char charset[BINARY_FORMAT_MAX_CHARSET];
+} binary_format_header;
+
+int binary_format_init(binary_format_header *header, const char *charset, uint32_t record_length,
+                       uint64_t count, int indices);
+size_t binary_format_write(const binary_format_header *header, unsigned char *out);
+int binary_format_read(binary_format_header *header, const unsigned char *data, size_t length);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * The ChaCha20 block function, as specified in RFC 7539.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+#include <stdint.h>
+
+#include "chacha20.h"
+#include "memset_s.h"
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTL32(d, 16); \
+    c += d; b ^= c; b = ROTL32(b, 12); \
+    a += b; d ^= a; d = ROTL32(d, 8);  \
+    c += d; b ^= c; b = ROTL32(b, 7);
+
+static uint32_t load32_le(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store32_le(unsigned char *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+/*
+ * Computes one 64-byte block of ChaCha20 keystream for the given key, block
+ * counter and nonce.
+ */
+void chacha20_block(const unsigned char key[CHACHA20_KEY_LENGTH], uint32_t counter,
+                    const unsigned char nonce[CHACHA20_NONCE_LENGTH],
+                    unsigned char out[CHACHA20_BLOCK_LENGTH])
+{
+    uint32_t input[16];
+    uint32_t x[16];
+
+    /* "expand 32-byte k" */
+    input[0] = 0x61707865;
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) {
+        input[4 + i] = load32_le(key + 4 * i);
+    }
+    input[12] = counter;
+    for (int i = 0; i < 3; i++) {
+        input[13 + i] = load32_le(nonce + 4 * i);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        x[i] = input[i];
+    }
+
+    for (int i = 0; i < 10; i++) {
+        /* Column rounds. */
+        QUARTERROUND(x[0], x[4], x[8],  x[12])
+        QUARTERROUND(x[1], x[5], x[9],  x[13])
+        QUARTERROUND(x[2], x[6], x[10], x[14])
+        QUARTERROUND(x[3], x[7], x[11], x[15])
+        /* Diagonal rounds. */
+        QUARTERROUND(x[0], x[5], x[10], x[15])
+        QUARTERROUND(x[1], x[6], x[11], x[12])
+        QUARTERROUND(x[2], x[7], x[8],  x[13])
+        QUARTERROUND(x[3], x[4], x[9],  x[14])
+    }
+
+    for (int i = 0; i < 16; i++) {
+        store32_le(out + 4 * i, x[i] + input[i]);
+    }
+
+    memset_s(input, 0, sizeof(input));
+    memset_s(x, 0, sizeof(x));
+}
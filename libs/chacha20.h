@@ -0,0 +1,14 @@
+#ifndef CHACHA20_H
+#define CHACHA20_H
+
+#include <stdint.h>
+
+#define CHACHA20_KEY_LENGTH 32
+#define CHACHA20_NONCE_LENGTH 12
+#define CHACHA20_BLOCK_LENGTH 64
+
+void chacha20_block(const unsigned char key[CHACHA20_KEY_LENGTH], uint32_t counter,
+                    const unsigned char nonce[CHACHA20_NONCE_LENGTH],
+                    unsigned char out[CHACHA20_BLOCK_LENGTH]);
+
+#endif
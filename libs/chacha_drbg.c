@@ -0,0 +1,115 @@
+/*
+ * A fast-key-erasure random number generator built on ChaCha20.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * This is the construction described in https://blog.cr.yp.to/20170723-fast-key-erasure.html:
+ *
+ *  1. The only state is a 32-byte ChaCha20 key.
+ *
+ *  2. To generate output, we run ChaCha20 under that key (zero nonce, counter
+ *     starting at zero). The first 32 bytes of keystream immediately replace
+ *     the key, and the rest of the keystream is the output.
+ *
+ * Since the key is overwritten before any output is returned, someone who
+ * steals the state later on can't reconstruct anything we've already output.
+ *
+ * This file contains no I/O. The caller provides the seed (see entropy.c) and
+ * is responsible for calling chacha_drbg_reseed() when
+ * chacha_drbg_needs_reseed() says so.
+ */
+
+#include <string.h>
+
+#include "chacha_drbg.h"
+#include "memset_s.h"
+
+/*
+ * Initializes the generator with a 32-byte seed from a trusted source.
+ */
+void chacha_drbg_init(chacha_drbg *drbg, const unsigned char seed[CHACHA_DRBG_SEED_LENGTH])
+{
+    memcpy(drbg->key, seed, CHACHA20_KEY_LENGTH);
+    drbg->output_since_reseed = 0;
+}
+
+/*
+ * Mixes 32 fresh bytes into the key. The result is at least as unpredictable
+ * as either the old key or the new seed. The key is ratcheted forward
+ * afterwards so that the XOR of the two can't be recovered either.
+ */
+void chacha_drbg_reseed(chacha_drbg *drbg, const unsigned char seed[CHACHA_DRBG_SEED_LENGTH])
+{
+    for (size_t i = 0; i < CHACHA20_KEY_LENGTH; i++) {
+        drbg->key[i] ^= seed[i];
+    }
+    chacha_drbg_generate(drbg, NULL, 0);
+    drbg->output_since_reseed = 0;
+}
+
+/*
+ * Returns 1 if the generator has output CHACHA_DRBG_RESEED_INTERVAL bytes since
+ * it was last seeded, 0 otherwise.
+ */
+int chacha_drbg_needs_reseed(const chacha_drbg *drbg)
+{
+    return drbg->output_since_reseed >= CHACHA_DRBG_RESEED_INTERVAL;
+}
+
+/*
+ * Fills 'out' with 'length' bytes of output. 'length' must be less than 256
+ * GiB, which is the most keystream a single ChaCha20 key/nonce can produce.
+ */
+void chacha_drbg_generate(chacha_drbg *drbg, unsigned char *out, size_t length)
+{
+    static const unsigned char nonce[CHACHA20_NONCE_LENGTH] = { 0 };
+    unsigned char key[CHACHA20_KEY_LENGTH];
+    unsigned char block[CHACHA20_BLOCK_LENGTH];
+    uint32_t counter = 0;
+
+    /* Take the current key and replace it before producing any output. */
+    memcpy(key, drbg->key, CHACHA20_KEY_LENGTH);
+    chacha20_block(key, counter++, nonce, block);
+    memcpy(drbg->key, block, CHACHA20_KEY_LENGTH);
+
+    /* The rest of the first block is output. */
+    size_t offset = CHACHA20_KEY_LENGTH;
+    while (length > 0) {
+        if (offset == CHACHA20_BLOCK_LENGTH) {
+            chacha20_block(key, counter++, nonce, block);
+            offset = 0;
+        }
+        size_t n = CHACHA20_BLOCK_LENGTH - offset;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(out, block + offset, n);
+        out += n;
+        offset += n;
+        length -= n;
+        drbg->output_since_reseed += n;
+    }
+
+    memset_s(key, 0, sizeof(key));
+    memset_s(block, 0, sizeof(block));
+}
+
+/*
+ * Erases the generator's state.
+ */
+void chacha_drbg_wipe(chacha_drbg *drbg)
+{
+    memset_s(drbg->key, 0, sizeof(drbg->key));
+    memset_s(&(drbg->output_since_reseed), 0, sizeof(drbg->output_since_reseed));
+}
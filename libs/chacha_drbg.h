@@ -0,0 +1,23 @@
+#ifndef CHACHA_DRBG_H
+#define CHACHA_DRBG_H
+
+#include <stddef.h>
+
+#include "chacha20.h"
+
+#define CHACHA_DRBG_SEED_LENGTH CHACHA20_KEY_LENGTH
+/* Fresh kernel randomness is mixed in after this many output bytes. */
+#define CHACHA_DRBG_RESEED_INTERVAL (1ul << 24)
+
+typedef struct ChaChaDrbg {
+    unsigned char key[CHACHA20_KEY_LENGTH];
+    unsigned long output_since_reseed;
+} chacha_drbg;
+
+void chacha_drbg_init(chacha_drbg *drbg, const unsigned char seed[CHACHA_DRBG_SEED_LENGTH]);
+void chacha_drbg_reseed(chacha_drbg *drbg, const unsigned char seed[CHACHA_DRBG_SEED_LENGTH]);
+int chacha_drbg_needs_reseed(const chacha_drbg *drbg);
+void chacha_drbg_generate(chacha_drbg *drbg, unsigned char *out, size_t length);
+void chacha_drbg_wipe(chacha_drbg *drbg);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Random numbers from the CPU's RDSEED and RDRAND instructions.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * We can't audit the CPU's generator, so these bytes are NEVER used on their
+ * own. They are only hashed together with kernel randomness when seeding a
+ * generator (see entropy.c), which can't make the seed any worse than the
+ * kernel bytes alone.
+ *
+ * RDSEED reads the hardware entropy source directly and fails (clears the
+ * carry flag) when it's drained, which happens easily when many processes use
+ * it at once. We retry a few times with a pause in between, and fall back to
+ * RDRAND (whose output comes from a DRBG that the same source reseeds) when it
+ * keeps failing. Every retry and fallback is counted so --stats can show how
+ * contended the hardware source is.
+ *
+ * Some AMD CPUs have been known to return all ones from RDRAND with the carry
+ * flag set after a suspend, so an all-ones word is treated as a failure.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu_random.h"
+#include "memset_s.h"
+
+#if defined(__x86_64__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+static int rdseed_word(uint64_t *word, cpu_random_stats *stats);
+static int rdrand_word(uint64_t *word, cpu_random_stats *stats);
+
+/*
+ * Returns 1 if the CPU has the RDSEED instruction, 0 otherwise.
+ */
+int cpu_random_has_rdseed(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (ebx & bit_RDSEED) != 0;
+}
+
+/*
+ * Returns 1 if the CPU has the RDRAND instruction, 0 otherwise.
+ */
+int cpu_random_has_rdrand(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (ecx & bit_RDRND) != 0;
+}
+
+__attribute__((target("rdseed")))
+static int rdseed_word(uint64_t *word, cpu_random_stats *stats)
+{
+    unsigned long long value;
+    for (int i = 0; i < CPU_RANDOM_RDSEED_TRIES; i++) {
+        if (_rdseed64_step(&value) && value != UINT64_MAX) {
+            *word = value;
+            stats->rdseed_words++;
+            return 1;
+        }
+        stats->rdseed_retries++;
+        _mm_pause();
+    }
+    stats->rdseed_failures++;
+    return 0;
+}
+
+__attribute__((target("rdrnd")))
+static int rdrand_word(uint64_t *word, cpu_random_stats *stats)
+{
+    unsigned long long value;
+    for (int i = 0; i < CPU_RANDOM_RDRAND_TRIES; i++) {
+        if (_rdrand64_step(&value) && value != UINT64_MAX) {
+            *word = value;
+            stats->rdrand_words++;
+            return 1;
+        }
+    }
+    stats->rdrand_failures++;
+    return 0;
+}
+
+/*
+ * Fills 'out' with bytes from RDSEED, or RDRAND when RDSEED is unavailable or
+ * keeps failing. Returns 0 on failure (no usable instruction, or both kept
+ * failing), 1 on success.
+ */
+int cpu_random_fill(unsigned char *out, size_t length, cpu_random_stats *stats)
+{
+    int have_rdseed = cpu_random_has_rdseed();
+    int have_rdrand = cpu_random_has_rdrand();
+    uint64_t word = 0;
+    int success = 1;
+
+    while (length > 0) {
+        if (!(have_rdseed && rdseed_word(&word, stats)) &&
+            !(have_rdrand && rdrand_word(&word, stats))) {
+            success = 0;
+            break;
+        }
+        size_t n = length < sizeof(word) ? length : sizeof(word);
+        memcpy(out, &word, n);
+        out += n;
+        length -= n;
+    }
+
+    memset_s(&word, 0, sizeof(word));
+    return success;
+}
+
+#else
+
+int cpu_random_has_rdseed(void)
+{
+    return 0;
+}
+
+int cpu_random_has_rdrand(void)
+{
+    return 0;
+}
+
+int cpu_random_fill(unsigned char *out, size_t length, cpu_random_stats *stats)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef CPU_RANDOM_H
+#define CPU_RANDOM_H
+
+#include <stddef.h>
+
+/* How many times one RDSEED is retried before falling back to RDRAND. */
+#define CPU_RANDOM_RDSEED_TRIES 16
+/* Intel recommends retrying RDRAND 10 times before giving up. */
+#define CPU_RANDOM_RDRAND_TRIES 10
+
+typedef struct CpuRandomStats {
+    /* 64-bit words that came from RDSEED and RDRAND. */
+    unsigned long rdseed_words;
+    unsigned long rdrand_words;
+    /* RDSEED attempts that failed and were retried. */
+    unsigned long rdseed_retries;
+    /* Words for which every RDSEED attempt failed, so RDRAND was used. */
+    unsigned long rdseed_failures;
+    /* Words for which RDRAND also failed. */
+    unsigned long rdrand_failures;
+} cpu_random_stats;
+
+int cpu_random_has_rdseed(void);
+int cpu_random_has_rdrand(void);
+int cpu_random_fill(unsigned char *out, size_t length, cpu_random_stats *stats);
+
+#endif
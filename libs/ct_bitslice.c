@@ -0,0 +1,256 @@
+/*
+ * Constant-time selection of rows from a bitsliced table.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * ct_table.c selects a row by comparing every row's number with the index. A
+ * bitsliced table turns that around: each bit of the output is one plane with
+ * one bit per row, so selecting row i is ANDing every plane with a mask that
+ * has only bit i set, and checking whether anything is left. The mask is built
+ * once per index (with no secret-dependent memory accesses) and reused for all
+ * of the planes, so the sweep itself is nothing but AND, OR and a zero test
+ * over contiguous memory.
+ *
+ *  scalar - 64 bits at a time.
+ *  avx2   - 256 bits at a time.
+ *  avx512 - 512 bits at a time, with one ternary-logic instruction per vector.
+ *
+ * Every plane is read in full, in order, whatever the indices are. An index
+ * past the end of the table matches only padding (or nothing), so it gives all
+ * zeros, like ct_table_select().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ct_bitslice.h"
+#include "ct32.h"
+#include "memset_s.h"
+
+static uint64_t load64(const unsigned char *p);
+static void store64_le(unsigned char *p, uint64_t v);
+static uint32_t ct_isnonzero_u64(uint64_t x);
+static void build_mask(const ct_bitsliced_table *table, uint32_t index, unsigned char *mask);
+static void select_many_scalar(const ct_bitsliced_table *table, const unsigned char *masks, uint32_t count,
+                               unsigned char *out);
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+static int avx2_supported(void);
+static void select_many_avx2(const ct_bitsliced_table *table, const unsigned char *masks, uint32_t count,
+                             unsigned char *out);
+static int avx512_supported(void);
+static void select_many_avx512(const ct_bitsliced_table *table, const unsigned char *masks, uint32_t count,
+                               unsigned char *out);
+
+#endif
+
+static const ct_bitslice_kernel all_kernels[] = {
+    { "scalar", NULL, select_many_scalar },
+#if defined(__x86_64__)
+    { "avx2", avx2_supported, select_many_avx2 },
+    { "avx512", avx512_supported, select_many_avx512 },
+#endif
+};
+
+/*
+ * Returns the index'th kernel (whether it's supported or not), or NULL when
+ * 'index' is past the last one. Used to test and benchmark every kernel.
+ */
+const ct_bitslice_kernel *ct_bitslice_kernel_at(size_t index)
+{
+    if (index >= sizeof(all_kernels) / sizeof(all_kernels[0])) {
+        return NULL;
+    }
+    return &all_kernels[index];
+}
+
+/*
+ * Returns 1 if 'kernel' can be used on this machine, 0 otherwise.
+ */
+int ct_bitslice_kernel_supported(const ct_bitslice_kernel *kernel)
+{
+    return kernel->supported == NULL || kernel->supported();
+}
+
+/*
+ * Copies row indices[i] of 'table' (or zeros, if there's no such row) to
+ * out + i * table->row_length for each of the 'count' indices, using 'kernel'.
+ * Returns 0 on failure (bad table or out of memory), 1 on success.
+ */
+int ct_bitslice_select_many_with(const ct_bitslice_kernel *kernel, const ct_bitsliced_table *table,
+                                 const uint32_t *indices, size_t count, unsigned char *out)
+{
+    if (table->plane_length % CT_BITSLICE_PLANE_ALIGNMENT != 0 ||
+        table->row_count > (uint64_t)table->plane_length * 8) {
+        return 0;
+    }
+
+    /* Only as many masks as one batch (or all of 'count') needs. */
+    size_t batch = count < CT_BITSLICE_BATCH ? count : CT_BITSLICE_BATCH;
+    size_t masks_length = batch * table->plane_length;
+    unsigned char *masks = malloc(masks_length > 0 ? masks_length : 1);
+    if (masks == NULL) {
+        return 0;
+    }
+
+    for (size_t done = 0; done < count; done += CT_BITSLICE_BATCH) {
+        uint32_t n = count - done < CT_BITSLICE_BATCH ? count - done : CT_BITSLICE_BATCH;
+        for (uint32_t k = 0; k < n; k++) {
+            build_mask(table, indices[done + k], masks + (size_t)k * table->plane_length);
+        }
+        kernel->select_many(table, masks, n, out + done * table->row_length);
+    }
+
+    memset_s(masks, 0, masks_length);
+    free(masks);
+    return 1;
+}
+
+/*
+ * Like ct_bitslice_select_many_with(), using the fastest kernel this CPU
+ * supports (the last supported one).
+ */
+int ct_bitslice_select_many(const ct_bitsliced_table *table, const uint32_t *indices, size_t count,
+                            unsigned char *out)
+{
+    const ct_bitslice_kernel *best = &all_kernels[0];
+    for (size_t i = 1; i < sizeof(all_kernels) / sizeof(all_kernels[0]); i++) {
+        if (ct_bitslice_kernel_supported(&all_kernels[i])) {
+            best = &all_kernels[i];
+        }
+    }
+    return ct_bitslice_select_many_with(best, table, indices, count, out);
+}
+
+static uint64_t load64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void store64_le(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = (v >> (8 * i)) & 0xFF;
+    }
+}
+
+/* Returns 1 if x != 0, 0 otherwise. */
+static uint32_t ct_isnonzero_u64(uint64_t x)
+{
+    return (uint32_t)((x | (0 - x)) >> 63);
+}
+
+/*
+ * Writes a plane-sized mask with only bit 'index' set (nothing, if 'index' is
+ * past the end of the planes). Every 64-bit word is computed the same way;
+ * shifts by a variable amount take constant time.
+ */
+static void build_mask(const ct_bitsliced_table *table, uint32_t index, unsigned char *mask)
+{
+    uint64_t bit = (uint64_t)1 << (index & 63);
+    for (uint32_t w = 0; w < table->plane_length / 8; w++) {
+        uint64_t word_mask = ct_mask_u32(ct_eq_u32(w, index >> 6));
+        word_mask |= word_mask << 32;
+        store64_le(mask + 8 * w, bit & word_mask);
+    }
+}
+
+static void select_many_scalar(const ct_bitsliced_table *table, const unsigned char *masks, uint32_t count,
+                               unsigned char *out)
+{
+    uint32_t plane_count = table->row_length * 8;
+
+    memset(out, 0, (size_t)count * table->row_length);
+
+    for (uint32_t p = 0; p < plane_count; p++) {
+        const unsigned char *plane = table->planes + (size_t)p * table->plane_length;
+        /* The plane stays in L1 while each mask is applied to it. */
+        for (uint32_t k = 0; k < count; k++) {
+            const unsigned char *mask = masks + (size_t)k * table->plane_length;
+            uint64_t acc = 0;
+            for (uint32_t i = 0; i < table->plane_length; i += 8) {
+                acc |= load64(plane + i) & load64(mask + i);
+            }
+            out[k * table->row_length + p / 8] |= ct_isnonzero_u64(acc) << (p % 8);
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+static int avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void select_many_avx2(const ct_bitsliced_table *table, const unsigned char *masks, uint32_t count,
+                             unsigned char *out)
+{
+    uint32_t plane_count = table->row_length * 8;
+
+    memset(out, 0, (size_t)count * table->row_length);
+
+    for (uint32_t p = 0; p < plane_count; p++) {
+        const unsigned char *plane = table->planes + (size_t)p * table->plane_length;
+        for (uint32_t k = 0; k < count; k++) {
+            const unsigned char *mask = masks + (size_t)k * table->plane_length;
+            __m256i acc = _mm256_setzero_si256();
+            for (uint32_t i = 0; i < table->plane_length; i += 32) {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(plane + i));
+                __m256i m = _mm256_loadu_si256((const __m256i *)(mask + i));
+                acc = _mm256_or_si256(acc, _mm256_and_si256(v, m));
+            }
+            uint32_t nonzero = 1 ^ (uint32_t)_mm256_testz_si256(acc, acc);
+            out[k * table->row_length + p / 8] |= nonzero << (p % 8);
+        }
+    }
+}
+
+static int avx512_supported(void)
+{
+    return __builtin_cpu_supports("avx512f");
+}
+
+__attribute__((target("avx512f")))
+static void select_many_avx512(const ct_bitsliced_table *table, const unsigned char *masks, uint32_t count,
+                               unsigned char *out)
+{
+    uint32_t plane_count = table->row_length * 8;
+
+    memset(out, 0, (size_t)count * table->row_length);
+
+    for (uint32_t p = 0; p < plane_count; p++) {
+        const unsigned char *plane = table->planes + (size_t)p * table->plane_length;
+        for (uint32_t k = 0; k < count; k++) {
+            const unsigned char *mask = masks + (size_t)k * table->plane_length;
+            __m512i acc = _mm512_setzero_si512();
+            for (uint32_t i = 0; i < table->plane_length; i += 64) {
+                __m512i v = _mm512_loadu_si512((const void *)(plane + i));
+                __m512i m = _mm512_loadu_si512((const void *)(mask + i));
+                /* acc | (v & m) */
+                acc = _mm512_ternarylogic_epi64(acc, v, m, 0xF8);
+            }
+            uint32_t nonzero = ct_isnonzero_u32(_mm512_test_epi64_mask(acc, acc));
+            out[k * table->row_length + p / 8] |= nonzero << (p % 8);
+        }
+    }
+}
+
+#endif
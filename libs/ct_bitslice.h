@@ -0,0 +1,42 @@
+#ifndef CT_BITSLICE_H
+#define CT_BITSLICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Planes are padded to a multiple of this many bytes. */
+#define CT_BITSLICE_PLANE_ALIGNMENT 64
+/* How many indices one sweep over the planes can resolve. */
+#define CT_BITSLICE_BATCH 16
+
+/*
+ * A table of equal-length rows stored bitsliced: bit b of byte c of row i is
+ * bit i % 8 of byte i / 8 of plane c * 8 + b. There are row_length * 8 planes
+ * of plane_length bytes each, one after the other.
+ */
+typedef struct ConstantTimeBitslicedTable {
+    const unsigned char *planes;
+    uint32_t row_count;
+    uint32_t row_length;
+    uint32_t plane_length;
+} ct_bitsliced_table;
+
+typedef struct ConstantTimeBitsliceKernel {
+    const char *name;
+    /* Returns 1 if the kernel can run on this CPU. May be NULL. */
+    int (*supported)(void);
+    /* Selects 'count' (at most CT_BITSLICE_BATCH) rows in one sweep, given
+     * one one-hot mask of plane_length bytes per index. */
+    void (*select_many)(const ct_bitsliced_table *table, const unsigned char *masks, uint32_t count,
+                        unsigned char *out);
+} ct_bitslice_kernel;
+
+const ct_bitslice_kernel *ct_bitslice_kernel_at(size_t index);
+int ct_bitslice_kernel_supported(const ct_bitslice_kernel *kernel);
+
+int ct_bitslice_select_many_with(const ct_bitslice_kernel *kernel, const ct_bitsliced_table *table,
+                                 const uint32_t *indices, size_t count, unsigned char *out);
+int ct_bitslice_select_many(const ct_bitsliced_table *table, const uint32_t *indices, size_t count,
+                            unsigned char *out);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * Constant-time table lookups for whole blocks of indices, using SIMD.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * invariant_time_lookup() (in ct32.c) reads every entry of the table for every
+ * character, so the memory accesses don't depend on the secret index. That's
+ * still what we do here, but for many indices at once:
+ *
+ *  scalar - invariant_time_lookup() on each index. This is the reference the
+ *           others are tested against (see runtimeTests() in passgen.c).
+ *
+ *  sse2   - 16 indices per vector. For each table entry t, compare all the
+ *           indices with t and OR in table[t] where they're equal. Every x86-64
+ *           CPU has SSE2.
+ *
+ *  avx2   - 32 indices per vector. The (zero-padded) table is held in up to 16
+ *           registers of 16 bytes each. VPSHUFB looks up the low nibble of
+ *           every index in each of them, and a compare on the high nibble keeps
+ *           the result from the right one. That's one pass per 16 table
+ *           entries instead of one per entry.
+ *
+ * The number of passes depends only on the table's length, which is public.
+ * Indices that are out of range give 0, like invariant_time_lookup().
+ */
+
+#include <string.h>
+
+#include "ct_lookup.h"
+#include "ct32.h"
+#include "memset_s.h"
+
+static void lookup_scalar(const unsigned char *table, uint32_t length,
+                          const unsigned char *indices, unsigned char *out, size_t count);
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+static void lookup_sse2(const unsigned char *table, uint32_t length,
+                        const unsigned char *indices, unsigned char *out, size_t count);
+static int avx2_supported(void);
+static void lookup_avx2(const unsigned char *table, uint32_t length,
+                        const unsigned char *indices, unsigned char *out, size_t count);
+
+#endif
+
+static const ct_lookup_kernel all_kernels[] = {
+    { "scalar", NULL, lookup_scalar },
+#if defined(__x86_64__)
+    { "sse2", NULL, lookup_sse2 },
+    { "avx2", avx2_supported, lookup_avx2 },
+#endif
+};
+
+/*
+ * Returns the index'th kernel (whether it's supported or not), or NULL when
+ * 'index' is past the last one. Used to test and benchmark every kernel.
+ */
+const ct_lookup_kernel *ct_lookup_kernel_at(size_t index)
+{
+    if (index >= sizeof(all_kernels) / sizeof(all_kernels[0])) {
+        return NULL;
+    }
+    return &all_kernels[index];
+}
+
+/*
+ * Returns 1 if 'kernel' can be used on this machine, 0 otherwise.
+ */
+int ct_lookup_kernel_supported(const ct_lookup_kernel *kernel)
+{
+    return kernel->supported == NULL || kernel->supported();
+}
+
+/*
+ * Sets out[i] to table[indices[i]] (or 0 if indices[i] >= length) for each of
+ * the 'count' indices, using the fastest kernel this CPU supports. 'length'
+ * must be between 1 and CT_LOOKUP_MAX_LENGTH.
+ */
+void ct_lookup_block(const unsigned char *table, uint32_t length,
+                     const unsigned char *indices, unsigned char *out, size_t count)
+{
+    /* The last supported kernel is the fastest. */
+    const ct_lookup_kernel *best = &all_kernels[0];
+    for (size_t i = 1; i < sizeof(all_kernels) / sizeof(all_kernels[0]); i++) {
+        if (ct_lookup_kernel_supported(&all_kernels[i])) {
+            best = &all_kernels[i];
+        }
+    }
+    best->lookup(table, length, indices, out, count);
+}
+
+static void lookup_scalar(const unsigned char *table, uint32_t length,
+                          const unsigned char *indices, unsigned char *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        out[i] = invariant_time_lookup(table, length, indices[i]);
+    }
+}
+
+#if defined(__x86_64__)
+
+#define SSE2_WIDTH 16
+#define AVX2_WIDTH 32
+
+static void lookup_sse2(const unsigned char *table, uint32_t length,
+                        const unsigned char *indices, unsigned char *out, size_t count)
+{
+    unsigned char block[SSE2_WIDTH];
+
+    for (size_t done = 0; done < count; done += SSE2_WIDTH) {
+        size_t n = count - done < SSE2_WIDTH ? count - done : SSE2_WIDTH;
+        memset(block, 0, sizeof(block));
+        memcpy(block, indices + done, n);
+
+        __m128i index = _mm_loadu_si128((const __m128i *)block);
+        __m128i result = _mm_setzero_si128();
+        for (uint32_t t = 0; t < length; t++) {
+            __m128i equal = _mm_cmpeq_epi8(index, _mm_set1_epi8((char)t));
+            result = _mm_or_si128(result, _mm_and_si128(equal, _mm_set1_epi8((char)table[t])));
+        }
+
+        _mm_storeu_si128((__m128i *)block, result);
+        memcpy(out + done, block, n);
+    }
+
+    memset_s(block, 0, sizeof(block));
+}
+
+static int avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void lookup_avx2(const unsigned char *table, uint32_t length,
+                        const unsigned char *indices, unsigned char *out, size_t count)
+{
+    unsigned char padded[CT_LOOKUP_MAX_LENGTH] __attribute__((aligned(16)));
+    unsigned char block[AVX2_WIDTH];
+    __m256i rows[CT_LOOKUP_MAX_LENGTH / 16];
+    uint32_t row_count = (length + 15) / 16;
+
+    memset(padded, 0, sizeof(padded));
+    memcpy(padded, table, length);
+    for (uint32_t r = 0; r < row_count; r++) {
+        rows[r] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(padded + 16 * r)));
+    }
+
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    for (size_t done = 0; done < count; done += AVX2_WIDTH) {
+        size_t n = count - done < AVX2_WIDTH ? count - done : AVX2_WIDTH;
+        memset(block, 0, sizeof(block));
+        memcpy(block, indices + done, n);
+
+        __m256i index = _mm256_loadu_si256((const __m256i *)block);
+        __m256i column = _mm256_and_si256(index, low_nibble);
+        __m256i row = _mm256_and_si256(_mm256_srli_epi16(index, 4), low_nibble);
+        __m256i result = _mm256_setzero_si256();
+        for (uint32_t r = 0; r < row_count; r++) {
+            __m256i in_row = _mm256_cmpeq_epi8(row, _mm256_set1_epi8((char)r));
+            __m256i found = _mm256_shuffle_epi8(rows[r], column);
+            result = _mm256_or_si256(result, _mm256_and_si256(in_row, found));
+        }
+
+        _mm256_storeu_si256((__m256i *)block, result);
+        memcpy(out + done, block, n);
+    }
+
+    memset_s(block, 0, sizeof(block));
+}
+
+#endif
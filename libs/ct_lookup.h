@@ -0,0 +1,29 @@
+#ifndef CT_LOOKUP_H
+#define CT_LOOKUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tables are indexed by bytes, so they can't be longer than this. */
+#define CT_LOOKUP_MAX_LENGTH 256
+
+/*
+ * A way of doing out[i] = indices[i] < length ? table[indices[i]] : 0 for a
+ * whole block of indices, without the time or memory accesses depending on
+ * the indices.
+ */
+typedef struct ConstantTimeLookupKernel {
+    const char *name;
+    /* Returns 1 if the kernel can run on this CPU. May be NULL. */
+    int (*supported)(void);
+    void (*lookup)(const unsigned char *table, uint32_t length,
+                   const unsigned char *indices, unsigned char *out, size_t count);
+} ct_lookup_kernel;
+
+const ct_lookup_kernel *ct_lookup_kernel_at(size_t index);
+int ct_lookup_kernel_supported(const ct_lookup_kernel *kernel);
+
+void ct_lookup_block(const unsigned char *table, uint32_t length,
+                     const unsigned char *indices, unsigned char *out, size_t count);
+
+#endif
@@ -0,0 +1,364 @@
+/*
+ * Constant-time selection of packed wordlist entries.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * Every word in the wordlist is at most 15 lowercase letters, so an entry fits
+ * in 10 bytes (4 bits of length, 5 bits per letter) instead of 16. That's 72
+ * KB for a sweep over the whole list instead of 116 KB, which fits in L2 with
+ * room to spare on the CPUs we run on.
+ *
+ * 10-byte rows don't line up with vectors, so the vector kernels work on
+ * groups of rows that do: 8 rows (80 bytes) is 5 SSE2 vectors, 16 rows is 5
+ * AVX2 vectors and 32 rows is 5 AVX-512 vectors. For each index we precompute
+ * a byte mask over one group that selects the row's position within its
+ * group, and then sweep the groups, ORing each one into an accumulator under
+ * that mask and under a compare of the group number. At the end the
+ * accumulator holds only the wanted row (at its position in the group), which
+ * is pulled out by reading every position under a mask.
+ *
+ *  scalar - One row at a time, with ct_mask_u32(ct_eq_u32()) per row. This is
+ *           the reference the others are tested against (see
+ *           tools/kernel_tests.c).
+ *  sse2   - Groups of 8 rows.
+ *  avx2   - Groups of 16 rows.
+ *  avx512 - Groups of 32 rows.
+ *
+ * Every kernel reads every row, in order, whatever the indices are. An index
+ * past the end of the table gives all zeros.
+ *
+ * ct_packed_unpack() turns a selected entry back into the wordlist's usual
+ * form (length byte, letters, 'Z' padding) without branching on the length.
+ */
+
+#include <string.h>
+
+#include "ct_packed.h"
+#include "ct32.h"
+#include "memset_s.h"
+
+#define GROUP_BYTES(rows) ((rows) * CT_PACKED_ROW_LENGTH)
+
+static void select_many_scalar(const ct_packed_table *table, const uint32_t *indices, uint32_t count,
+                               unsigned char *out);
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+static void build_masks(const uint32_t *indices, uint32_t count, uint32_t group_rows,
+                        unsigned char masks[][GROUP_BYTES(CT_PACKED_GROUP_ROWS)]);
+static void extract_row(const unsigned char *group, uint32_t group_rows, uint32_t index, unsigned char *out);
+static void select_many_sse2(const ct_packed_table *table, const uint32_t *indices, uint32_t count,
+                             unsigned char *out);
+static int avx2_supported(void);
+static void select_many_avx2(const ct_packed_table *table, const uint32_t *indices, uint32_t count,
+                             unsigned char *out);
+static int avx512_supported(void);
+static void select_many_avx512(const ct_packed_table *table, const uint32_t *indices, uint32_t count,
+                               unsigned char *out);
+
+#endif
+
+static const ct_packed_kernel all_kernels[] = {
+    { "scalar", NULL, select_many_scalar },
+#if defined(__x86_64__)
+    { "sse2", NULL, select_many_sse2 },
+    { "avx2", avx2_supported, select_many_avx2 },
+    { "avx512", avx512_supported, select_many_avx512 },
+#endif
+};
+
+/*
+ * Returns the index'th kernel (whether it's supported or not), or NULL when
+ * 'index' is past the last one. Used to test and benchmark every kernel.
+ */
+const ct_packed_kernel *ct_packed_kernel_at(size_t index)
+{
+    if (index >= sizeof(all_kernels) / sizeof(all_kernels[0])) {
+        return NULL;
+    }
+    return &all_kernels[index];
+}
+
+/*
+ * Returns 1 if 'kernel' can be used on this machine, 0 otherwise.
+ */
+int ct_packed_kernel_supported(const ct_packed_kernel *kernel)
+{
+    return kernel->supported == NULL || kernel->supported();
+}
+
+/*
+ * Copies packed row indices[i] of 'table' (or zeros, if there's no such row)
+ * to out + i * CT_PACKED_ROW_LENGTH for each of the 'count' indices, sweeping
+ * the table once per CT_PACKED_BATCH indices with the fastest kernel this CPU
+ * supports. Returns 0 if the table's row count isn't a multiple of
+ * CT_PACKED_GROUP_ROWS, 1 otherwise.
+ */
+int ct_packed_select_many(const ct_packed_table *table, const uint32_t *indices, size_t count,
+                          unsigned char *out)
+{
+    if (table->row_count % CT_PACKED_GROUP_ROWS != 0) {
+        return 0;
+    }
+
+    /* The last supported kernel is the fastest. */
+    const ct_packed_kernel *best = &all_kernels[0];
+    for (size_t i = 1; i < sizeof(all_kernels) / sizeof(all_kernels[0]); i++) {
+        if (ct_packed_kernel_supported(&all_kernels[i])) {
+            best = &all_kernels[i];
+        }
+    }
+
+    for (size_t done = 0; done < count; done += CT_PACKED_BATCH) {
+        uint32_t n = count - done < CT_PACKED_BATCH ? count - done : CT_PACKED_BATCH;
+        best->select_many(table, indices + done, n, out + done * CT_PACKED_ROW_LENGTH);
+    }
+    return 1;
+}
+
+/*
+ * Unpacks a packed entry into 'letters' + 1 bytes: the length, then the
+ * letters, padded with 'Z' past the end of the word. 'letters' is at most
+ * CT_PACKED_MAX_LETTERS.
+ */
+void ct_packed_unpack(const unsigned char *packed, uint32_t letters, unsigned char *row)
+{
+    uint32_t length = packed[0] & 0x0F;
+
+    row[0] = length;
+    for (uint32_t j = 0; j < letters; j++) {
+        uint32_t bit = 4 + 5 * j;
+        uint32_t pair = packed[bit / 8];
+        if (bit / 8 + 1 < CT_PACKED_ROW_LENGTH) {
+            pair |= (uint32_t)packed[bit / 8 + 1] << 8;
+        }
+        uint32_t letter = 'a' + ((pair >> (bit % 8)) & 0x1F);
+        row[1 + j] = ct_select_u32(letter, 'Z', ct_lt_u32(j, length)) & 0xFF;
+    }
+}
+
+static void select_many_scalar(const ct_packed_table *table, const uint32_t *indices, uint32_t count,
+                               unsigned char *out)
+{
+    memset(out, 0, (size_t)count * CT_PACKED_ROW_LENGTH);
+
+    for (uint32_t k = 0; k < count; k++) {
+        const unsigned char *row = table->rows;
+        unsigned char *selected = out + (size_t)k * CT_PACKED_ROW_LENGTH;
+        for (uint32_t i = 0; i < table->row_count; i++) {
+            unsigned char mask = ct_mask_u32(ct_eq_u32(i, indices[k])) & 0xFF;
+            for (uint32_t j = 0; j < CT_PACKED_ROW_LENGTH; j++) {
+                selected[j] |= row[j] & mask;
+            }
+            row += CT_PACKED_ROW_LENGTH;
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * For each index, sets the bytes of a 'group_rows'-row group that belong to the
+ * index's position within its group to 0xFF, and the rest to 0.
+ */
+static void build_masks(const uint32_t *indices, uint32_t count, uint32_t group_rows,
+                        unsigned char masks[][GROUP_BYTES(CT_PACKED_GROUP_ROWS)])
+{
+    for (uint32_t k = 0; k < count; k++) {
+        uint32_t position = indices[k] & (group_rows - 1);
+        for (uint32_t r = 0; r < group_rows; r++) {
+            int mask = ct_mask_u32(ct_eq_u32(r, position)) & 0xFF;
+            memset(masks[k] + r * CT_PACKED_ROW_LENGTH, mask, CT_PACKED_ROW_LENGTH);
+        }
+    }
+}
+
+/* Copies the row at index's position out of an accumulated group. */
+static void extract_row(const unsigned char *group, uint32_t group_rows, uint32_t index, unsigned char *out)
+{
+    uint32_t position = index & (group_rows - 1);
+
+    memset(out, 0, CT_PACKED_ROW_LENGTH);
+    for (uint32_t r = 0; r < group_rows; r++) {
+        unsigned char mask = ct_mask_u32(ct_eq_u32(r, position)) & 0xFF;
+        for (uint32_t j = 0; j < CT_PACKED_ROW_LENGTH; j++) {
+            out[j] |= group[r * CT_PACKED_ROW_LENGTH + j] & mask;
+        }
+    }
+}
+
+#define SSE2_GROUP_ROWS 8
+#define AVX2_GROUP_ROWS 16
+#define AVX512_GROUP_ROWS 32
+
+static void select_many_sse2(const ct_packed_table *table, const uint32_t *indices, uint32_t count,
+                             unsigned char *out)
+{
+    unsigned char masks[CT_PACKED_BATCH][GROUP_BYTES(CT_PACKED_GROUP_ROWS)];
+    unsigned char results[CT_PACKED_BATCH][GROUP_BYTES(SSE2_GROUP_ROWS)];
+    __m128i acc[CT_PACKED_BATCH][5];
+    __m128i targets[CT_PACKED_BATCH];
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i group_number = _mm_setzero_si128();
+
+    build_masks(indices, count, SSE2_GROUP_ROWS, masks);
+    for (uint32_t k = 0; k < count; k++) {
+        targets[k] = _mm_set1_epi32((int)(indices[k] / SSE2_GROUP_ROWS));
+        for (int v = 0; v < 5; v++) {
+            acc[k][v] = _mm_setzero_si128();
+        }
+    }
+
+    for (uint32_t g = 0; g < table->row_count / SSE2_GROUP_ROWS; g++) {
+        const unsigned char *group = table->rows + (size_t)g * GROUP_BYTES(SSE2_GROUP_ROWS);
+        __m128i rows[5];
+        for (int v = 0; v < 5; v++) {
+            rows[v] = _mm_loadu_si128((const __m128i *)(group + 16 * v));
+        }
+        for (uint32_t k = 0; k < count; k++) {
+            __m128i in_group = _mm_cmpeq_epi32(group_number, targets[k]);
+            for (int v = 0; v < 5; v++) {
+                __m128i mask = _mm_and_si128(in_group, _mm_loadu_si128((const __m128i *)(masks[k] + 16 * v)));
+                acc[k][v] = _mm_or_si128(acc[k][v], _mm_and_si128(rows[v], mask));
+            }
+        }
+        group_number = _mm_add_epi32(group_number, one);
+    }
+
+    for (uint32_t k = 0; k < count; k++) {
+        for (int v = 0; v < 5; v++) {
+            _mm_storeu_si128((__m128i *)(results[k] + 16 * v), acc[k][v]);
+        }
+        extract_row(results[k], SSE2_GROUP_ROWS, indices[k], out + k * CT_PACKED_ROW_LENGTH);
+    }
+
+    /* Only the first 'count' of each were used. */
+    memset_s(masks, 0, count * sizeof(masks[0]));
+    memset_s(results, 0, count * sizeof(results[0]));
+    memset_s(acc, 0, count * sizeof(acc[0]));
+    memset_s(targets, 0, count * sizeof(targets[0]));
+}
+
+static int avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void select_many_avx2(const ct_packed_table *table, const uint32_t *indices, uint32_t count,
+                             unsigned char *out)
+{
+    unsigned char masks[CT_PACKED_BATCH][GROUP_BYTES(CT_PACKED_GROUP_ROWS)];
+    unsigned char results[CT_PACKED_BATCH][GROUP_BYTES(AVX2_GROUP_ROWS)];
+    __m256i acc[CT_PACKED_BATCH][5];
+    __m256i targets[CT_PACKED_BATCH];
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i group_number = _mm256_setzero_si256();
+
+    build_masks(indices, count, AVX2_GROUP_ROWS, masks);
+    for (uint32_t k = 0; k < count; k++) {
+        targets[k] = _mm256_set1_epi32((int)(indices[k] / AVX2_GROUP_ROWS));
+        for (int v = 0; v < 5; v++) {
+            acc[k][v] = _mm256_setzero_si256();
+        }
+    }
+
+    for (uint32_t g = 0; g < table->row_count / AVX2_GROUP_ROWS; g++) {
+        const unsigned char *group = table->rows + (size_t)g * GROUP_BYTES(AVX2_GROUP_ROWS);
+        __m256i rows[5];
+        for (int v = 0; v < 5; v++) {
+            rows[v] = _mm256_loadu_si256((const __m256i *)(group + 32 * v));
+        }
+        for (uint32_t k = 0; k < count; k++) {
+            __m256i in_group = _mm256_cmpeq_epi32(group_number, targets[k]);
+            for (int v = 0; v < 5; v++) {
+                __m256i mask = _mm256_and_si256(in_group, _mm256_loadu_si256((const __m256i *)(masks[k] + 32 * v)));
+                acc[k][v] = _mm256_or_si256(acc[k][v], _mm256_and_si256(rows[v], mask));
+            }
+        }
+        group_number = _mm256_add_epi32(group_number, one);
+    }
+
+    for (uint32_t k = 0; k < count; k++) {
+        for (int v = 0; v < 5; v++) {
+            _mm256_storeu_si256((__m256i *)(results[k] + 32 * v), acc[k][v]);
+        }
+        extract_row(results[k], AVX2_GROUP_ROWS, indices[k], out + k * CT_PACKED_ROW_LENGTH);
+    }
+
+    /* Only the first 'count' of each were used. */
+    memset_s(masks, 0, count * sizeof(masks[0]));
+    memset_s(results, 0, count * sizeof(results[0]));
+    memset_s(acc, 0, count * sizeof(acc[0]));
+    memset_s(targets, 0, count * sizeof(targets[0]));
+}
+
+static int avx512_supported(void)
+{
+    return __builtin_cpu_supports("avx512f");
+}
+
+__attribute__((target("avx512f")))
+static void select_many_avx512(const ct_packed_table *table, const uint32_t *indices, uint32_t count,
+                               unsigned char *out)
+{
+    unsigned char masks[CT_PACKED_BATCH][GROUP_BYTES(CT_PACKED_GROUP_ROWS)];
+    unsigned char results[CT_PACKED_BATCH][GROUP_BYTES(AVX512_GROUP_ROWS)];
+    __m512i acc[CT_PACKED_BATCH][5];
+    __m512i targets[CT_PACKED_BATCH];
+    const __m512i one = _mm512_set1_epi32(1);
+    __m512i group_number = _mm512_setzero_si512();
+
+    build_masks(indices, count, AVX512_GROUP_ROWS, masks);
+    for (uint32_t k = 0; k < count; k++) {
+        targets[k] = _mm512_set1_epi32((int)(indices[k] / AVX512_GROUP_ROWS));
+        for (int v = 0; v < 5; v++) {
+            acc[k][v] = _mm512_setzero_si512();
+        }
+    }
+
+    for (uint32_t g = 0; g < table->row_count / AVX512_GROUP_ROWS; g++) {
+        const unsigned char *group = table->rows + (size_t)g * GROUP_BYTES(AVX512_GROUP_ROWS);
+        __m512i rows[5];
+        for (int v = 0; v < 5; v++) {
+            rows[v] = _mm512_loadu_si512((const void *)(group + 64 * v));
+        }
+        for (uint32_t k = 0; k < count; k++) {
+            __mmask16 in_group = _mm512_cmpeq_epi32_mask(group_number, targets[k]);
+            for (int v = 0; v < 5; v++) {
+                __m512i mask = _mm512_loadu_si512((const void *)(masks[k] + 64 * v));
+                /* acc | (rows & mask), only in the index's group. */
+                acc[k][v] = _mm512_mask_ternarylogic_epi32(acc[k][v], in_group, rows[v], mask, 0xF8);
+            }
+        }
+        group_number = _mm512_add_epi32(group_number, one);
+    }
+
+    for (uint32_t k = 0; k < count; k++) {
+        for (int v = 0; v < 5; v++) {
+            _mm512_storeu_si512((void *)(results[k] + 64 * v), acc[k][v]);
+        }
+        extract_row(results[k], AVX512_GROUP_ROWS, indices[k], out + k * CT_PACKED_ROW_LENGTH);
+    }
+
+    /* Only the first 'count' of each were used. */
+    memset_s(masks, 0, count * sizeof(masks[0]));
+    memset_s(results, 0, count * sizeof(results[0]));
+    memset_s(acc, 0, count * sizeof(acc[0]));
+    memset_s(targets, 0, count * sizeof(targets[0]));
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef CT_PACKED_H
+#define CT_PACKED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* 4 bits of length and 15 letters of 5 bits each fit in 10 bytes. */
+#define CT_PACKED_ROW_LENGTH 10
+#define CT_PACKED_MAX_LETTERS 15
+/* The row count must be a multiple of this (pad with all-zero rows). */
+#define CT_PACKED_GROUP_ROWS 32
+/* How many indices one sweep over the table can resolve. */
+#define CT_PACKED_BATCH 16
+
+/* A table of packed words, CT_PACKED_ROW_LENGTH bytes each. */
+typedef struct ConstantTimePackedTable {
+    const unsigned char *rows;
+    uint32_t row_count;
+} ct_packed_table;
+
+typedef struct ConstantTimePackedKernel {
+    const char *name;
+    /* Returns 1 if the kernel can run on this CPU. May be NULL. */
+    int (*supported)(void);
+    /* Selects 'count' (at most CT_PACKED_BATCH) rows in one sweep. */
+    void (*select_many)(const ct_packed_table *table, const uint32_t *indices, uint32_t count,
+                        unsigned char *out);
+} ct_packed_kernel;
+
+const ct_packed_kernel *ct_packed_kernel_at(size_t index);
+int ct_packed_kernel_supported(const ct_packed_kernel *kernel);
+
+int ct_packed_select_many(const ct_packed_table *table, const uint32_t *indices, size_t count,
+                          unsigned char *out);
+void ct_packed_unpack(const unsigned char *packed, uint32_t letters, unsigned char *row);
+
+#endif
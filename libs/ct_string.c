@@ -38,6 +38,33 @@
  * they have no idea that each concatenation was really only adding three
  * characters for a total actual length of 18.
  * 
+ * If the sum of the maximum lengths is known up front, initialize the string
+ * with ct_string_init_capacity() or ct_string_init_buffer() instead. Then the
+ * memory is allocated (or provided) once, concatenations never realloc() (and
+ * so never leave copies of the string behind in freed memory), and
+ * ct_string_reset() wipes it for reuse by the next string.
+ *
+ * To put the new bytes at the secret offset (the actual length so far), the
+ * obvious way is to try every possible offset and OR them in under a mask for
+ * the right one, which is O(allocated length * max length) per concatenation.
+ * ct_string_concat_reference() still does that. ct_string_concat() instead
+ * copies the new bytes to the start of a scratch buffer and shifts them into
+ * place with a barrel shifter: one pass over the buffer for each bit of the
+ * offset, shifting by that bit's value or not under a mask. The number of
+ * passes depends only on the allocated length, so that's O(n log n) and it
+ * still only leaks the maximum lengths.
+ *
+ * The passes (and ct_string_finalize()) are done by one of these kernels:
+ *
+ *  scalar - One byte at a time, with the ct32.c functions. This is the
+ *           reference the others are tested against (see
+ *           tools/kernel_tests.c).
+ *  sse2   - 16 bytes at a time. "Is byte i before the actual length?" becomes
+ *           a compare of the byte offsets 0..15 against the broadcast number
+ *           of meaningful bytes left in the block (clamped to 0..16), and the
+ *           selects become AND/ANDNOT/OR.
+ *  avx2   - The same, 32 bytes at a time.
+ *
  * WARNING: Be cautious of other side channels that might leak information about
  * your string. If you print the string to a terminal, its word-wrap might leak
  * some information about it!
@@ -50,6 +77,80 @@
 #include "ct32.h"
 #include "memset_s.h"
 
+static int grow(ct_string *str, uint32_t max_length);
+static const ct_string_kernel *best_kernel(void);
+static void place(const ct_string_kernel *kernel, unsigned char *string, unsigned char *scratch,
+                  uint32_t old_allocated_length, uint32_t allocated_length, const unsigned char *to_append,
+                  uint32_t max_length, uint32_t actual_length, uint32_t offset);
+static void prepare_scalar(unsigned char *scratch, uint32_t length, const unsigned char *to_append,
+                           uint32_t max_length, uint32_t actual_length);
+static void shift_scalar(unsigned char *scratch, uint32_t length, uint32_t shift, uint32_t mask);
+static void merge_scalar(unsigned char *string, const unsigned char *scratch, uint32_t length);
+static void finalize_scalar(const unsigned char *string, unsigned char *buf, uint32_t length,
+                            uint32_t actual_length, unsigned char filler);
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+static uint32_t ct_after(uint32_t actual_length, uint32_t start);
+static uint32_t ct_remaining(uint32_t actual_length, uint32_t start, uint32_t width);
+static void prepare_sse2(unsigned char *scratch, uint32_t length, const unsigned char *to_append,
+                         uint32_t max_length, uint32_t actual_length);
+static void shift_sse2(unsigned char *scratch, uint32_t length, uint32_t shift, uint32_t mask);
+static void merge_sse2(unsigned char *string, const unsigned char *scratch, uint32_t length);
+static void finalize_sse2(const unsigned char *string, unsigned char *buf, uint32_t length,
+                          uint32_t actual_length, unsigned char filler);
+static int avx2_supported(void);
+static void prepare_avx2(unsigned char *scratch, uint32_t length, const unsigned char *to_append,
+                         uint32_t max_length, uint32_t actual_length);
+static void shift_avx2(unsigned char *scratch, uint32_t length, uint32_t shift, uint32_t mask);
+static void merge_avx2(unsigned char *string, const unsigned char *scratch, uint32_t length);
+static void finalize_avx2(const unsigned char *string, unsigned char *buf, uint32_t length,
+                          uint32_t actual_length, unsigned char filler);
+
+#endif
+
+static const ct_string_kernel all_kernels[] = {
+    { "scalar", NULL, prepare_scalar, shift_scalar, merge_scalar, finalize_scalar },
+#if defined(__x86_64__)
+    { "sse2", NULL, prepare_sse2, shift_sse2, merge_sse2, finalize_sse2 },
+    { "avx2", avx2_supported, prepare_avx2, shift_avx2, merge_avx2, finalize_avx2 },
+#endif
+};
+
+/*
+ * Returns the index'th kernel (whether it's supported or not), or NULL when
+ * 'index' is past the last one. Used to test and benchmark every kernel.
+ */
+const ct_string_kernel *ct_string_kernel_at(size_t index)
+{
+    if (index >= sizeof(all_kernels) / sizeof(all_kernels[0])) {
+        return NULL;
+    }
+    return &all_kernels[index];
+}
+
+/*
+ * Returns 1 if 'kernel' can be used on this machine, 0 otherwise.
+ */
+int ct_string_kernel_supported(const ct_string_kernel *kernel)
+{
+    return kernel->supported == NULL || kernel->supported();
+}
+
+/* Returns the fastest kernel this CPU supports (the last supported one). */
+static const ct_string_kernel *best_kernel(void)
+{
+    const ct_string_kernel *best = &all_kernels[0];
+    for (size_t i = 1; i < sizeof(all_kernels) / sizeof(all_kernels[0]); i++) {
+        if (ct_string_kernel_supported(&all_kernels[i])) {
+            best = &all_kernels[i];
+        }
+    }
+    return best;
+}
+
 /*
  * Initializes a ct_string context.
  */
@@ -58,6 +159,66 @@ void ct_string_init(ct_string *str)
     str->allocated_length = 0;
     str->actual_length = 0;
     str->string = NULL;
+    str->scratch = NULL;
+    str->capacity = 0;
+    str->owns_string = 1;
+}
+
+/*
+ * Initializes a ct_string context with room for 'capacity' bytes (the sum of
+ * the maximum lengths of everything that will be concatenated), allocated
+ * once. Returns 0 on failure, 1 on success.
+ */
+int ct_string_init_capacity(ct_string *str, uint32_t capacity)
+{
+    ct_string_init(str);
+    if (capacity == 0 || capacity > UINT32_MAX / 2) {
+        return 0;
+    }
+    /* The string, then the scratch space for ct_string_concat(). */
+    str->string = calloc(CT_STRING_BUFFER_LENGTH(capacity), 1);
+    if (str->string == NULL) {
+        return 0;
+    }
+    str->scratch = str->string + capacity;
+    str->capacity = capacity;
+    return 1;
+}
+
+/*
+ * Initializes a ct_string context that builds a string of up to 'capacity'
+ * bytes in 'buffer', which must have room for CT_STRING_BUFFER_LENGTH(capacity)
+ * bytes and outlive the context. The buffer is zeroed, and wiped (but not
+ * freed) by ct_string_deinit().
+ */
+void ct_string_init_buffer(ct_string *str, unsigned char *buffer, uint32_t capacity)
+{
+    ct_string_init(str);
+    memset(buffer, 0, CT_STRING_BUFFER_LENGTH((size_t)capacity));
+    str->string = buffer;
+    str->scratch = buffer + capacity;
+    str->capacity = capacity;
+    str->owns_string = 0;
+}
+
+/*
+ * Wipes the string so the context can build another one, keeping its memory.
+ */
+void ct_string_reset(ct_string *str)
+{
+    if (str->string != NULL) {
+        memset_s(str->string, 0, str->allocated_length);
+    }
+    if (str->scratch != NULL) {
+        memset_s(str->scratch, 0, str->allocated_length);
+    }
+    if (str->capacity == 0 && str->string != NULL) {
+        /* A growing string starts again from nothing. */
+        free(str->string);
+        str->string = NULL;
+    }
+    str->allocated_length = 0;
+    str->actual_length = 0;
 }
 
 /*
@@ -70,16 +231,97 @@ void ct_string_init(ct_string *str)
  * Returns 0 on failure, 1 on success.
  */
 int ct_string_concat(ct_string *str, const unsigned char *to_append, uint32_t max_length, uint32_t actual_length)
+{
+    return ct_string_concat_with(best_kernel(), str, to_append, max_length, actual_length);
+}
+
+/*
+ * Like ct_string_concat(), using 'kernel'.
+ */
+int ct_string_concat_with(const ct_string_kernel *kernel, ct_string *str, const unsigned char *to_append,
+                          uint32_t max_length, uint32_t actual_length)
+{
+    uint32_t old_allocated_length = str->allocated_length;
+    unsigned char *scratch = str->scratch;
+
+    if (max_length == 0 || actual_length == 0 || actual_length > max_length) {
+        return 0;
+    }
+    if (!grow(str, max_length)) {
+        return 0;
+    }
+
+    /* A growing string has no scratch space of its own. */
+    if (scratch == NULL) {
+        scratch = malloc(str->allocated_length);
+        if (scratch == NULL) {
+            return 0;
+        }
+    }
+
+    place(kernel, str->string, scratch, old_allocated_length, str->allocated_length,
+          to_append, max_length, actual_length, str->actual_length);
+    str->actual_length += actual_length;
+
+    memset_s(scratch, 0, str->allocated_length);
+    if (scratch != str->scratch) {
+        free(scratch);
+    }
+
+    return 1;
+}
+
+/*
+ * Does the same as ct_string_concat(), trying every offset in turn. It's
+ * O(allocated length * max_length), and kept to test ct_string_concat()
+ * against.
+ */
+int ct_string_concat_reference(ct_string *str, const unsigned char *to_append, uint32_t max_length,
+                               uint32_t actual_length)
 {
     if (max_length == 0 || actual_length == 0 || actual_length > max_length) {
         return 0;
     }
+    if (!grow(str, max_length)) {
+        return 0;
+    }
 
-    /* Every time this function is called, the allocated length of the string
+    for (uint32_t i = 0; i + max_length - 1 < str->allocated_length; i++) {
+        /* outer_mask is 0xFFFFFFFF only when we're at the right spot in the
+         * string to start ORing in bytes from to_append. This will leave all
+         * the other bytes in the string unchanged until we get to the right
+         * index. */
+        uint32_t outer_mask = ct_mask_u32(ct_eq_u32(i, str->actual_length));
+        for (uint32_t j = 0; j < max_length; j++) {
+            /* inner_mask is 0xFFFFFFFF until we've gone past the actual length
+             * of to_append, so that its padding bytes don't clobber our
+             * string's zero padding bytes. */
+            uint32_t inner_mask = ct_mask_u32(ct_lt_u32(j, actual_length));
+            str->string[i+j] |= (uint32_t)to_append[j] & outer_mask & inner_mask;
+        }
+    }
+    str->actual_length += actual_length;
+
+    return 1;
+}
+
+/*
+ * Increases the allocated length of the string by max_length, with the new
+ * bytes zero. Returns 0 on failure, 1 on success.
+ */
+static int grow(ct_string *str, uint32_t max_length)
+{
+    /* Every time a string is concatenated, the allocated length of the string
      * increases by max_length, and the new memory is initialized to zero. This
      * is important, since we're going to bitwise-or stuff into it later. */
 
-    if (str->string == NULL) {
+    if (str->capacity != 0) {
+        /* The memory is already there (and zero). Just make sure it fits. */
+        if (max_length > str->capacity - str->allocated_length) {
+            return 0;
+        }
+        str->allocated_length += max_length;
+    } else if (str->string == NULL) {
         /* If this is the first time, allocate the buffer and zero it. */
         str->string = malloc(max_length);
         if (str->string == NULL) {
@@ -97,23 +339,29 @@ int ct_string_concat(ct_string *str, const unsigned char *to_append, uint32_t ma
         str->allocated_length += max_length;
     }
 
-    for (uint32_t i = 0; i + max_length - 1 < str->allocated_length; i++) {
-        /* outer_mask is 0xFFFFFFFF only when we're at the right spot in the
-         * string to start ORing in bytes from to_append. This will leave all
-         * the other bytes in the string unchanged until we get to the right
-         * index. */
-        uint32_t outer_mask = ct_mask_u32(ct_eq_u32(i, str->actual_length));
-        for (uint32_t j = 0; j < max_length; j++) {
-            /* inner_mask is 0xFFFFFFFF until we've gone past the actual length
-             * of to_append, so that its padding bytes don't clobber our
-             * string's zero padding bytes. */
-            uint32_t inner_mask = ct_mask_u32(ct_lt_u32(j, actual_length));
-            str->string[i+j] |= (uint32_t)to_append[j] & outer_mask & inner_mask;
-        }
+    return 1;
+}
+
+/*
+ * ORs the first actual_length bytes of to_append into string at 'offset',
+ * which is at most old_allocated_length, using 'scratch' (allocated_length
+ * bytes). Every pass reads and writes the whole of 'scratch' no matter what
+ * 'offset' and 'actual_length' are.
+ */
+static void place(const ct_string_kernel *kernel, unsigned char *string, unsigned char *scratch,
+                  uint32_t old_allocated_length, uint32_t allocated_length, const unsigned char *to_append,
+                  uint32_t max_length, uint32_t actual_length, uint32_t offset)
+{
+    /* The meaningful bytes of to_append at the start, zeros everywhere else. */
+    kernel->prepare(scratch, allocated_length, to_append, max_length, actual_length);
+
+    /* Shift them right by each bit of the offset that's set. The offset is at
+     * most old_allocated_length, so no higher bits are set. */
+    for (uint32_t shift = 1; shift != 0 && shift <= old_allocated_length; shift <<= 1) {
+        kernel->shift(scratch, allocated_length, shift, ct_mask_u32(ct_isnonzero_u32(offset & shift)));
     }
-    str->actual_length += actual_length;
 
-    return 1;
+    kernel->merge(string, scratch, allocated_length);
 }
 
 /*
@@ -126,10 +374,16 @@ int ct_string_concat(ct_string *str, const unsigned char *to_append, uint32_t ma
  */
 void ct_string_finalize(ct_string *str, unsigned char *buf, unsigned char filler)
 {
-    for (uint32_t i = 0; i < str->allocated_length; i++) {
-        /* buf[i] = (j < actual_length) ? str->string[i] : filler */
-        buf[i] = ct_select_u32(str->string[i], filler, ct_lt_u32(i, str->actual_length));
-    }
+    ct_string_finalize_with(best_kernel(), str, buf, filler);
+}
+
+/*
+ * Like ct_string_finalize(), using 'kernel'.
+ */
+void ct_string_finalize_with(const ct_string_kernel *kernel, ct_string *str, unsigned char *buf,
+                             unsigned char filler)
+{
+    kernel->finalize(str->string, buf, str->allocated_length, str->actual_length, filler);
 }
 
 /*
@@ -145,10 +399,249 @@ uint32_t ct_string_allocated_length(ct_string *str)
  */
 void ct_string_deinit(ct_string *str)
 {
+    if (str->scratch != NULL) {
+        memset_s(str->scratch, 0, str->allocated_length);
+    }
     if (str->string != NULL) {
         memset_s(str->string, 0, str->allocated_length);
-        free(str->string);
+        if (str->owns_string) {
+            free(str->string);
+        }
     }
     memset_s(&(str->allocated_length), 0, sizeof(str->allocated_length));
     memset_s(&(str->actual_length), 0, sizeof(str->actual_length));
 }
+
+/* scratch[i] = to_append[i] if i < actual_length, 0 otherwise. */
+static void prepare_scalar(unsigned char *scratch, uint32_t length, const unsigned char *to_append,
+                           uint32_t max_length, uint32_t actual_length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        uint32_t byte = i < max_length ? to_append[i] : 0;
+        scratch[i] = byte & ct_mask_u32(ct_lt_u32(i, actual_length));
+    }
+}
+
+/* Shifts scratch right by 'shift' bytes if mask is all ones, not if it's 0. */
+static void shift_scalar(unsigned char *scratch, uint32_t length, uint32_t shift, uint32_t mask)
+{
+    /* Going down from the end, scratch[i - shift] hasn't been overwritten yet
+     * when we read it. */
+    for (uint32_t i = length; i-- > 0; ) {
+        uint32_t moved = i >= shift ? scratch[i - shift] : 0;
+        scratch[i] = (moved & mask) | (scratch[i] & ~mask);
+    }
+}
+
+static void merge_scalar(unsigned char *string, const unsigned char *scratch, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        string[i] |= scratch[i];
+    }
+}
+
+static void finalize_scalar(const unsigned char *string, unsigned char *buf, uint32_t length,
+                            uint32_t actual_length, unsigned char filler)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        /* buf[i] = (i < actual_length) ? string[i] : filler */
+        buf[i] = ct_select_u32(string[i], filler, ct_lt_u32(i, actual_length));
+    }
+}
+
+#if defined(__x86_64__)
+
+/* Returns actual_length - start, or 0 if that would be negative. */
+static uint32_t ct_after(uint32_t actual_length, uint32_t start)
+{
+    return ct_select_u32(0, actual_length - start, ct_lt_u32(actual_length, start));
+}
+
+/*
+ * Returns how many of the 'width' bytes starting at 'start' are before
+ * actual_length: actual_length - start, clamped to between 0 and 'width'.
+ */
+static uint32_t ct_remaining(uint32_t actual_length, uint32_t start, uint32_t width)
+{
+    uint32_t left = ct_after(actual_length, start);
+    return ct_select_u32(width, left, ct_gt_u32(left, width));
+}
+
+static void prepare_sse2(unsigned char *scratch, uint32_t length, const unsigned char *to_append,
+                         uint32_t max_length, uint32_t actual_length)
+{
+    const __m128i offsets = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    unsigned char block[16];
+    uint32_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        /* The part of to_append in this block, through a buffer at the end. */
+        __m128i bytes;
+        if (i + 16 <= max_length) {
+            bytes = _mm_loadu_si128((const __m128i *)(to_append + i));
+        } else {
+            memset(block, 0, sizeof(block));
+            if (i < max_length) {
+                memcpy(block, to_append + i, max_length - i);
+            }
+            bytes = _mm_loadu_si128((const __m128i *)block);
+        }
+        __m128i left = _mm_set1_epi8((char)ct_remaining(actual_length, i, 16));
+        __m128i keep = _mm_cmpgt_epi8(left, offsets);
+        _mm_storeu_si128((__m128i *)(scratch + i), _mm_and_si128(bytes, keep));
+    }
+    if (i < length) {
+        prepare_scalar(scratch + i, length - i, to_append + (i < max_length ? i : max_length),
+                       i < max_length ? max_length - i : 0, ct_after(actual_length, i));
+    }
+
+    memset_s(block, 0, sizeof(block));
+}
+
+static void shift_sse2(unsigned char *scratch, uint32_t length, uint32_t shift, uint32_t mask)
+{
+    const __m128i select = _mm_set1_epi8((char)(mask & 0xFF));
+    uint32_t end = length - length % 16;
+
+    /* Going down from the end, as in shift_scalar(). The odd bytes at the top
+     * and the bytes with nothing 'shift' below them (and so can't be a
+     * whole vector) are done one at a time, in the same order. */
+    for (uint32_t i = length; i-- > end; ) {
+        uint32_t moved = i >= shift ? scratch[i - shift] : 0;
+        scratch[i] = (moved & mask) | (scratch[i] & ~mask);
+    }
+    while (end >= 16 && end - 16 >= shift) {
+        end -= 16;
+        __m128i moved = _mm_loadu_si128((const __m128i *)(scratch + end - shift));
+        __m128i current = _mm_loadu_si128((const __m128i *)(scratch + end));
+        __m128i result = _mm_or_si128(_mm_and_si128(select, moved), _mm_andnot_si128(select, current));
+        _mm_storeu_si128((__m128i *)(scratch + end), result);
+    }
+    shift_scalar(scratch, end, shift, mask);
+}
+
+static void merge_sse2(unsigned char *string, const unsigned char *scratch, uint32_t length)
+{
+    uint32_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(string + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(scratch + i));
+        _mm_storeu_si128((__m128i *)(string + i), _mm_or_si128(a, b));
+    }
+    merge_scalar(string + i, scratch + i, length - i);
+}
+
+static void finalize_sse2(const unsigned char *string, unsigned char *buf, uint32_t length,
+                          uint32_t actual_length, unsigned char filler)
+{
+    const __m128i offsets = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i fill = _mm_set1_epi8((char)filler);
+    uint32_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(string + i));
+        __m128i left = _mm_set1_epi8((char)ct_remaining(actual_length, i, 16));
+        __m128i keep = _mm_cmpgt_epi8(left, offsets);
+        __m128i result = _mm_or_si128(_mm_and_si128(keep, bytes), _mm_andnot_si128(keep, fill));
+        _mm_storeu_si128((__m128i *)(buf + i), result);
+    }
+    for (; i < length; i++) {
+        buf[i] = ct_select_u32(string[i], filler, ct_lt_u32(i, actual_length));
+    }
+}
+
+static int avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void prepare_avx2(unsigned char *scratch, uint32_t length, const unsigned char *to_append,
+                         uint32_t max_length, uint32_t actual_length)
+{
+    const __m256i offsets = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                             16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    unsigned char block[32];
+    uint32_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes;
+        if (i + 32 <= max_length) {
+            bytes = _mm256_loadu_si256((const __m256i *)(to_append + i));
+        } else {
+            memset(block, 0, sizeof(block));
+            if (i < max_length) {
+                memcpy(block, to_append + i, max_length - i);
+            }
+            bytes = _mm256_loadu_si256((const __m256i *)block);
+        }
+        __m256i left = _mm256_set1_epi8((char)ct_remaining(actual_length, i, 32));
+        __m256i keep = _mm256_cmpgt_epi8(left, offsets);
+        _mm256_storeu_si256((__m256i *)(scratch + i), _mm256_and_si256(bytes, keep));
+    }
+    /* Clear the upper halves first, or the non-VEX SSE2 code stalls. */
+    _mm256_zeroupper();
+    if (i < length) {
+        prepare_sse2(scratch + i, length - i, to_append + (i < max_length ? i : max_length),
+                     i < max_length ? max_length - i : 0, ct_after(actual_length, i));
+    }
+
+    memset_s(block, 0, sizeof(block));
+}
+
+__attribute__((target("avx2")))
+static void shift_avx2(unsigned char *scratch, uint32_t length, uint32_t shift, uint32_t mask)
+{
+    const __m256i select = _mm256_set1_epi8((char)(mask & 0xFF));
+    uint32_t end = length - length % 32;
+
+    /* As in shift_sse2(), 32 bytes at a time. */
+    for (uint32_t i = length; i-- > end; ) {
+        uint32_t moved = i >= shift ? scratch[i - shift] : 0;
+        scratch[i] = (moved & mask) | (scratch[i] & ~mask);
+    }
+    while (end >= 32 && end - 32 >= shift) {
+        end -= 32;
+        __m256i moved = _mm256_loadu_si256((const __m256i *)(scratch + end - shift));
+        __m256i current = _mm256_loadu_si256((const __m256i *)(scratch + end));
+        __m256i result = _mm256_or_si256(_mm256_and_si256(select, moved), _mm256_andnot_si256(select, current));
+        _mm256_storeu_si256((__m256i *)(scratch + end), result);
+    }
+    _mm256_zeroupper();
+    shift_sse2(scratch, end, shift, mask);
+}
+
+__attribute__((target("avx2")))
+static void merge_avx2(unsigned char *string, const unsigned char *scratch, uint32_t length)
+{
+    uint32_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(string + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(scratch + i));
+        _mm256_storeu_si256((__m256i *)(string + i), _mm256_or_si256(a, b));
+    }
+    _mm256_zeroupper();
+    merge_sse2(string + i, scratch + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static void finalize_avx2(const unsigned char *string, unsigned char *buf, uint32_t length,
+                          uint32_t actual_length, unsigned char filler)
+{
+    const __m256i offsets = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                             16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    const __m256i fill = _mm256_set1_epi8((char)filler);
+    uint32_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(string + i));
+        __m256i left = _mm256_set1_epi8((char)ct_remaining(actual_length, i, 32));
+        __m256i keep = _mm256_cmpgt_epi8(left, offsets);
+        __m256i result = _mm256_or_si256(_mm256_and_si256(keep, bytes), _mm256_andnot_si256(keep, fill));
+        _mm256_storeu_si256((__m256i *)(buf + i), result);
+    }
+    _mm256_zeroupper();
+    finalize_sse2(string + i, buf + i, length - i, ct_after(actual_length, i), filler);
+}
+
+#endif
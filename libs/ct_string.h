@@ -1,17 +1,57 @@
 #ifndef CT_STRING_H
 #define CT_STRING_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* How big a buffer ct_string_init_buffer() needs for a string of up to
+ * 'capacity' bytes: the string, and as much again of scratch space. */
+#define CT_STRING_BUFFER_LENGTH(capacity) (2 * (capacity))
+
 typedef struct ConstantTimeString {
     uint32_t allocated_length;
     uint32_t actual_length;
     unsigned char *string;
+    /* Scratch space for concatenations, or NULL if 'string' grows. */
+    unsigned char *scratch;
+    /* The fixed size of 'string', or 0 if it grows with each concat. */
+    uint32_t capacity;
+    /* 1 if 'string' was malloc'd by us, 0 if the caller provided it. */
+    int owns_string;
 } ct_string;
 
+/* The byte-at-a-time passes behind ct_string_concat() and _finalize(). */
+typedef struct ConstantTimeStringKernel {
+    const char *name;
+    /* Returns 1 if the kernel can run on this CPU. May be NULL. */
+    int (*supported)(void);
+    /* scratch[i] = i < actual_length ? to_append[i] : 0, for i < length. */
+    void (*prepare)(unsigned char *scratch, uint32_t length, const unsigned char *to_append,
+                    uint32_t max_length, uint32_t actual_length);
+    /* Shifts scratch right by 'shift' bytes where mask is all ones. */
+    void (*shift)(unsigned char *scratch, uint32_t length, uint32_t shift, uint32_t mask);
+    /* string[i] |= scratch[i]. */
+    void (*merge)(unsigned char *string, const unsigned char *scratch, uint32_t length);
+    /* buf[i] = i < actual_length ? string[i] : filler. */
+    void (*finalize)(const unsigned char *string, unsigned char *buf, uint32_t length,
+                     uint32_t actual_length, unsigned char filler);
+} ct_string_kernel;
+
+const ct_string_kernel *ct_string_kernel_at(size_t index);
+int ct_string_kernel_supported(const ct_string_kernel *kernel);
+
 void ct_string_init(ct_string *str);
+int ct_string_init_capacity(ct_string *str, uint32_t capacity);
+void ct_string_init_buffer(ct_string *str, unsigned char *buffer, uint32_t capacity);
+void ct_string_reset(ct_string *str);
 int ct_string_concat(ct_string *str, const unsigned char *to_append, uint32_t max_length, uint32_t actual_length);
+int ct_string_concat_with(const ct_string_kernel *kernel, ct_string *str, const unsigned char *to_append,
+                          uint32_t max_length, uint32_t actual_length);
+int ct_string_concat_reference(ct_string *str, const unsigned char *to_append, uint32_t max_length,
+                               uint32_t actual_length);
 void ct_string_finalize(ct_string *str, unsigned char *buf, unsigned char filler);
+void ct_string_finalize_with(const ct_string_kernel *kernel, ct_string *str, unsigned char *buf,
+                             unsigned char filler);
 uint32_t ct_string_allocated_length(ct_string *str);
 void ct_string_deinit(ct_string *str);
 
@@ -0,0 +1,513 @@
+/*
+ * Constant-time selection of one row from a table, using SIMD.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * To look up a word without the cache revealing which one it was, we read
+ * every row of the table and OR each one into the output under a mask that is
+ * all ones for the selected row and all zeros for the others. Every kernel
+ * reads every row, in order, whatever the index is; an index past the end
+ * gives all zeros.
+ *
+ *  scalar - One byte at a time, with ct_mask_u32(ct_eq_u32()) per row. Works
+ *           for any row length. This is the reference the others are tested
+ *           against (see tools/kernel_tests.c).
+ *
+ *  sse2   - One 16-byte row per vector. The mask comes from comparing a vector
+ *           of row numbers with the broadcast index.
+ *
+ *  avx2   - Two rows per 32-byte vector.
+ *
+ *  avx512 - Four rows per 64-byte vector.
+ *
+ * The vector kernels only handle CT_TABLE_VECTOR_ROW_LENGTH-byte rows, which
+ * is what the wordlist uses. Rows left over at the end (when the row count
+ * isn't a multiple of the vector's) are done the SSE2 way.
+ *
+ * Looking up many words one at a time means sweeping the whole table for each
+ * of them. ct_table_select_many() resolves up to CT_TABLE_BATCH indices per
+ * sweep instead: each row (or vector of rows) is loaded once and compared
+ * against every index, with one accumulator per index. The scalar kernel
+ * still does one sweep per index, as the reference.
+ *
+ * For very large tables, ct_table_select_many_threaded() splits the rows into
+ * one contiguous slice per thread. Each thread sweeps its whole slice with the
+ * indices shifted to be relative to the slice (an index outside the slice
+ * wraps around to past its end, and so selects zeros), and the slices'
+ * results are ORed together at the end. Only one slice holds any given row,
+ * so that's the row.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ct_table.h"
+#include "ct32.h"
+#include "memset_s.h"
+
+static int handles_any(uint32_t row_length);
+static void select_scalar(const ct_table *table, uint32_t index, unsigned char *out);
+static void select_many_scalar(const ct_table *table, const uint32_t *indices, uint32_t count,
+                               unsigned char *out);
+static const ct_table_kernel *best_kernel(uint32_t row_length);
+
+typedef struct TableSlice {
+    ct_table table;
+    uint32_t first;
+    const uint32_t *indices;
+    size_t count;
+    unsigned char *out;
+} table_slice;
+
+static void *select_slice(void *argument);
+static void count_online_cpus(void);
+
+/* How many CPUs are online, looked up once. */
+static pthread_once_t online_cpus_once = PTHREAD_ONCE_INIT;
+static unsigned int online_cpus;
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+static int handles_vector(uint32_t row_length);
+static __m128i select_rows_sse2(const ct_table *table, uint32_t first, uint32_t index, __m128i result);
+static void select_sse2(const ct_table *table, uint32_t index, unsigned char *out);
+static void select_many_rows_sse2(const ct_table *table, uint32_t first, const uint32_t *indices,
+                                  uint32_t count, __m128i *results);
+static void select_many_sse2(const ct_table *table, const uint32_t *indices, uint32_t count,
+                             unsigned char *out);
+static int avx2_supported(void);
+static void select_avx2(const ct_table *table, uint32_t index, unsigned char *out);
+static void select_many_avx2(const ct_table *table, const uint32_t *indices, uint32_t count,
+                             unsigned char *out);
+static int avx512_supported(void);
+static void select_avx512(const ct_table *table, uint32_t index, unsigned char *out);
+static void select_many_avx512(const ct_table *table, const uint32_t *indices, uint32_t count,
+                               unsigned char *out);
+
+#endif
+
+static const ct_table_kernel all_kernels[] = {
+    { "scalar", NULL, handles_any, select_scalar, select_many_scalar },
+#if defined(__x86_64__)
+    { "sse2", NULL, handles_vector, select_sse2, select_many_sse2 },
+    { "avx2", avx2_supported, handles_vector, select_avx2, select_many_avx2 },
+    { "avx512", avx512_supported, handles_vector, select_avx512, select_many_avx512 },
+#endif
+};
+
+/*
+ * Returns the index'th kernel (whether it's supported or not), or NULL when
+ * 'index' is past the last one. Used to test and benchmark every kernel.
+ */
+const ct_table_kernel *ct_table_kernel_at(size_t index)
+{
+    if (index >= sizeof(all_kernels) / sizeof(all_kernels[0])) {
+        return NULL;
+    }
+    return &all_kernels[index];
+}
+
+/*
+ * Returns 1 if 'kernel' can be used on this machine, 0 otherwise.
+ */
+int ct_table_kernel_supported(const ct_table_kernel *kernel)
+{
+    return kernel->supported == NULL || kernel->supported();
+}
+
+/*
+ * Returns the fastest kernel that this CPU supports and that can handle rows
+ * of the given length. The last usable kernel is the fastest.
+ */
+static const ct_table_kernel *best_kernel(uint32_t row_length)
+{
+    const ct_table_kernel *best = &all_kernels[0];
+    for (size_t i = 1; i < sizeof(all_kernels) / sizeof(all_kernels[0]); i++) {
+        if (ct_table_kernel_supported(&all_kernels[i]) && all_kernels[i].handles(row_length)) {
+            best = &all_kernels[i];
+        }
+    }
+    return best;
+}
+
+/*
+ * Copies row 'index' of 'table' (or zeros, if there's no such row) to 'out',
+ * which must have room for table->row_length bytes.
+ */
+void ct_table_select(const ct_table *table, uint32_t index, unsigned char *out)
+{
+    best_kernel(table->row_length)->select(table, index, out);
+}
+
+/*
+ * Copies row indices[i] of 'table' to out + i * table->row_length, for each
+ * of the 'count' indices, sweeping the table once per CT_TABLE_BATCH indices.
+ */
+void ct_table_select_many(const ct_table *table, const uint32_t *indices, size_t count,
+                          unsigned char *out)
+{
+    const ct_table_kernel *best = best_kernel(table->row_length);
+    for (size_t done = 0; done < count; done += CT_TABLE_BATCH) {
+        uint32_t n = count - done < CT_TABLE_BATCH ? count - done : CT_TABLE_BATCH;
+        best->select_many(table, indices + done, n, out + done * table->row_length);
+    }
+}
+
+/*
+ * Like ct_table_select_many(), but with the table split between up to
+ * 'threads' threads (0 for one per online CPU). No thread gets fewer than
+ * CT_TABLE_ROWS_PER_THREAD rows, so small tables are done by the calling
+ * thread alone. Returns 0 if it ran out of memory, 1 on success.
+ */
+int ct_table_select_many_threaded(const ct_table *table, const uint32_t *indices, size_t count,
+                                  unsigned char *out, unsigned int threads)
+{
+    table_slice slices[CT_TABLE_MAX_THREADS];
+    pthread_t ids[CT_TABLE_MAX_THREADS];
+    int started[CT_TABLE_MAX_THREADS];
+
+    if (threads == 0) {
+        pthread_once(&online_cpus_once, count_online_cpus);
+        threads = online_cpus;
+    }
+    if (threads > table->row_count / CT_TABLE_ROWS_PER_THREAD) {
+        threads = table->row_count / CT_TABLE_ROWS_PER_THREAD;
+    }
+    if (threads > CT_TABLE_MAX_THREADS) {
+        threads = CT_TABLE_MAX_THREADS;
+    }
+    if (threads <= 1) {
+        ct_table_select_many(table, indices, count, out);
+        return 1;
+    }
+
+    /* The first slice's result goes straight to 'out'. */
+    size_t out_length = count * table->row_length;
+    unsigned char *partial = malloc((threads - 1) * out_length);
+    if (partial == NULL) {
+        return 0;
+    }
+
+    for (unsigned int t = 0; t < threads; t++) {
+        uint32_t first = (uint64_t)table->row_count * t / threads;
+        uint32_t last = (uint64_t)table->row_count * (t + 1) / threads;
+        slices[t].table.rows = table->rows + (size_t)first * table->row_length;
+        slices[t].table.row_count = last - first;
+        slices[t].table.row_length = table->row_length;
+        slices[t].first = first;
+        slices[t].indices = indices;
+        slices[t].count = count;
+        slices[t].out = t == 0 ? out : partial + (t - 1) * out_length;
+    }
+
+    /* If a thread can't be started, its slice is done here instead. */
+    for (unsigned int t = 1; t < threads; t++) {
+        started[t] = pthread_create(&ids[t], NULL, select_slice, &slices[t]) == 0;
+        if (!started[t]) {
+            select_slice(&slices[t]);
+        }
+    }
+    select_slice(&slices[0]);
+    for (unsigned int t = 1; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(ids[t], NULL);
+        }
+    }
+
+    for (unsigned int t = 1; t < threads; t++) {
+        const unsigned char *result = partial + (t - 1) * out_length;
+        for (size_t i = 0; i < out_length; i++) {
+            out[i] |= result[i];
+        }
+    }
+
+    memset_s(partial, 0, (threads - 1) * out_length);
+    free(partial);
+    return 1;
+}
+
+/* Sets online_cpus, once per process. */
+static void count_online_cpus(void)
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    online_cpus = online > 0 ? (unsigned int)online : 1;
+}
+
+/* Sweeps one slice of the table for all of the indices. */
+static void *select_slice(void *argument)
+{
+    const table_slice *slice = argument;
+    const ct_table_kernel *best = best_kernel(slice->table.row_length);
+    uint32_t shifted[CT_TABLE_BATCH];
+
+    for (size_t done = 0; done < slice->count; done += CT_TABLE_BATCH) {
+        uint32_t n = slice->count - done < CT_TABLE_BATCH ? slice->count - done : CT_TABLE_BATCH;
+        for (uint32_t k = 0; k < n; k++) {
+            shifted[k] = slice->indices[done + k] - slice->first;
+        }
+        best->select_many(&slice->table, shifted, n, slice->out + done * slice->table.row_length);
+    }
+
+    memset_s(shifted, 0, sizeof(shifted));
+    return NULL;
+}
+
+static int handles_any(uint32_t row_length)
+{
+    return 1;
+}
+
+static void select_scalar(const ct_table *table, uint32_t index, unsigned char *out)
+{
+    memset(out, 0, table->row_length);
+
+    const unsigned char *row = table->rows;
+    for (uint32_t i = 0; i < table->row_count; i++) {
+        unsigned char mask = ct_mask_u32(ct_eq_u32(i, index)) & 0xFF;
+        for (uint32_t j = 0; j < table->row_length; j++) {
+            out[j] |= row[j] & mask;
+        }
+        row += table->row_length;
+    }
+}
+
+static void select_many_scalar(const ct_table *table, const uint32_t *indices, uint32_t count,
+                               unsigned char *out)
+{
+    for (uint32_t k = 0; k < count; k++) {
+        select_scalar(table, indices[k], out + (size_t)k * table->row_length);
+    }
+}
+
+#if defined(__x86_64__)
+
+static int handles_vector(uint32_t row_length)
+{
+    return row_length == CT_TABLE_VECTOR_ROW_LENGTH;
+}
+
+/* ORs rows first, first + 1, ... (to the end) into 'result' under the mask. */
+static __m128i select_rows_sse2(const ct_table *table, uint32_t first, uint32_t index, __m128i result)
+{
+    const __m128i target = _mm_set1_epi32((int)index);
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i row_number = _mm_set1_epi32((int)first);
+
+    for (uint32_t i = first; i < table->row_count; i++) {
+        __m128i row = _mm_loadu_si128((const __m128i *)(table->rows + (size_t)i * CT_TABLE_VECTOR_ROW_LENGTH));
+        __m128i mask = _mm_cmpeq_epi32(row_number, target);
+        result = _mm_or_si128(result, _mm_and_si128(row, mask));
+        row_number = _mm_add_epi32(row_number, one);
+    }
+    return result;
+}
+
+static void select_sse2(const ct_table *table, uint32_t index, unsigned char *out)
+{
+    __m128i result = select_rows_sse2(table, 0, index, _mm_setzero_si128());
+    _mm_storeu_si128((__m128i *)out, result);
+}
+
+/* Like select_rows_sse2(), for 'count' indices with one result each. */
+static void select_many_rows_sse2(const ct_table *table, uint32_t first, const uint32_t *indices,
+                                  uint32_t count, __m128i *results)
+{
+    __m128i targets[CT_TABLE_BATCH];
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i row_number = _mm_set1_epi32((int)first);
+
+    for (uint32_t k = 0; k < count; k++) {
+        targets[k] = _mm_set1_epi32((int)indices[k]);
+    }
+
+    for (uint32_t i = first; i < table->row_count; i++) {
+        __m128i row = _mm_loadu_si128((const __m128i *)(table->rows + (size_t)i * CT_TABLE_VECTOR_ROW_LENGTH));
+        for (uint32_t k = 0; k < count; k++) {
+            __m128i mask = _mm_cmpeq_epi32(row_number, targets[k]);
+            results[k] = _mm_or_si128(results[k], _mm_and_si128(row, mask));
+        }
+        row_number = _mm_add_epi32(row_number, one);
+    }
+
+    memset_s(targets, 0, sizeof(targets));
+}
+
+static void select_many_sse2(const ct_table *table, const uint32_t *indices, uint32_t count,
+                             unsigned char *out)
+{
+    __m128i results[CT_TABLE_BATCH];
+
+    for (uint32_t k = 0; k < count; k++) {
+        results[k] = _mm_setzero_si128();
+    }
+    select_many_rows_sse2(table, 0, indices, count, results);
+    for (uint32_t k = 0; k < count; k++) {
+        _mm_storeu_si128((__m128i *)(out + k * CT_TABLE_VECTOR_ROW_LENGTH), results[k]);
+    }
+
+    memset_s(results, 0, sizeof(results));
+}
+
+static int avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void select_avx2(const ct_table *table, uint32_t index, unsigned char *out)
+{
+    const __m256i target = _mm256_set1_epi32((int)index);
+    const __m256i two = _mm256_set1_epi32(2);
+    /* The low half holds row i, the high half row i + 1. */
+    __m256i row_numbers = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    __m256i result = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 2 <= table->row_count; i += 2) {
+        __m256i rows = _mm256_loadu_si256((const __m256i *)(table->rows + (size_t)i * CT_TABLE_VECTOR_ROW_LENGTH));
+        __m256i mask = _mm256_cmpeq_epi32(row_numbers, target);
+        result = _mm256_or_si256(result, _mm256_and_si256(rows, mask));
+        row_numbers = _mm256_add_epi32(row_numbers, two);
+    }
+
+    __m128i folded = _mm_or_si128(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1));
+    folded = select_rows_sse2(table, i, index, folded);
+    _mm_storeu_si128((__m128i *)out, folded);
+}
+
+__attribute__((target("avx2")))
+static void select_many_avx2(const ct_table *table, const uint32_t *indices, uint32_t count,
+                             unsigned char *out)
+{
+    __m256i targets[CT_TABLE_BATCH];
+    __m256i results[CT_TABLE_BATCH];
+    __m128i folded[CT_TABLE_BATCH];
+    const __m256i two = _mm256_set1_epi32(2);
+    __m256i row_numbers = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+
+    for (uint32_t k = 0; k < count; k++) {
+        targets[k] = _mm256_set1_epi32((int)indices[k]);
+        results[k] = _mm256_setzero_si256();
+    }
+
+    uint32_t i = 0;
+    for (; i + 2 <= table->row_count; i += 2) {
+        __m256i rows = _mm256_loadu_si256((const __m256i *)(table->rows + (size_t)i * CT_TABLE_VECTOR_ROW_LENGTH));
+        for (uint32_t k = 0; k < count; k++) {
+            __m256i mask = _mm256_cmpeq_epi32(row_numbers, targets[k]);
+            results[k] = _mm256_or_si256(results[k], _mm256_and_si256(rows, mask));
+        }
+        row_numbers = _mm256_add_epi32(row_numbers, two);
+    }
+
+    for (uint32_t k = 0; k < count; k++) {
+        folded[k] = _mm_or_si128(_mm256_castsi256_si128(results[k]), _mm256_extracti128_si256(results[k], 1));
+    }
+    select_many_rows_sse2(table, i, indices, count, folded);
+    for (uint32_t k = 0; k < count; k++) {
+        _mm_storeu_si128((__m128i *)(out + k * CT_TABLE_VECTOR_ROW_LENGTH), folded[k]);
+    }
+
+    memset_s(targets, 0, sizeof(targets));
+    memset_s(results, 0, sizeof(results));
+    memset_s(folded, 0, sizeof(folded));
+}
+
+static int avx512_supported(void)
+{
+    return __builtin_cpu_supports("avx512f");
+}
+
+__attribute__((target("avx512f")))
+static void select_avx512(const ct_table *table, uint32_t index, unsigned char *out)
+{
+    const __m512i target = _mm512_set1_epi32((int)index);
+    const __m512i four = _mm512_set1_epi32(4);
+    /* Each 128-bit quarter holds one of rows i, i + 1, i + 2 and i + 3. */
+    __m512i row_numbers = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+    __m512i result = _mm512_setzero_si512();
+
+    uint32_t i = 0;
+    for (; i + 4 <= table->row_count; i += 4) {
+        __m512i rows = _mm512_loadu_si512((const void *)(table->rows + (size_t)i * CT_TABLE_VECTOR_ROW_LENGTH));
+        __mmask16 mask = _mm512_cmpeq_epi32_mask(row_numbers, target);
+        result = _mm512_or_si512(result, _mm512_maskz_mov_epi32(mask, rows));
+        row_numbers = _mm512_add_epi32(row_numbers, four);
+    }
+
+    /* Fold the quarters together through memory. (GCC 12's extract
+     * intrinsics trip -Werror=uninitialized at -O2.) */
+    unsigned char quarters[4 * CT_TABLE_VECTOR_ROW_LENGTH];
+    _mm512_storeu_si512((void *)quarters, result);
+    __m128i folded = _mm_setzero_si128();
+    for (int q = 0; q < 4; q++) {
+        folded = _mm_or_si128(folded, _mm_loadu_si128((const __m128i *)(quarters + q * CT_TABLE_VECTOR_ROW_LENGTH)));
+    }
+    memset_s(quarters, 0, sizeof(quarters));
+    folded = select_rows_sse2(table, i, index, folded);
+    _mm_storeu_si128((__m128i *)out, folded);
+}
+
+__attribute__((target("avx512f")))
+static void select_many_avx512(const ct_table *table, const uint32_t *indices, uint32_t count,
+                               unsigned char *out)
+{
+    __m512i targets[CT_TABLE_BATCH];
+    __m512i results[CT_TABLE_BATCH];
+    __m128i folded[CT_TABLE_BATCH];
+    unsigned char quarters[4 * CT_TABLE_VECTOR_ROW_LENGTH];
+    const __m512i four = _mm512_set1_epi32(4);
+    __m512i row_numbers = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+
+    for (uint32_t k = 0; k < count; k++) {
+        targets[k] = _mm512_set1_epi32((int)indices[k]);
+        results[k] = _mm512_setzero_si512();
+    }
+
+    uint32_t i = 0;
+    for (; i + 4 <= table->row_count; i += 4) {
+        __m512i rows = _mm512_loadu_si512((const void *)(table->rows + (size_t)i * CT_TABLE_VECTOR_ROW_LENGTH));
+        for (uint32_t k = 0; k < count; k++) {
+            __mmask16 mask = _mm512_cmpeq_epi32_mask(row_numbers, targets[k]);
+            results[k] = _mm512_or_si512(results[k], _mm512_maskz_mov_epi32(mask, rows));
+        }
+        row_numbers = _mm512_add_epi32(row_numbers, four);
+    }
+
+    /* Fold each result's quarters together through memory, as above. */
+    for (uint32_t k = 0; k < count; k++) {
+        _mm512_storeu_si512((void *)quarters, results[k]);
+        folded[k] = _mm_setzero_si128();
+        for (int q = 0; q < 4; q++) {
+            folded[k] = _mm_or_si128(folded[k], _mm_loadu_si128((const __m128i *)(quarters + q * CT_TABLE_VECTOR_ROW_LENGTH)));
+        }
+    }
+    select_many_rows_sse2(table, i, indices, count, folded);
+    for (uint32_t k = 0; k < count; k++) {
+        _mm_storeu_si128((__m128i *)(out + k * CT_TABLE_VECTOR_ROW_LENGTH), folded[k]);
+    }
+
+    memset_s(targets, 0, sizeof(targets));
+    memset_s(results, 0, sizeof(results));
+    memset_s(folded, 0, sizeof(folded));
+    memset_s(quarters, 0, sizeof(quarters));
+}
+
+#endif
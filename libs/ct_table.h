@@ -0,0 +1,48 @@
+#ifndef CT_TABLE_H
+#define CT_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The vector kernels work on rows of exactly this many bytes. */
+#define CT_TABLE_VECTOR_ROW_LENGTH 16
+/* How many indices one sweep over the table can resolve. */
+#define CT_TABLE_BATCH 16
+/* Threaded sweeps give each thread at least this many rows, and use at most
+ * this many threads. */
+#define CT_TABLE_ROWS_PER_THREAD 32768
+#define CT_TABLE_MAX_THREADS 64
+
+/* A table of equal-length rows, stored one after the other. */
+typedef struct ConstantTimeTable {
+    const unsigned char *rows;
+    uint32_t row_count;
+    uint32_t row_length;
+} ct_table;
+
+/*
+ * A way of copying one row of a table out, reading every row so that the time
+ * and memory accesses don't depend on which one was selected.
+ */
+typedef struct ConstantTimeTableKernel {
+    const char *name;
+    /* Returns 1 if the kernel can run on this CPU. May be NULL. */
+    int (*supported)(void);
+    /* Returns 1 if the kernel can handle rows of this length. */
+    int (*handles)(uint32_t row_length);
+    void (*select)(const ct_table *table, uint32_t index, unsigned char *out);
+    /* Selects 'count' (at most CT_TABLE_BATCH) rows in one sweep. */
+    void (*select_many)(const ct_table *table, const uint32_t *indices, uint32_t count,
+                        unsigned char *out);
+} ct_table_kernel;
+
+const ct_table_kernel *ct_table_kernel_at(size_t index);
+int ct_table_kernel_supported(const ct_table_kernel *kernel);
+
+void ct_table_select(const ct_table *table, uint32_t index, unsigned char *out);
+void ct_table_select_many(const ct_table *table, const uint32_t *indices, size_t count,
+                          unsigned char *out);
+int ct_table_select_many_threaded(const ct_table *table, const uint32_t *indices, size_t count,
+                                  unsigned char *out, unsigned int threads);
+
+#endif
@@ -0,0 +1,578 @@
+/*
+ * Buffered access to the system's random number generator.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * Opening /dev/urandom for every few bytes we need makes bulk generation
+ * spend almost all of its time in open(), read() and close(). Instead, an
+ * entropy_pool gets its bytes from an entropy_source (see entropy_sources.c)
+ * that is opened once, and reads ENTROPY_POOL_SIZE bytes at a time into a
+ * buffer that is locked into memory (so it never hits swap).
+ *
+ * Bytes are handed out of the buffer front to back, and every byte is
+ * overwritten with zero as soon as it has been copied out, so the pool never
+ * holds on to randomness that has already been used for a password.
+ *
+ * The source is opened lazily on the first read, so a missing /dev/urandom is
+ * reported as a read failure, exactly as it was when we opened it every time.
+ *
+ * The source's own state (a file descriptor, a generator key, ...) lives in
+ * the same locked mapping, right after the buffer. Unbuffered sources get the
+ * state page only.
+ *
+ * When mix_cpu is set, the generators' seeds are SHA-256 hashes of kernel
+ * randomness and RDSEED/RDRAND output (see cpu_random.c), so a broken or
+ * malicious CPU generator can't weaken them. If the CPU has neither
+ * instruction, or both keep failing, the kernel bytes are used as they are.
+ *
+ * entropy_pool_start_producer() moves the source to a thread of its own, which
+ * fills a ring of blocks (in another locked mapping) ahead of the reader, so
+ * waiting for the kernel or running a generator overlaps with whatever the
+ * reader does with the bytes. The reader takes a full block when its current
+ * one runs out, wiping it as it goes just like the pool's own buffer. Both
+ * sides count how often they had to wait for the other: if the reader stalls,
+ * the source is the bottleneck; if the producer stalls, the reader is.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "entropy.h"
+#include "memset_s.h"
+#include "sha256.h"
+
+/*
+ * A thread filling blocks of a ring ahead of the reader. The full blocks are
+ * tail, tail + 1, ..., tail + ready - 1 (mod blocks), and the producer fills
+ * the one after them as long as it isn't the block the reader is still using.
+ */
+struct EntropyProducer {
+    pthread_t thread;
+    /* Protects everything below, except what source_lock does. */
+    pthread_mutex_t lock;
+    /* Signalled whenever a block is filled or freed, or we're stopping. */
+    pthread_cond_t changed;
+    /* Held while the source is used, so a reseed can't happen mid-fill. */
+    pthread_mutex_t source_lock;
+    unsigned char *ring;
+    size_t ring_length;
+    int locked;
+    unsigned int blocks;
+    unsigned int tail;
+    unsigned int ready;
+    /* 1 while the reader is taking bytes out of block tail - 1. */
+    int in_use;
+    /* Bumped by every reseed, so a fill that started before one is dropped. */
+    unsigned long generation;
+    int failed;
+    int stop;
+    /* The producer's side of the statistics, until they're copied out. */
+    unsigned long blocks_produced;
+    unsigned long producer_stalls;
+};
+
+static int entropy_pool_open(entropy_pool *pool);
+static int entropy_pool_refill(entropy_pool *pool);
+static int entropy_producer_take(entropy_pool *pool);
+static void entropy_producer_unmap(struct EntropyProducer *producer);
+static void *entropy_producer_run(void *argument);
+
+/*
+ * Returns 1 if 'source' can be used on this machine, 0 otherwise.
+ */
+int entropy_source_supported(const entropy_source *source)
+{
+    return source->supported == NULL || source->supported();
+}
+
+/*
+ * Returns the source with the given name, or NULL if there is no source with
+ * that name or it isn't supported on this machine. "drbg" means the fastest
+ * userspace generator available.
+ */
+const entropy_source *entropy_source_find(const char *name)
+{
+    if (strcmp(name, "drbg") == 0) {
+        if (entropy_source_supported(&entropy_source_aes_ctr)) {
+            return &entropy_source_aes_ctr;
+        }
+        return &entropy_source_chacha20;
+    }
+
+    const entropy_source *source;
+    for (size_t i = 0; (source = entropy_source_at(i)) != NULL; i++) {
+        if (strcmp(name, source->name) == 0) {
+            return entropy_source_supported(source) ? source : NULL;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Initializes an entropy_pool that gets its bytes from 'source'. This does not
+ * touch the source yet.
+ */
+void entropy_pool_init(entropy_pool *pool, const entropy_source *source)
+{
+    pool->source = source;
+    pool->mapping = NULL;
+    pool->mapping_length = 0;
+    pool->buffer = NULL;
+    pool->state = NULL;
+    pool->position = ENTROPY_POOL_SIZE;
+    pool->opened = 0;
+    pool->locked = 0;
+    pool->bytes_read = 0;
+    pool->mix_cpu = 0;
+    pool->stream = 0;
+    memset(&pool->cpu_stats, 0, sizeof(pool->cpu_stats));
+    pool->producer = NULL;
+    memset(&pool->producer_stats, 0, sizeof(pool->producer_stats));
+}
+
+/*
+ * Allocates the locked buffer and state and initializes the source.
+ * Returns 0 on failure, 1 on success.
+ */
+static int entropy_pool_open(entropy_pool *pool)
+{
+    size_t length = ENTROPY_STATE_SIZE;
+    if (pool->source->buffered) {
+        length += ENTROPY_POOL_SIZE;
+    }
+
+    void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return 0;
+    }
+
+    /* Locking can fail if RLIMIT_MEMLOCK is tiny. That's not a reason to
+     * refuse to generate passwords, so we just remember whether it worked. */
+    pool->locked = mlock(mapping, length) == 0;
+#ifdef MADV_DONTDUMP
+    madvise(mapping, length, MADV_DONTDUMP);
+#endif
+
+    pool->mapping = mapping;
+    pool->mapping_length = length;
+    if (pool->source->buffered) {
+        pool->buffer = pool->mapping;
+        pool->state = pool->mapping + ENTROPY_POOL_SIZE;
+    } else {
+        pool->state = pool->mapping;
+    }
+    pool->position = ENTROPY_POOL_SIZE;
+    pool->opened = 1;
+
+    if (!pool->source->init(pool)) {
+        entropy_pool_deinit(pool);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Replaces the (already wiped) contents of the buffer with fresh bytes.
+ * Returns 0 on failure, 1 on success.
+ */
+static int entropy_pool_refill(entropy_pool *pool)
+{
+    if (pool->producer != NULL) {
+        return entropy_producer_take(pool);
+    }
+    if (!pool->source->fill(pool, pool->buffer, ENTROPY_POOL_SIZE)) {
+        memset_s(pool->buffer, 0, ENTROPY_POOL_SIZE);
+        return 0;
+    }
+    pool->position = 0;
+    return 1;
+}
+
+/*
+ * Fills 'out' with 'length' random bytes taken from the pool.
+ *
+ * Returns 0 on failure, 1 on success. On failure, the contents of 'out' are
+ * unspecified and must not be used.
+ */
+int entropy_pool_read(entropy_pool *pool, void *out, size_t length)
+{
+    unsigned char *dst = out;
+
+    if (!pool->opened && !entropy_pool_open(pool)) {
+        return 0;
+    }
+
+    if (!pool->source->buffered && pool->producer == NULL) {
+        if (!pool->source->fill(pool, dst, length)) {
+            return 0;
+        }
+        pool->bytes_read += length;
+        return 1;
+    }
+
+    pool->bytes_read += length;
+
+    while (length > 0) {
+        if (pool->position >= ENTROPY_POOL_SIZE && !entropy_pool_refill(pool)) {
+            return 0;
+        }
+
+        size_t available = ENTROPY_POOL_SIZE - pool->position;
+        size_t n = length < available ? length : available;
+
+        memcpy(dst, pool->buffer + pool->position, n);
+        /* Never keep a copy of bytes that have been handed out. */
+        memset_s(pool->buffer + pool->position, 0, n);
+
+        pool->position += n;
+        dst += n;
+        length -= n;
+    }
+
+    return 1;
+}
+
+/*
+ * Asks the source to mix in fresh kernel randomness now, and throws away any
+ * buffered bytes produced before that.
+ * Returns 0 on failure, 1 on success.
+ */
+int entropy_pool_reseed(entropy_pool *pool)
+{
+    if (!pool->opened && !entropy_pool_open(pool)) {
+        return 0;
+    }
+
+    if (pool->producer != NULL) {
+        struct EntropyProducer *producer = pool->producer;
+
+        /* Wait for any fill in progress, and throw away every full block. */
+        pthread_mutex_lock(&producer->source_lock);
+        pthread_mutex_lock(&producer->lock);
+        if (producer->in_use) {
+            memset_s(pool->buffer, 0, ENTROPY_POOL_SIZE);
+            producer->in_use = 0;
+        }
+        pool->position = ENTROPY_POOL_SIZE;
+        for (unsigned int i = 0; i < producer->ready; i++) {
+            unsigned int block = (producer->tail + i) % producer->blocks;
+            memset_s(producer->ring + (size_t)block * ENTROPY_POOL_SIZE, 0, ENTROPY_POOL_SIZE);
+        }
+        producer->ready = 0;
+        producer->generation++;
+        pthread_cond_broadcast(&producer->changed);
+        pthread_mutex_unlock(&producer->lock);
+
+        int ok = pool->source->reseed(pool);
+        pthread_mutex_unlock(&producer->source_lock);
+        return ok;
+    }
+
+    if (pool->buffer != NULL) {
+        memset_s(pool->buffer, 0, ENTROPY_POOL_SIZE);
+        pool->position = ENTROPY_POOL_SIZE;
+    }
+    return pool->source->reseed(pool);
+}
+
+/*
+ * Starts a thread that keeps up to 'blocks' (2 to ENTROPY_PRODUCER_MAX_BLOCKS)
+ * blocks of ENTROPY_POOL_SIZE bytes ready for entropy_pool_read(). Bytes left
+ * in the pool's own buffer are thrown away. From now until the producer is
+ * stopped, the source is only used by that thread. The pool must still be
+ * read from one thread at a time.
+ * Returns 0 on failure, 1 on success.
+ */
+int entropy_pool_start_producer(entropy_pool *pool, unsigned int blocks)
+{
+    struct EntropyProducer *producer;
+
+    if (pool->producer != NULL || blocks < 2 || blocks > ENTROPY_PRODUCER_MAX_BLOCKS) {
+        return 0;
+    }
+    if (!pool->opened && !entropy_pool_open(pool)) {
+        return 0;
+    }
+
+    producer = calloc(1, sizeof(*producer));
+    if (producer == NULL) {
+        return 0;
+    }
+    producer->blocks = blocks;
+    producer->ring_length = (size_t)blocks * ENTROPY_POOL_SIZE;
+
+    void *ring = mmap(NULL, producer->ring_length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        free(producer);
+        return 0;
+    }
+    producer->locked = mlock(ring, producer->ring_length) == 0;
+#ifdef MADV_DONTDUMP
+    madvise(ring, producer->ring_length, MADV_DONTDUMP);
+#endif
+    producer->ring = ring;
+
+    int lock_ok = pthread_mutex_init(&producer->lock, NULL) == 0;
+    int source_lock_ok = pthread_mutex_init(&producer->source_lock, NULL) == 0;
+    int changed_ok = pthread_cond_init(&producer->changed, NULL) == 0;
+    if (!lock_ok || !source_lock_ok || !changed_ok) {
+        if (lock_ok) {
+            pthread_mutex_destroy(&producer->lock);
+        }
+        if (source_lock_ok) {
+            pthread_mutex_destroy(&producer->source_lock);
+        }
+        if (changed_ok) {
+            pthread_cond_destroy(&producer->changed);
+        }
+        entropy_producer_unmap(producer);
+        free(producer);
+        return 0;
+    }
+
+    if (pool->buffer != NULL) {
+        memset_s(pool->buffer, 0, ENTROPY_POOL_SIZE);
+    }
+    pool->position = ENTROPY_POOL_SIZE;
+    pool->producer = producer;
+    memset(&pool->producer_stats, 0, sizeof(pool->producer_stats));
+    pool->producer_stats.ring_blocks = blocks;
+
+    if (pthread_create(&producer->thread, NULL, entropy_producer_run, pool) != 0) {
+        pool->producer = NULL;
+        pthread_cond_destroy(&producer->changed);
+        pthread_mutex_destroy(&producer->source_lock);
+        pthread_mutex_destroy(&producer->lock);
+        entropy_producer_unmap(producer);
+        free(producer);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Stops the pool's producer thread (if it has one), wipes and releases its
+ * ring, and copies its statistics into pool->producer_stats. The pool goes
+ * back to using the source itself.
+ */
+void entropy_pool_stop_producer(entropy_pool *pool)
+{
+    struct EntropyProducer *producer = pool->producer;
+
+    if (producer == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&producer->lock);
+    producer->stop = 1;
+    pthread_cond_broadcast(&producer->changed);
+    pthread_mutex_unlock(&producer->lock);
+    pthread_join(producer->thread, NULL);
+
+    pool->producer_stats.blocks_produced = producer->blocks_produced;
+    pool->producer_stats.producer_stalls = producer->producer_stalls;
+
+    pthread_cond_destroy(&producer->changed);
+    pthread_mutex_destroy(&producer->source_lock);
+    pthread_mutex_destroy(&producer->lock);
+    entropy_producer_unmap(producer);
+    free(producer);
+
+    pool->producer = NULL;
+    pool->buffer = pool->source->buffered ? pool->mapping : NULL;
+    pool->position = ENTROPY_POOL_SIZE;
+}
+
+/*
+ * Gives the (used up) block the reader had back to the producer and makes the
+ * next full one the pool's buffer, waiting for it if necessary.
+ * Returns 0 if the source failed, 1 on success.
+ */
+static int entropy_producer_take(entropy_pool *pool)
+{
+    struct EntropyProducer *producer = pool->producer;
+
+    pthread_mutex_lock(&producer->lock);
+    producer->in_use = 0;
+    pthread_cond_broadcast(&producer->changed);
+
+    if (producer->ready == 0 && !producer->failed) {
+        pool->producer_stats.reader_stalls++;
+        while (producer->ready == 0 && !producer->failed) {
+            pthread_cond_wait(&producer->changed, &producer->lock);
+        }
+    }
+    if (producer->ready == 0) {
+        pthread_mutex_unlock(&producer->lock);
+        return 0;
+    }
+
+    pool->producer_stats.blocks_taken++;
+    pool->producer_stats.depth_total += producer->ready;
+    pool->buffer = producer->ring + (size_t)producer->tail * ENTROPY_POOL_SIZE;
+    producer->tail = (producer->tail + 1) % producer->blocks;
+    producer->ready--;
+    producer->in_use = 1;
+    pthread_cond_broadcast(&producer->changed);
+    pthread_mutex_unlock(&producer->lock);
+
+    pool->position = 0;
+    return 1;
+}
+
+/*
+ * Wipes and releases a producer's ring.
+ */
+static void entropy_producer_unmap(struct EntropyProducer *producer)
+{
+    memset_s(producer->ring, 0, producer->ring_length);
+    if (producer->locked) {
+        munlock(producer->ring, producer->ring_length);
+    }
+    munmap(producer->ring, producer->ring_length);
+}
+
+static void *entropy_producer_run(void *argument)
+{
+    entropy_pool *pool = argument;
+    struct EntropyProducer *producer = pool->producer;
+
+    pthread_mutex_lock(&producer->lock);
+    while (!producer->stop && !producer->failed) {
+        if (producer->ready + producer->in_use >= producer->blocks) {
+            producer->producer_stalls++;
+            while (!producer->stop && producer->ready + producer->in_use >= producer->blocks) {
+                pthread_cond_wait(&producer->changed, &producer->lock);
+            }
+            continue;
+        }
+
+        unsigned char *block = producer->ring +
+            (size_t)((producer->tail + producer->ready) % producer->blocks) * ENTROPY_POOL_SIZE;
+        unsigned long generation = producer->generation;
+        pthread_mutex_unlock(&producer->lock);
+
+        /* The reader never touches this block until we say it's full. */
+        pthread_mutex_lock(&producer->source_lock);
+        int ok = pool->source->fill(pool, block, ENTROPY_POOL_SIZE);
+        pthread_mutex_unlock(&producer->source_lock);
+
+        pthread_mutex_lock(&producer->lock);
+        if (!ok || generation != producer->generation) {
+            memset_s(block, 0, ENTROPY_POOL_SIZE);
+            producer->failed = !ok;
+        } else {
+            producer->ready++;
+            producer->blocks_produced++;
+        }
+        pthread_cond_broadcast(&producer->changed);
+    }
+    pthread_mutex_unlock(&producer->lock);
+
+    return NULL;
+}
+
+/*
+ * Fills 'seed' with 'length' (at most ENTROPY_MAX_SEED_LENGTH) bytes for a
+ * generator's seed or reseed. Block i of the seed is
+ *
+ *      SHA-256("passgen seed" || i || length || kernel || cpu)
+ *
+ * when mix_cpu is set, and just the kernel bytes otherwise.
+ * Returns 0 on failure, 1 on success.
+ */
+int entropy_pool_seed(entropy_pool *pool, unsigned char *seed, size_t length)
+{
+    static const char label[] = "passgen seed";
+    unsigned char kernel[ENTROPY_MAX_SEED_LENGTH];
+    unsigned char cpu[ENTROPY_MAX_SEED_LENGTH];
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    sha256 hash;
+
+    if (length > ENTROPY_MAX_SEED_LENGTH) {
+        abort();
+    }
+
+    if (!entropy_kernel_bytes(seed, length)) {
+        memset_s(seed, 0, length);
+        return 0;
+    }
+
+    if (!pool->mix_cpu || !cpu_random_fill(cpu, length, &pool->cpu_stats)) {
+        memset_s(cpu, 0, sizeof(cpu));
+        return 1;
+    }
+
+    memcpy(kernel, seed, length);
+    for (size_t i = 0; i * SHA256_DIGEST_LENGTH < length; i++) {
+        const unsigned char header[2] = { (unsigned char)i, (unsigned char)length };
+        sha256_init(&hash);
+        sha256_update(&hash, label, sizeof(label) - 1);
+        sha256_update(&hash, header, sizeof(header));
+        sha256_update(&hash, kernel, length);
+        sha256_update(&hash, cpu, length);
+        sha256_final(&hash, digest);
+
+        size_t offset = i * SHA256_DIGEST_LENGTH;
+        size_t n = length - offset < SHA256_DIGEST_LENGTH ? length - offset : SHA256_DIGEST_LENGTH;
+        memcpy(seed + offset, digest, n);
+    }
+
+    memset_s(kernel, 0, sizeof(kernel));
+    memset_s(cpu, 0, sizeof(cpu));
+    memset_s(digest, 0, sizeof(digest));
+    return 1;
+}
+
+/*
+ * Describes where a pool's bytes actually came from, e.g. whether getrandom
+ * used the vDSO or made system calls.
+ */
+const char *entropy_pool_description(const entropy_pool *pool)
+{
+    if (pool->opened && pool->source->describe != NULL) {
+        return pool->source->describe(pool);
+    }
+    return pool->source->name;
+}
+
+/*
+ * Wipes the source's state, then wipes and releases the buffer. The pool can
+ * be used again afterwards; it will reopen its source (and still mix in CPU
+ * randomness if it did before).
+ */
+void entropy_pool_deinit(entropy_pool *pool)
+{
+    int mix_cpu = pool->mix_cpu;
+
+    entropy_pool_stop_producer(pool);
+    if (pool->opened) {
+        pool->source->wipe(pool);
+    }
+    if (pool->mapping != NULL) {
+        memset_s(pool->mapping, 0, pool->mapping_length);
+        if (pool->locked) {
+            munlock(pool->mapping, pool->mapping_length);
+        }
+        munmap(pool->mapping, pool->mapping_length);
+    }
+    entropy_pool_init(pool, pool->source);
+    pool->mix_cpu = mix_cpu;
+}
@@ -0,0 +1,100 @@
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stddef.h>
+
+#include "cpu_random.h"
+
+/* Number of bytes fetched from a buffered source at once. */
+#define ENTROPY_POOL_SIZE 32768
+/* Bytes set aside (in locked memory) for a source's own state. */
+#define ENTROPY_STATE_SIZE 4096
+/* The longest seed a source may ask entropy_pool_seed() for. */
+#define ENTROPY_MAX_SEED_LENGTH 64
+/* The most ENTROPY_POOL_SIZE blocks a producer thread may keep ready. */
+#define ENTROPY_PRODUCER_MAX_BLOCKS 64
+
+struct EntropySource;
+struct EntropyProducer;
+
+/* What a pool's producer thread (see entropy_pool_start_producer) did. */
+typedef struct EntropyProducerStats {
+    /* How many blocks the ring holds. */
+    unsigned int ring_blocks;
+    /* Blocks the producer filled from the source. */
+    unsigned long blocks_produced;
+    /* Blocks the reader took, and how many were ready, summed over those. */
+    unsigned long blocks_taken;
+    unsigned long depth_total;
+    /* Times the reader had to wait for a block: the source is too slow. */
+    unsigned long reader_stalls;
+    /* Times the producer found every block full: the reader is too slow. */
+    unsigned long producer_stalls;
+} entropy_producer_stats;
+
+typedef struct EntropyPool {
+    const struct EntropySource *source;
+    unsigned char *mapping;
+    size_t mapping_length;
+    unsigned char *buffer;
+    void *state;
+    size_t position;
+    int opened;
+    int locked;
+    /* Bytes handed out by entropy_pool_read(), for statistics. */
+    unsigned long bytes_read;
+    /* Hash RDSEED/RDRAND output into every seed (see entropy_pool_seed). */
+    int mix_cpu;
+    cpu_random_stats cpu_stats;
+    /* Which stream this is, e.g. a -j worker's number. Only the test source
+     * uses it, to give each stream its own output. */
+    unsigned int stream;
+    /* The thread filling blocks ahead of the reader, or NULL. */
+    struct EntropyProducer *producer;
+    entropy_producer_stats producer_stats;
+} entropy_pool;
+
+/*
+ * An entropy source. Sources with 'buffered' set are read ENTROPY_POOL_SIZE
+ * bytes at a time into the pool's buffer; other sources fill the caller's
+ * buffer directly. All functions return 0 on failure, 1 on success.
+ */
+typedef struct EntropySource {
+    const char *name;
+    int buffered;
+    /* Set for generators that seed themselves with entropy_pool_seed(). */
+    int seeded;
+    /* Returns 1 if the source can be used on this machine. May be NULL. */
+    int (*supported)(void);
+    /* Sets up pool->state (ENTROPY_STATE_SIZE bytes of zeroed, locked memory). */
+    int (*init)(entropy_pool *pool);
+    int (*fill)(entropy_pool *pool, unsigned char *out, size_t length);
+    /* Mixes fresh kernel randomness into the state, if there is a state. */
+    int (*reseed)(entropy_pool *pool);
+    /* Erases pool->state and releases anything init() acquired. */
+    void (*wipe)(entropy_pool *pool);
+    /* Describes what the source is actually doing. May be NULL. */
+    const char *(*describe)(const entropy_pool *pool);
+} entropy_source;
+
+extern const entropy_source entropy_source_urandom;
+extern const entropy_source entropy_source_getrandom;
+extern const entropy_source entropy_source_chacha20;
+extern const entropy_source entropy_source_aes_ctr;
+extern const entropy_source entropy_source_test;
+
+const entropy_source *entropy_source_find(const char *name);
+const entropy_source *entropy_source_at(size_t index);
+int entropy_source_supported(const entropy_source *source);
+int entropy_kernel_bytes(unsigned char *out, size_t length);
+
+void entropy_pool_init(entropy_pool *pool, const entropy_source *source);
+int entropy_pool_read(entropy_pool *pool, void *out, size_t length);
+int entropy_pool_start_producer(entropy_pool *pool, unsigned int blocks);
+void entropy_pool_stop_producer(entropy_pool *pool);
+int entropy_pool_reseed(entropy_pool *pool);
+int entropy_pool_seed(entropy_pool *pool, unsigned char *seed, size_t length);
+const char *entropy_pool_description(const entropy_pool *pool);
+void entropy_pool_deinit(entropy_pool *pool);
+
+#endif
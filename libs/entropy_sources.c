@@ -0,0 +1,335 @@
+/*
+ * The entropy sources an entropy_pool can draw from.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ *  urandom   - Reads /dev/urandom through a file descriptor that stays open.
+ *              This is the default.
+ *
+ *  getrandom - Asks the kernel for exactly the bytes requested, skipping the
+ *              pool's buffer. It uses the vDSO getrandom() (see
+ *              vdso_getrandom.c) when the kernel has one, which makes a single
+ *              password much cheaper, and the getrandom(2) system call
+ *              otherwise.
+ *
+ *  chacha20  - A ChaCha20 fast-key-erasure generator (see chacha_drbg.c),
+ *              seeded from getrandom(2) (plus RDSEED/RDRAND, if the pool asks
+ *              for it) and reseeded every CHACHA_DRBG_RESEED_INTERVAL bytes.
+ *
+ *  aes-ctr   - An AES-256 CTR_DRBG (see aes_ctr_drbg.c), seeded and reseeded
+ *              the same way. Only available on CPUs with AES-NI.
+ *
+ *  test      - The ChaCha20 generator with a fixed seed: all zeros, except
+ *              that the first 4 bytes are pool->stream (little-endian). Its
+ *              output is the same every time, but each -j worker's is
+ *              different. It exists for tests and benchmarks and MUST NOT be
+ *              used for real passwords.
+ *
+ * Each source keeps its state in pool->state, which is locked memory that the
+ * pool wipes after calling the source's wipe function.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+#include "entropy.h"
+#include "chacha_drbg.h"
+#include "aes_ctr_drbg.h"
+#include "vdso_getrandom.h"
+#include "memset_s.h"
+
+typedef struct UrandomState {
+    int fd;
+} urandom_state;
+
+typedef struct GetrandomState {
+    vdso_getrandom vdso;
+    int use_vdso;
+} getrandom_state;
+
+static int urandom_init(entropy_pool *pool);
+static int urandom_fill(entropy_pool *pool, unsigned char *out, size_t length);
+static void urandom_wipe(entropy_pool *pool);
+static int getrandom_init(entropy_pool *pool);
+static int getrandom_fill(entropy_pool *pool, unsigned char *out, size_t length);
+static void getrandom_wipe(entropy_pool *pool);
+static const char *getrandom_describe(const entropy_pool *pool);
+static int chacha20_init(entropy_pool *pool);
+static int chacha20_fill(entropy_pool *pool, unsigned char *out, size_t length);
+static int chacha20_reseed(entropy_pool *pool);
+static void chacha20_wipe(entropy_pool *pool);
+static int aes_ctr_init(entropy_pool *pool);
+static int aes_ctr_fill(entropy_pool *pool, unsigned char *out, size_t length);
+static int aes_ctr_reseed(entropy_pool *pool);
+static void aes_ctr_wipe(entropy_pool *pool);
+static int test_init(entropy_pool *pool);
+static int test_fill(entropy_pool *pool, unsigned char *out, size_t length);
+static const char *test_describe(const entropy_pool *pool);
+static int nothing_to_reseed(entropy_pool *pool);
+
+const entropy_source entropy_source_urandom = {
+    "urandom", 1, 0, NULL, urandom_init, urandom_fill, nothing_to_reseed, urandom_wipe, NULL
+};
+
+const entropy_source entropy_source_getrandom = {
+    "getrandom", 0, 0, NULL, getrandom_init, getrandom_fill, nothing_to_reseed, getrandom_wipe,
+    getrandom_describe
+};
+
+const entropy_source entropy_source_chacha20 = {
+    "chacha20", 1, 1, NULL, chacha20_init, chacha20_fill, chacha20_reseed, chacha20_wipe, NULL
+};
+
+const entropy_source entropy_source_aes_ctr = {
+    "aes-ctr", 1, 1, aes_ctr_drbg_supported, aes_ctr_init, aes_ctr_fill, aes_ctr_reseed, aes_ctr_wipe,
+    NULL
+};
+
+const entropy_source entropy_source_test = {
+    "test", 1, 0, NULL, test_init, test_fill, nothing_to_reseed, chacha20_wipe, test_describe
+};
+
+static const entropy_source *const all_sources[] = {
+    &entropy_source_urandom,
+    &entropy_source_getrandom,
+    &entropy_source_chacha20,
+    &entropy_source_aes_ctr,
+    &entropy_source_test,
+};
+
+/*
+ * Returns the index'th source (whether it's supported or not), or NULL when
+ * 'index' is past the last one. Used to list and benchmark every source.
+ */
+const entropy_source *entropy_source_at(size_t index)
+{
+    if (index >= sizeof(all_sources) / sizeof(all_sources[0])) {
+        return NULL;
+    }
+    return all_sources[index];
+}
+
+/*
+ * Fills 'out' with bytes from getrandom(2). Used (via entropy_pool_seed) to
+ * seed the generators.
+ * Returns 0 on failure, 1 on success.
+ */
+int entropy_kernel_bytes(unsigned char *out, size_t length)
+{
+    while (length > 0) {
+        ssize_t got = getrandom(out, length, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return 0;
+        }
+        out += got;
+        length -= (size_t)got;
+    }
+    return 1;
+}
+
+static int nothing_to_reseed(entropy_pool *pool)
+{
+    return 1;
+}
+
+/* urandom */
+
+static int urandom_init(entropy_pool *pool)
+{
+    urandom_state *state = pool->state;
+    state->fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    return state->fd >= 0;
+}
+
+static int urandom_fill(entropy_pool *pool, unsigned char *out, size_t length)
+{
+    urandom_state *state = pool->state;
+    while (length > 0) {
+        ssize_t got = read(state->fd, out, length);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return 0;
+        }
+        out += got;
+        length -= (size_t)got;
+    }
+    return 1;
+}
+
+static void urandom_wipe(entropy_pool *pool)
+{
+    urandom_state *state = pool->state;
+    if (state->fd >= 0) {
+        close(state->fd);
+    }
+    state->fd = -1;
+}
+
+/* getrandom */
+
+static int getrandom_init(entropy_pool *pool)
+{
+    getrandom_state *state = pool->state;
+    /* If there's no vDSO function, we make system calls. */
+    state->use_vdso = vdso_getrandom_init(&state->vdso);
+    return 1;
+}
+
+static int getrandom_fill(entropy_pool *pool, unsigned char *out, size_t length)
+{
+    getrandom_state *state = pool->state;
+    if (state->use_vdso && vdso_getrandom_fill(&state->vdso, out, length)) {
+        return 1;
+    }
+    /* If the vDSO ever fails, stop using it and make system calls. */
+    if (state->use_vdso) {
+        vdso_getrandom_deinit(&state->vdso);
+        state->use_vdso = 0;
+    }
+    return entropy_kernel_bytes(out, length);
+}
+
+static void getrandom_wipe(entropy_pool *pool)
+{
+    getrandom_state *state = pool->state;
+    if (state->use_vdso) {
+        vdso_getrandom_deinit(&state->vdso);
+    }
+    state->use_vdso = 0;
+}
+
+static const char *getrandom_describe(const entropy_pool *pool)
+{
+    const getrandom_state *state = pool->state;
+    return state->use_vdso ? "getrandom (vDSO)" : "getrandom (system call)";
+}
+
+/* chacha20 */
+
+static int chacha20_init(entropy_pool *pool)
+{
+    unsigned char seed[CHACHA_DRBG_SEED_LENGTH];
+    if (!entropy_pool_seed(pool, seed, sizeof(seed))) {
+        memset_s(seed, 0, sizeof(seed));
+        return 0;
+    }
+    chacha_drbg_init(pool->state, seed);
+    memset_s(seed, 0, sizeof(seed));
+    return 1;
+}
+
+static int chacha20_fill(entropy_pool *pool, unsigned char *out, size_t length)
+{
+    if (chacha_drbg_needs_reseed(pool->state) && !chacha20_reseed(pool)) {
+        return 0;
+    }
+    chacha_drbg_generate(pool->state, out, length);
+    return 1;
+}
+
+static int chacha20_reseed(entropy_pool *pool)
+{
+    unsigned char seed[CHACHA_DRBG_SEED_LENGTH];
+    if (!entropy_pool_seed(pool, seed, sizeof(seed))) {
+        memset_s(seed, 0, sizeof(seed));
+        return 0;
+    }
+    chacha_drbg_reseed(pool->state, seed);
+    memset_s(seed, 0, sizeof(seed));
+    return 1;
+}
+
+static void chacha20_wipe(entropy_pool *pool)
+{
+    chacha_drbg_wipe(pool->state);
+}
+
+/* aes-ctr */
+
+static int aes_ctr_init(entropy_pool *pool)
+{
+    unsigned char seed[AES_CTR_DRBG_SEED_LENGTH];
+    if (!entropy_pool_seed(pool, seed, sizeof(seed))) {
+        memset_s(seed, 0, sizeof(seed));
+        return 0;
+    }
+    aes_ctr_drbg_init(pool->state, seed);
+    memset_s(seed, 0, sizeof(seed));
+    return 1;
+}
+
+static int aes_ctr_fill(entropy_pool *pool, unsigned char *out, size_t length)
+{
+    if (aes_ctr_drbg_needs_reseed(pool->state) && !aes_ctr_reseed(pool)) {
+        return 0;
+    }
+    while (length > 0) {
+        size_t n = length < AES_CTR_DRBG_MAX_REQUEST ? length : AES_CTR_DRBG_MAX_REQUEST;
+        aes_ctr_drbg_generate(pool->state, out, n);
+        out += n;
+        length -= n;
+    }
+    return 1;
+}
+
+static int aes_ctr_reseed(entropy_pool *pool)
+{
+    unsigned char seed[AES_CTR_DRBG_SEED_LENGTH];
+    if (!entropy_pool_seed(pool, seed, sizeof(seed))) {
+        memset_s(seed, 0, sizeof(seed));
+        return 0;
+    }
+    aes_ctr_drbg_reseed(pool->state, seed);
+    memset_s(seed, 0, sizeof(seed));
+    return 1;
+}
+
+static void aes_ctr_wipe(entropy_pool *pool)
+{
+    aes_ctr_drbg_wipe(pool->state);
+}
+
+/* test */
+
+static int test_init(entropy_pool *pool)
+{
+    unsigned char seed[CHACHA_DRBG_SEED_LENGTH] = { 0 };
+    seed[0] = (unsigned char)pool->stream;
+    seed[1] = (unsigned char)(pool->stream >> 8);
+    seed[2] = (unsigned char)(pool->stream >> 16);
+    seed[3] = (unsigned char)(pool->stream >> 24);
+    chacha_drbg_init(pool->state, seed);
+    return 1;
+}
+
+static int test_fill(entropy_pool *pool, unsigned char *out, size_t length)
+{
+    chacha_drbg_generate(pool->state, out, length);
+    return 1;
+}
+
+static const char *test_describe(const entropy_pool *pool)
+{
+    return "test (deterministic, NOT random)";
+}
@@ -0,0 +1,207 @@
+/*
+ * Writes buffers to a file through io_uring, several at a time.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * A write(2) to a file blocks until the data is copied into the page cache
+ * (or, with O_DIRECT, until it's on the disk), and we can't make passwords in
+ * the meantime. With io_uring we put a write in a ring shared with the kernel,
+ * tell it with one system call, and carry on; its completion shows up in a
+ * second ring, and we only wait for one when we need its buffer back.
+ *
+ * This is the bare minimum of io_uring needed for that: IORING_OP_WRITE at an
+ * explicit offset, one submission per io_uring_enter(2), and waiting for one
+ * completion at a time. We use the system calls directly, so we don't depend
+ * on liburing. IORING_OP_WRITE needs Linux 5.6; on anything older (or where
+ * io_uring is disabled, as some containers do), io_uring_writer_init() fails
+ * and the caller should use write(2) instead.
+ *
+ * A buffer belongs to the kernel from when it's submitted until its
+ * completion has been returned by io_uring_writer_wait(), so it mustn't be
+ * changed, wiped or freed before then.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "io_uring_writer.h"
+
+static void *io_uring_writer_map(int ring_fd, size_t size, off_t offset);
+
+/*
+ * Sets up a ring with room for 'entries' writes in flight to 'fd'. Returns 1
+ * on success, 0 (with errno set) if io_uring isn't available.
+ */
+int io_uring_writer_init(io_uring_writer *writer, int fd, unsigned int entries)
+{
+    struct io_uring_params params;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->ring_fd = -1;
+    writer->fd = fd;
+
+    memset(&params, 0, sizeof(params));
+    writer->ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (writer->ring_fd < 0) {
+        return 0;
+    }
+
+    /* IORING_OP_WRITE came in the same release as this feature. */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        io_uring_writer_deinit(writer);
+        errno = ENOSYS;
+        return 0;
+    }
+
+    writer->entries = params.sq_entries;
+    writer->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    writer->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    writer->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    writer->sq_ring = io_uring_writer_map(writer->ring_fd, writer->sq_ring_size, IORING_OFF_SQ_RING);
+    writer->cq_ring = io_uring_writer_map(writer->ring_fd, writer->cq_ring_size, IORING_OFF_CQ_RING);
+    writer->sqes = io_uring_writer_map(writer->ring_fd, writer->sqes_size, IORING_OFF_SQES);
+    if (writer->sq_ring == NULL || writer->cq_ring == NULL || writer->sqes == NULL) {
+        int error = errno;
+        io_uring_writer_deinit(writer);
+        errno = error;
+        return 0;
+    }
+
+    writer->sq_tail = (unsigned int *)(void *)((unsigned char *)writer->sq_ring + params.sq_off.tail);
+    writer->sq_mask = (unsigned int *)(void *)((unsigned char *)writer->sq_ring + params.sq_off.ring_mask);
+    writer->sq_array = (unsigned int *)(void *)((unsigned char *)writer->sq_ring + params.sq_off.array);
+    writer->cq_head = (unsigned int *)(void *)((unsigned char *)writer->cq_ring + params.cq_off.head);
+    writer->cq_tail = (unsigned int *)(void *)((unsigned char *)writer->cq_ring + params.cq_off.tail);
+    writer->cq_mask = (unsigned int *)(void *)((unsigned char *)writer->cq_ring + params.cq_off.ring_mask);
+    writer->cqes = (unsigned char *)writer->cq_ring + params.cq_off.cqes;
+    return 1;
+}
+
+/*
+ * Starts writing 'length' bytes of 'data' at 'offset' in the file. 'tag' comes
+ * back with its completion. Returns 1 on success, 0 (with errno set) if it
+ * couldn't be submitted, e.g. because 'entries' writes are already in flight.
+ */
+int io_uring_writer_submit(io_uring_writer *writer, const void *data, size_t length, uint64_t offset,
+                           uint64_t tag)
+{
+    if (writer->in_flight >= writer->entries || length > UINT32_MAX) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    /* Only we move the submission tail, so it needs no atomic load. */
+    unsigned int tail = *writer->sq_tail;
+    unsigned int index = tail & *writer->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)writer->sqes + index;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = writer->fd;
+    sqe->addr = (uint64_t)(uintptr_t)data;
+    sqe->len = (uint32_t)length;
+    sqe->off = offset;
+    sqe->user_data = tag;
+    writer->sq_array[index] = index;
+
+    /* The kernel must see the entry before the tail that covers it. */
+    __atomic_store_n(writer->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while (syscall(__NR_io_uring_enter, writer->ring_fd, 1, 0, 0, NULL, 0) < 0) {
+        if (errno != EINTR) {
+            /* It wasn't consumed, so take it back. */
+            int error = errno;
+            __atomic_store_n(writer->sq_tail, tail, __ATOMIC_RELEASE);
+            errno = error;
+            return 0;
+        }
+    }
+
+    writer->in_flight++;
+    return 1;
+}
+
+/*
+ * Waits for a write to finish, and sets 'tag' to the one it was submitted with
+ * and 'result' to the bytes written or a negative errno. Returns 1 on
+ * success, 0 (with errno set) if nothing is in flight or waiting failed.
+ */
+int io_uring_writer_wait(io_uring_writer *writer, uint64_t *tag, int32_t *result)
+{
+    if (writer->in_flight == 0) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    unsigned int head = *writer->cq_head;
+    while (head == __atomic_load_n(writer->cq_tail, __ATOMIC_ACQUIRE)) {
+        if (syscall(__NR_io_uring_enter, writer->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR) {
+            return 0;
+        }
+    }
+
+    const struct io_uring_cqe *cqe = (const struct io_uring_cqe *)writer->cqes + (head & *writer->cq_mask);
+    *tag = cqe->user_data;
+    *result = cqe->res;
+
+    /* Hand the entry back only once we've read it. */
+    __atomic_store_n(writer->cq_head, head + 1, __ATOMIC_RELEASE);
+    writer->in_flight--;
+    return 1;
+}
+
+/*
+ * Waits for any writes still in flight, then tears the ring down.
+ */
+void io_uring_writer_deinit(io_uring_writer *writer)
+{
+    uint64_t tag;
+    int32_t result;
+
+    while (writer->in_flight > 0 && io_uring_writer_wait(writer, &tag, &result)) {
+        /* Their buffers may be freed as soon as we return. */
+    }
+
+    if (writer->sqes != NULL) {
+        munmap(writer->sqes, writer->sqes_size);
+    }
+    if (writer->cq_ring != NULL) {
+        munmap(writer->cq_ring, writer->cq_ring_size);
+    }
+    if (writer->sq_ring != NULL) {
+        munmap(writer->sq_ring, writer->sq_ring_size);
+    }
+    if (writer->ring_fd >= 0) {
+        close(writer->ring_fd);
+    }
+    memset(writer, 0, sizeof(*writer));
+    writer->ring_fd = -1;
+}
+
+/*
+ * Maps one of the ring's regions. Returns NULL on failure.
+ */
+static void *io_uring_writer_map(int ring_fd, size_t size, off_t offset)
+{
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+    return data == MAP_FAILED ? NULL : data;
+}
@@ -0,0 +1,36 @@
+#ifndef IO_URING_WRITER_H
+#define IO_URING_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct IoUringWriter {
+    /* The ring, and the file it writes to. */
+    int ring_fd;
+    int fd;
+    /* Submission queue entries; at most this many writes are in flight. */
+    unsigned int entries;
+    unsigned int in_flight;
+    /* The rings shared with the kernel, and pointers into them. */
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    void *sqes;
+    size_t sqes_size;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    void *cqes;
+} io_uring_writer;
+
+int io_uring_writer_init(io_uring_writer *writer, int fd, unsigned int entries);
+int io_uring_writer_submit(io_uring_writer *writer, const void *data, size_t length, uint64_t offset,
+                           uint64_t tag);
+int io_uring_writer_wait(io_uring_writer *writer, uint64_t *tag, int32_t *result);
+void io_uring_writer_deinit(io_uring_writer *writer);
+
+#endif
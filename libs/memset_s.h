@@ -1,6 +1,8 @@
 #ifndef MEMSET_S_H
 #define MEMSET_S_H
 
+#include <stddef.h>
+
 void *memset_s(void *v, int c, size_t n);
 
 #endif
@@ -0,0 +1,213 @@
+/*
+ * Finds the machine's NUMA nodes and pins threads to them.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * On a machine with several sockets, memory is faster to reach from the
+ * socket (node) it's attached to. A thread that the scheduler moves to another
+ * node keeps using memory on the old one, so bulk generation pins each worker
+ * to the CPUs of one node. Linux puts a page on the node of the thread that
+ * first touches it, so once a worker is pinned, whatever it allocates and
+ * fills itself (its entropy pool, its output buffers, its copy of the
+ * wordlist) ends up on its own node. That needs nothing but the affinity
+ * system call, so we don't depend on libnuma.
+ *
+ * The nodes and their CPUs come from /sys/devices/system/node. Nodes without
+ * CPUs we're allowed to use (memory-only nodes, or ones excluded by taskset
+ * or a cgroup) are left out. Without sysfs (or NUMA support in the kernel),
+ * every CPU we may use is treated as one node.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "numa_nodes.h"
+
+static int parse_cpulist(const char *list, unsigned char *cpus);
+static int read_node(int id, const cpu_set_t *allowed, unsigned char *cpus);
+
+/*
+ * Fills 'nodes' with the NUMA nodes this process can run on. Returns 1 on
+ * success, 0 if we couldn't even find out which CPUs we're allowed to use.
+ */
+int numa_nodes_init(numa_nodes *nodes)
+{
+    cpu_set_t allowed;
+
+    memset(nodes, 0, sizeof(*nodes));
+
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return 0;
+    }
+
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL && nodes->count < NUMA_NODES_MAX) {
+            char *end;
+            if (strncmp(entry->d_name, "node", 4) != 0) {
+                continue;
+            }
+            long id = strtol(entry->d_name + 4, &end, 10);
+            if (end == entry->d_name + 4 || *end != '\0' || id < 0 || id > 0xFFFF) {
+                continue;
+            }
+            if (read_node((int)id, &allowed, nodes->cpus[nodes->count])) {
+                nodes->ids[nodes->count] = (int)id;
+                nodes->count++;
+            }
+        }
+        closedir(dir);
+    }
+
+    /* readdir() doesn't sort, but node numbers should read in order. */
+    for (unsigned int i = 1; i < nodes->count; i++) {
+        for (unsigned int j = i; j > 0 && nodes->ids[j - 1] > nodes->ids[j]; j--) {
+            unsigned char cpus[NUMA_NODES_MAX_CPUS / 8];
+            int id = nodes->ids[j];
+            nodes->ids[j] = nodes->ids[j - 1];
+            nodes->ids[j - 1] = id;
+            memcpy(cpus, nodes->cpus[j], sizeof(cpus));
+            memcpy(nodes->cpus[j], nodes->cpus[j - 1], sizeof(cpus));
+            memcpy(nodes->cpus[j - 1], cpus, sizeof(cpus));
+        }
+    }
+
+    /* Without NUMA information, all of the CPUs are one node. */
+    if (nodes->count == 0) {
+        memset(nodes->cpus[0], 0, sizeof(nodes->cpus[0]));
+        for (int cpu = 0; cpu < NUMA_NODES_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                nodes->cpus[0][cpu / 8] |= 1 << (cpu % 8);
+            }
+        }
+        nodes->ids[0] = 0;
+        nodes->count = 1;
+    }
+
+    return 1;
+}
+
+/*
+ * Returns the node (an index into nodes->ids) that worker number 'worker'
+ * should run on. Consecutive workers go to different nodes, so any number of
+ * workers is spread as evenly as possible.
+ */
+unsigned int numa_nodes_for_worker(const numa_nodes *nodes, unsigned int worker)
+{
+    return worker % nodes->count;
+}
+
+/*
+ * Lets the calling thread run only on the CPUs of 'node'. The scheduler can
+ * still move it between them. Returns 1 on success, 0 on failure.
+ */
+int numa_nodes_pin(const numa_nodes *nodes, unsigned int node)
+{
+    cpu_set_t set;
+
+    if (node >= nodes->count) {
+        return 0;
+    }
+
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < NUMA_NODES_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+        if (nodes->cpus[node][cpu / 8] & (1 << (cpu % 8))) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    /* On Linux, pid 0 means the calling thread, not the whole process. */
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+/*
+ * Sets the bits of 'cpus' listed in 'list' (like "0-3,8,10-11\n"). Returns 1
+ * on success, 0 if the list is malformed.
+ */
+static int parse_cpulist(const char *list, unsigned char *cpus)
+{
+    const char *p = list;
+
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+        if (end == p) {
+            return 0;
+        }
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtoul(p, &end, 10);
+            if (end == p || last < first) {
+                return 0;
+            }
+            p = end;
+        }
+        for (unsigned long cpu = first; cpu <= last && cpu < NUMA_NODES_MAX_CPUS; cpu++) {
+            cpus[cpu / 8] |= 1 << (cpu % 8);
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Reads node 'id's CPUs into 'cpus', keeping only the ones in 'allowed'.
+ * Returns 1 if the node has any of those, 0 otherwise.
+ */
+static int read_node(int id, const cpu_set_t *allowed, unsigned char *cpus)
+{
+    char path[64];
+    char list[4096];
+    int any = 0;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    if (fgets(list, sizeof(list), file) == NULL) {
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+    memset(cpus, 0, NUMA_NODES_MAX_CPUS / 8);
+    if (!parse_cpulist(list, cpus)) {
+        return 0;
+    }
+
+    for (int cpu = 0; cpu < NUMA_NODES_MAX_CPUS; cpu++) {
+        if (cpus[cpu / 8] & (1 << (cpu % 8))) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, allowed)) {
+                any = 1;
+            } else {
+                cpus[cpu / 8] &= ~(1 << (cpu % 8));
+            }
+        }
+    }
+
+    return any;
+}
@@ -0,0 +1,21 @@
+#ifndef NUMA_NODES_H
+#define NUMA_NODES_H
+
+/* Nodes (with CPUs) and CPUs past these are ignored. */
+#define NUMA_NODES_MAX 64
+#define NUMA_NODES_MAX_CPUS 1024
+
+typedef struct NumaNodes {
+    /* How many nodes have CPUs we're allowed to run on (at least 1). */
+    unsigned int count;
+    /* The kernel's number for each node, e.g. 1 for node1 in sysfs. */
+    int ids[NUMA_NODES_MAX];
+    /* Bit c of cpus[n] is set if CPU c is on node n and we may use it. */
+    unsigned char cpus[NUMA_NODES_MAX][NUMA_NODES_MAX_CPUS / 8];
+} numa_nodes;
+
+int numa_nodes_init(numa_nodes *nodes);
+unsigned int numa_nodes_for_worker(const numa_nodes *nodes, unsigned int worker);
+int numa_nodes_pin(const numa_nodes *nodes, unsigned int node);
+
+#endif
@@ -0,0 +1,617 @@
+/*
+ * Buffered, locked output of passwords.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * Passwords are formatted straight into blocks of OUTPUT_BLOCK_SIZE bytes
+ * (with output_reserve() and output_advance()), or copied in with
+ * output_append(), and written with one write(2) or writev(2) per flush
+ * instead of one or two stdio calls per password. Like the entropy pool's
+ * buffer, the blocks are locked into memory if RLIMIT_MEMLOCK allows and left
+ * out of core dumps, and every byte is wiped as soon as it has been written.
+ *
+ * Normally there is only one block: when it's full, it is written out and
+ * reused. In atomic mode nothing is written until output_commit(), and blocks
+ * are added as needed, so a run that fails halfway leaves no passwords on the
+ * output at all. That holds the whole run in memory.
+ *
+ * When the output is a pipe, output_try_vmsplice() has full blocks handed to
+ * the kernel with vmsplice(2) instead, which puts references to our pages in
+ * the pipe rather than copying them. The catch is that those pages are then
+ * shared with the reader until it's done with them, and it may even splice
+ * them on somewhere else, so we can't know when it's safe to touch them
+ * again. Wiping them would corrupt the output. So a spliced block is never
+ * written to again: we unmap it (the kernel frees the pages once the pipe is
+ * done with them, just as it frees its own copies of written data) and map a
+ * fresh block in its place. If the kernel refuses to splice, we go back to
+ * write(2).
+ *
+ * When the output is a file, output_try_io_uring() has full blocks written
+ * through io_uring (see io_uring_writer.c) instead, so we can carry on making
+ * passwords while they're written. Each one gets its own offset in the file,
+ * and up to OUTPUT_RING_DEPTH of them can be in flight; we only wait when all
+ * of them are. A block is wiped once its write completes, and taken back to
+ * fill again. If the file was opened with O_DIRECT, only whole multiples of
+ * OUTPUT_DIRECT_ALIGN bytes go out that way. What's left over is moved to the
+ * front of the next block, and at the very end it's written with O_DIRECT
+ * turned off.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "memset_s.h"
+
+/* At most this many blocks are written with one writev(). */
+#define OUTPUT_MAX_IOVECS 64
+
+static int output_add_block(output *out);
+static int output_map_block(output_block *block);
+static void output_unmap_block(output_block *block, int wipe);
+static int output_send(output *out);
+static int output_write_all(output *out);
+static int output_splice_all(output *out);
+static int output_finish(output *out);
+static int output_ring_send(output *out);
+static int output_ring_complete(output *out, uint64_t tag, int32_t result);
+static int output_ring_drain(output *out);
+static int output_write_tail(output *out);
+
+/*
+ * Initializes an output that writes to 'fd'. If 'atomic' is set, nothing is
+ * written until output_commit(). This doesn't allocate anything yet.
+ */
+void output_init(output *out, int fd, int atomic)
+{
+    memset(out, 0, sizeof(*out));
+    out->fd = fd;
+    out->atomic = atomic;
+}
+
+/*
+ * If the output isn't atomic and goes to a pipe, makes full blocks go into
+ * the pipe with vmsplice() from now on, and makes the pipe as big as a block
+ * if we're allowed to. Returns 1 if it will, 0 otherwise.
+ */
+int output_try_vmsplice(output *out)
+{
+    struct stat info;
+
+    if (out->atomic || fstat(out->fd, &info) != 0 || !S_ISFIFO(info.st_mode)) {
+        return 0;
+    }
+    /* Fewer, bigger trips through the pipe. It's fine if this fails. */
+    fcntl(out->fd, F_SETPIPE_SZ, OUTPUT_BLOCK_SIZE);
+    out->splice = 1;
+    return 1;
+}
+
+/*
+ * If the output isn't atomic and goes to a file (or a block device), makes
+ * full blocks go out through io_uring from now on. Returns 1 if it will, 0
+ * otherwise. Then, write(2) can't keep to O_DIRECT's alignment, so if the file
+ * was opened with O_DIRECT, that's turned off.
+ */
+int output_try_io_uring(output *out)
+{
+    struct stat info;
+    int flags = fcntl(out->fd, F_GETFL);
+    off_t offset = -1;
+
+    if (!out->atomic && fstat(out->fd, &info) == 0 && (S_ISREG(info.st_mode) || S_ISBLK(info.st_mode))) {
+        offset = lseek(out->fd, 0, SEEK_CUR);
+    }
+    if (offset < 0 || !io_uring_writer_init(&out->ring, out->fd, OUTPUT_RING_DEPTH)) {
+        if (flags >= 0 && (flags & O_DIRECT)) {
+            fcntl(out->fd, F_SETFL, flags & ~O_DIRECT);
+        }
+        return 0;
+    }
+
+    out->use_ring = 1;
+    out->ring_offset = (unsigned long)offset;
+    out->direct = flags >= 0 && (flags & O_DIRECT);
+    return 1;
+}
+
+/*
+ * Returns a pointer to 'length' (at most OUTPUT_RESERVE_MAX) bytes of locked
+ * space to format output into, or NULL on failure (out of memory, or a write
+ * to make room failed). Call output_advance() with how much was used before
+ * reserving again.
+ */
+unsigned char *output_reserve(output *out, size_t length)
+{
+    if (length > OUTPUT_RESERVE_MAX) {
+        return NULL;
+    }
+
+    if (out->block_count == 0 ||
+        OUTPUT_BLOCK_SIZE - out->blocks[out->block_count - 1].length < length) {
+        if (out->block_count > 0 && !out->atomic) {
+            /* Send the full block out, and reuse it (or a fresh one). */
+            if (!output_send(out)) {
+                return NULL;
+            }
+        }
+        if (out->block_count == 0 || out->atomic) {
+            if (!output_add_block(out)) {
+                return NULL;
+            }
+        }
+    }
+
+    output_block *block = &out->blocks[out->block_count - 1];
+    out->reserved = length;
+    return block->data + block->length;
+}
+
+/*
+ * Marks the first 'length' bytes of the last output_reserve() as output.
+ */
+void output_advance(output *out, size_t length)
+{
+    if (length > out->reserved) {
+        abort();
+    }
+    out->blocks[out->block_count - 1].length += length;
+    out->reserved = 0;
+}
+
+/*
+ * Copies 'length' bytes of output in. Returns 1 on success, 0 on failure.
+ */
+int output_append(output *out, const unsigned char *data, size_t length)
+{
+    while (length > 0) {
+        size_t n = length < OUTPUT_RESERVE_MAX ? length : OUTPUT_RESERVE_MAX;
+        unsigned char *space = output_reserve(out, n);
+        if (space == NULL) {
+            return 0;
+        }
+        memcpy(space, data, n);
+        output_advance(out, n);
+        data += n;
+        length -= n;
+    }
+    return 1;
+}
+
+/*
+ * Writes out everything so far, unless the output is atomic (then this does
+ * nothing). Returns 1 on success, 0 if a write failed.
+ */
+int output_flush(output *out)
+{
+    if (out->atomic) {
+        return 1;
+    }
+    return output_finish(out);
+}
+
+/*
+ * Writes out everything so far, atomic or not. Returns 1 on success, 0 if a
+ * write failed.
+ */
+int output_commit(output *out)
+{
+    return output_finish(out);
+}
+
+/*
+ * Wipes and releases the blocks. Anything not written yet is thrown away.
+ */
+void output_deinit(output *out)
+{
+    if (out->use_ring) {
+        /* Nothing can be unmapped while the kernel may still be writing it. */
+        output_ring_drain(out);
+        io_uring_writer_deinit(&out->ring);
+        for (size_t i = 0; i < OUTPUT_RING_DEPTH; i++) {
+            if (out->ring_blocks[i].data != NULL) {
+                output_unmap_block(&out->ring_blocks[i], 1);
+            }
+        }
+    }
+    for (size_t i = 0; i < out->block_count; i++) {
+        /* Whatever was reserved last may hold part of a password, too. */
+        if (i == out->block_count - 1) {
+            out->blocks[i].length += out->reserved;
+        }
+        output_unmap_block(&out->blocks[i], 1);
+    }
+    free(out->blocks);
+    output_init(out, out->fd, out->atomic);
+}
+
+/*
+ * Adds an empty block at the end. Returns 1 on success, 0 on failure.
+ */
+static int output_add_block(output *out)
+{
+    if (out->block_count == out->block_capacity) {
+        size_t capacity = out->block_capacity == 0 ? 4 : out->block_capacity * 2;
+        output_block *blocks = realloc(out->blocks, capacity * sizeof(output_block));
+        if (blocks == NULL) {
+            return 0;
+        }
+        out->blocks = blocks;
+        out->block_capacity = capacity;
+    }
+
+    if (!output_map_block(&out->blocks[out->block_count])) {
+        return 0;
+    }
+    out->block_count++;
+    return 1;
+}
+
+/*
+ * Maps a new, empty block. Returns 1 on success, 0 on failure.
+ */
+static int output_map_block(output_block *block)
+{
+    void *data = mmap(NULL, OUTPUT_BLOCK_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+
+    /* As with the entropy pool, a failed mlock() isn't a reason to stop. */
+    block->locked = mlock(data, OUTPUT_BLOCK_SIZE) == 0;
+#ifdef MADV_DONTDUMP
+    madvise(data, OUTPUT_BLOCK_SIZE, MADV_DONTDUMP);
+#endif
+    block->data = data;
+    block->length = 0;
+    return 1;
+}
+
+/*
+ * Unmaps a block, first wiping its bytes if 'wipe' is set (it mustn't be for
+ * a block that was spliced into a pipe).
+ */
+static void output_unmap_block(output_block *block, int wipe)
+{
+    if (wipe) {
+        memset_s(block->data, 0, block->length);
+    }
+    if (block->locked) {
+        munlock(block->data, OUTPUT_BLOCK_SIZE);
+    }
+    munmap(block->data, OUTPUT_BLOCK_SIZE);
+    block->data = NULL;
+    block->length = 0;
+}
+
+/*
+ * Sends everything so far out, whichever way we're sending it.
+ * Returns 1 on success, 0 on failure.
+ */
+static int output_send(output *out)
+{
+    if (out->block_count == 0) {
+        return 1;
+    }
+    if (out->use_ring) {
+        return output_ring_send(out);
+    }
+    if (out->splice) {
+        return output_splice_all(out);
+    }
+    return output_write_all(out);
+}
+
+/*
+ * Writes every block's bytes in order, OUTPUT_MAX_IOVECS blocks per call,
+ * then wipes them. Returns 1 on success, 0 if a write failed.
+ */
+static int output_write_all(output *out)
+{
+    struct iovec iov[OUTPUT_MAX_IOVECS];
+    size_t i = 0;
+
+    while (i < out->block_count) {
+        size_t count = 0;
+        for (; i < out->block_count && count < OUTPUT_MAX_IOVECS; i++) {
+            if (out->blocks[i].length > 0) {
+                iov[count].iov_base = out->blocks[i].data;
+                iov[count].iov_len = out->blocks[i].length;
+                count++;
+            }
+        }
+
+        /* Carry on where a short write (e.g. to a pipe) left off. */
+        struct iovec *next = iov;
+        while (count > 0) {
+            ssize_t written;
+            if (count == 1) {
+                written = write(out->fd, next->iov_base, next->iov_len);
+            } else {
+                written = writev(out->fd, next, (int)count);
+            }
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return 0;
+            }
+            out->write_calls++;
+            out->bytes_written += written;
+
+            while (count > 0 && (size_t)written >= next->iov_len) {
+                written -= next->iov_len;
+                next++;
+                count--;
+            }
+            if (count > 0) {
+                next->iov_base = (unsigned char *)next->iov_base + written;
+                next->iov_len -= written;
+            }
+        }
+    }
+
+    for (i = 0; i < out->block_count; i++) {
+        memset_s(out->blocks[i].data, 0, out->blocks[i].length);
+        out->blocks[i].length = 0;
+    }
+    return 1;
+}
+
+/*
+ * Gives the (only) block's bytes to the pipe with vmsplice(), then replaces
+ * the block with a fresh one (see the explanation at the top). Falls back to
+ * output_write_all() if the kernel won't splice. Returns 1 on success, 0 on
+ * failure.
+ */
+static int output_splice_all(output *out)
+{
+    output_block *block = &out->blocks[out->block_count - 1];
+    struct iovec iov;
+    size_t spliced = 0;
+
+    iov.iov_base = block->data;
+    iov.iov_len = block->length;
+
+    while (iov.iov_len > 0) {
+        ssize_t n = vmsplice(out->fd, &iov, 1, SPLICE_F_GIFT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (spliced == 0 && (errno == EINVAL || errno == ENOSYS)) {
+                out->splice = 0;
+                return output_write_all(out);
+            }
+            break;
+        }
+        out->splice_calls++;
+        out->bytes_written += n;
+        spliced += n;
+        iov.iov_base = (unsigned char *)iov.iov_base + n;
+        iov.iov_len -= n;
+    }
+
+    if (spliced == 0) {
+        /* Nothing left us, so the block can still be wiped as usual. */
+        return iov.iov_len == 0;
+    }
+
+    output_unmap_block(block, 0);
+    if (!output_map_block(block)) {
+        out->block_count--;
+        return 0;
+    }
+    return iov.iov_len == 0;
+}
+
+/*
+ * Sends everything so far out, and waits until it has all been written.
+ * Returns 1 on success, 0 (with errno set) on failure.
+ */
+static int output_finish(output *out)
+{
+    if (!out->use_ring || out->block_count == 0) {
+        return output_send(out);
+    }
+
+    output_block *block = &out->blocks[out->block_count - 1];
+    int ok = output_ring_send(out);
+    int error = errno;
+
+    /* Even after a failure, we have to wait for what's in flight. */
+    if (!output_ring_drain(out) && ok) {
+        ok = 0;
+        error = errno;
+    }
+    /* Only O_DIRECT leaves anything behind. */
+    if (ok && block->length > 0) {
+        ok = output_write_tail(out);
+        error = errno;
+    }
+
+    errno = error;
+    return ok;
+}
+
+/*
+ * Starts writing the block being filled through the io_uring (all of it, or
+ * with O_DIRECT its aligned part), and puts an empty block in its place,
+ * waiting for one to come back if they're all in flight. Returns 1 on
+ * success, 0 (with errno set) on failure.
+ */
+static int output_ring_send(output *out)
+{
+    output_block *block = &out->blocks[out->block_count - 1];
+    size_t carry = out->direct ? block->length % OUTPUT_DIRECT_ALIGN : 0;
+    size_t length = block->length - carry;
+    output_block *slot = NULL;
+
+    if (length == 0) {
+        return 1;
+    }
+
+    while (slot == NULL) {
+        for (size_t i = 0; i < OUTPUT_RING_DEPTH && slot == NULL; i++) {
+            if (!out->ring_blocks[i].busy) {
+                slot = &out->ring_blocks[i];
+            }
+        }
+        if (slot == NULL) {
+            uint64_t tag;
+            int32_t result;
+            if (!io_uring_writer_wait(&out->ring, &tag, &result) ||
+                !output_ring_complete(out, tag, result)) {
+                return 0;
+            }
+        }
+    }
+    if (slot->data == NULL && !output_map_block(slot)) {
+        return 0;
+    }
+
+    /* The full block goes to the ring, and the ring's empty one comes here. */
+    output_block full = *block;
+    *block = *slot;
+    *slot = full;
+
+    memcpy(block->data, slot->data + length, carry);
+    block->length = carry;
+    memset_s(slot->data + length, 0, carry);
+
+    slot->length = length;
+    slot->offset = out->ring_offset;
+    slot->sent = 0;
+    out->ring_offset += length;
+
+    if (!io_uring_writer_submit(&out->ring, slot->data, slot->length, slot->offset,
+                                (uint64_t)(slot - out->ring_blocks))) {
+        int error = errno;
+        memset_s(slot->data, 0, slot->length);
+        slot->length = 0;
+        errno = error;
+        return 0;
+    }
+    slot->busy = 1;
+    out->ring_writes++;
+    return 1;
+}
+
+/*
+ * Handles the completion of the write of ring block 'tag': a short write is
+ * continued, and a finished block is wiped and made free again. Returns 1 on
+ * success, 0 (with errno set) if the write failed.
+ */
+static int output_ring_complete(output *out, uint64_t tag, int32_t result)
+{
+    output_block *slot = &out->ring_blocks[tag];
+
+    if (result > 0) {
+        slot->sent += result;
+        out->bytes_written += result;
+    }
+    if (result > 0 && slot->sent < slot->length) {
+        if (io_uring_writer_submit(&out->ring, slot->data + slot->sent, slot->length - slot->sent,
+                                   slot->offset + slot->sent, tag)) {
+            out->ring_writes++;
+            return 1;
+        }
+        result = -errno;
+    }
+
+    memset_s(slot->data, 0, slot->length);
+    slot->length = 0;
+    slot->busy = 0;
+    if (result <= 0) {
+        /* Writing nothing at all isn't progress either. */
+        errno = result < 0 ? -result : EIO;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Waits until nothing is in flight in the io_uring. Returns 1 on success, 0
+ * (with errno set to the first error) if any of the writes failed.
+ */
+static int output_ring_drain(output *out)
+{
+    int ok = 1;
+    int error = 0;
+
+    while (out->ring.in_flight > 0) {
+        uint64_t tag;
+        int32_t result;
+        if (!io_uring_writer_wait(&out->ring, &tag, &result)) {
+            return 0;
+        }
+        if (!output_ring_complete(out, tag, result) && ok) {
+            ok = 0;
+            error = errno;
+        }
+    }
+
+    if (!ok) {
+        errno = error;
+    }
+    return ok;
+}
+
+/*
+ * Writes what O_DIRECT left in the last block, with O_DIRECT turned off for
+ * the moment, then wipes it. Returns 1 on success, 0 (with errno set) on
+ * failure.
+ */
+static int output_write_tail(output *out)
+{
+    output_block *block = &out->blocks[out->block_count - 1];
+    int flags = fcntl(out->fd, F_GETFL);
+    size_t done = 0;
+    int error = 0;
+
+    if (flags < 0 || fcntl(out->fd, F_SETFL, flags & ~O_DIRECT) != 0) {
+        return 0;
+    }
+
+    while (done < block->length) {
+        ssize_t written = pwrite(out->fd, block->data + done, block->length - done, (off_t)out->ring_offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            error = written < 0 ? errno : EIO;
+            break;
+        }
+        out->write_calls++;
+        out->bytes_written += written;
+        out->ring_offset += written;
+        done += written;
+    }
+
+    int ok = done == block->length;
+    fcntl(out->fd, F_SETFL, flags);
+    memset_s(block->data, 0, block->length);
+    block->length = 0;
+    errno = error;
+    return ok;
+}
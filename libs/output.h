@@ -0,0 +1,70 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+#include "io_uring_writer.h"
+
+/* Output is collected in locked blocks of this many bytes. */
+#define OUTPUT_BLOCK_SIZE (1024 * 1024)
+
+/* With O_DIRECT, file writes are whole multiples of this many bytes. */
+#define OUTPUT_DIRECT_ALIGN 4096
+
+/* The most output_reserve() gives out at once. It leaves room for what an
+ * O_DIRECT write had to leave behind. */
+#define OUTPUT_RESERVE_MAX (OUTPUT_BLOCK_SIZE - OUTPUT_DIRECT_ALIGN)
+
+/* Blocks that can be in the io_uring at once, besides the one being filled. */
+#define OUTPUT_RING_DEPTH 4
+
+typedef struct OutputBlock {
+    unsigned char *data;
+    /* Bytes of 'data' that are waiting to be written. */
+    size_t length;
+    int locked;
+    /* For blocks in the io_uring: set while it's being written, where in the
+     * file it goes, and how much of it has been written so far. */
+    int busy;
+    unsigned long offset;
+    size_t sent;
+} output_block;
+
+typedef struct Output {
+    int fd;
+    /* Set to keep everything until output_commit() (see output.c). */
+    int atomic;
+    output_block *blocks;
+    size_t block_count;
+    size_t block_capacity;
+    /* Bytes handed out by output_reserve() but not output_advance()'d yet. */
+    size_t reserved;
+    /* Set while full blocks are given to a pipe with vmsplice() instead. */
+    int splice;
+    /* Set while full blocks are written through 'ring' instead, into
+     * 'ring_blocks', at file offset 'ring_offset' and on. */
+    int use_ring;
+    io_uring_writer ring;
+    output_block ring_blocks[OUTPUT_RING_DEPTH];
+    unsigned long ring_offset;
+    /* Set if the file was opened with O_DIRECT. */
+    int direct;
+    /* For statistics: bytes written, and the write()/writev(), vmsplice()
+     * and io_uring writes it took. */
+    unsigned long bytes_written;
+    unsigned long write_calls;
+    unsigned long splice_calls;
+    unsigned long ring_writes;
+} output;
+
+void output_init(output *out, int fd, int atomic);
+int output_try_vmsplice(output *out);
+int output_try_io_uring(output *out);
+unsigned char *output_reserve(output *out, size_t length);
+void output_advance(output *out, size_t length);
+int output_append(output *out, const unsigned char *data, size_t length);
+int output_flush(output *out);
+int output_commit(output *out);
+void output_deinit(output *out);
+
+#endif
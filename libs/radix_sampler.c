@@ -0,0 +1,122 @@
+/*
+ * Several uniform random symbols from one 64-bit random number.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * Drawing one byte per symbol and rejecting bytes that are out of range spends
+ * 8 bits (or more, counting rejections) on every symbol, even a digit that
+ * only carries log2(10) = 3.3 bits. Instead, we treat a uniform 64-bit random
+ * number r as a fraction r / 2^64 and read k base-n digits off of it by
+ * multiplying by n k times: the high word of each product is the next digit,
+ * and the low word is carried into the next multiplication. (This is Lemire's
+ * "batched" bounded random numbers, with the rejection test done once per
+ * batch.)
+ *
+ * The digits spell out floor(r * n^k / 2^64), which is almost, but not
+ * exactly, uniform in [0, n^k). It becomes exactly uniform if we reject r when
+ * the final low word, r * n^k mod 2^64, is less than 2^64 mod n^k: then each
+ * of the n^k outcomes is produced by exactly floor(2^64 / n^k) values of r.
+ *
+ * The rejection only depends on r, never on which digits we're about to
+ * return, and the digits are computed with multiplications only (no division
+ * or table lookups), so this takes the same time whatever the digits are.
+ *
+ * k is chosen to maximize the expected number of symbols per draw,
+ * k * (1 - (2^64 mod n^k) / 2^64). The largest k isn't always best: for
+ * digits, 10^19 fits in 64 bits but rejects 46% of draws, while 10^18 rejects
+ * only 2.4%.
+ */
+
+#include <stdint.h>
+
+#include "radix_sampler.h"
+
+static void mul64(uint64_t a, uint64_t b, uint64_t *high, uint64_t *low);
+
+/*
+ * Computes the 128-bit product of a and b using 32-bit halves, so it doesn't
+ * need a compiler extension.
+ */
+static void mul64(uint64_t a, uint64_t b, uint64_t *high, uint64_t *low)
+{
+    uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+    uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+
+    uint64_t p0 = a_lo * b_lo;
+    uint64_t p1 = a_lo * b_hi;
+    uint64_t p2 = a_hi * b_lo;
+    uint64_t p3 = a_hi * b_hi;
+
+    uint64_t middle = (p0 >> 32) + (p1 & 0xFFFFFFFF) + (p2 & 0xFFFFFFFF);
+    *low = (p0 & 0xFFFFFFFF) | (middle << 32);
+    *high = p3 + (p1 >> 32) + (p2 >> 32) + (middle >> 32);
+}
+
+/*
+ * Sets up a sampler for symbols in [0, n). n must be at least 1.
+ * Returns 0 on failure, 1 on success.
+ */
+int radix_sampler_init(radix_sampler *sampler, uint32_t n)
+{
+    if (n < 1) {
+        return 0;
+    }
+
+    uint64_t power = 1;
+    double best_score = 0;
+    sampler->n = n;
+    sampler->k = 1;
+    sampler->threshold = 0;
+
+    for (uint32_t k = 1; k <= RADIX_SAMPLER_MAX_BATCH; k++) {
+        /* power = n^k, stopping once it no longer fits in 64 bits, except
+         * that n^k = 2^64 (which wraps to 0) is perfect: nothing is rejected. */
+        if (power > UINT64_MAX / n && (uint64_t)(power * n) != 0) {
+            break;
+        }
+        power *= n;
+
+        /* (2^64 - n^k) mod n^k = 2^64 mod n^k, computed in 64 bits. */
+        uint64_t threshold = power == 0 ? 0 : (0 - power) % power;
+        double score = k * (1.0 - threshold / 18446744073709551616.0);
+        if (score > best_score) {
+            best_score = score;
+            sampler->k = k;
+            sampler->threshold = threshold;
+        }
+        if (power == 0) {
+            break;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Turns the uniform 64-bit 'random' into sampler->k uniform symbols, written
+ * to 'symbols' most significant first. Returns 0 if 'random' was rejected (the
+ * caller must try again with a fresh random number), 1 otherwise.
+ */
+int radix_sampler_draw(const radix_sampler *sampler, uint64_t random, uint32_t *symbols)
+{
+    uint64_t high;
+    uint64_t low = random;
+
+    for (uint32_t i = 0; i < sampler->k; i++) {
+        mul64(low, sampler->n, &high, &low);
+        symbols[i] = (uint32_t)high;
+    }
+
+    return low >= sampler->threshold;
+}
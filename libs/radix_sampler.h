@@ -0,0 +1,21 @@
+#ifndef RADIX_SAMPLER_H
+#define RADIX_SAMPLER_H
+
+#include <stdint.h>
+
+/* The most symbols one 64-bit draw can produce (reached when n is 1 or 2). */
+#define RADIX_SAMPLER_MAX_BATCH 64
+
+typedef struct RadixSampler {
+    /* Each symbol is uniform in [0, n). */
+    uint32_t n;
+    /* Symbols produced by each accepted draw. */
+    uint32_t k;
+    /* Draws whose final low word is below this (2^64 mod n^k) are rejected. */
+    uint64_t threshold;
+} radix_sampler;
+
+int radix_sampler_init(radix_sampler *sampler, uint32_t n);
+int radix_sampler_draw(const radix_sampler *sampler, uint64_t random, uint32_t *symbols);
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * The SHA-256 hash function, as specified in FIPS 180-4.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+#include <string.h>
+
+#include "sha256.h"
+#include "memset_s.h"
+
+#define ROTR32(v, n) (((v) >> (n)) | ((v) << (32 - (n))))
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t load32_be(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void store32_be(unsigned char *p, uint32_t v)
+{
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static void sha256_compress(uint32_t h[8], const unsigned char block[SHA256_BLOCK_LENGTH])
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, hh;
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = load32_be(block + 4 * i);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3];
+    e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t S1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = hh + S1 + ch + K[i] + w[i];
+        uint32_t S0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = S0 + maj;
+        hh = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+
+    memset_s(w, 0, sizeof(w));
+}
+
+void sha256_init(sha256 *ctx)
+{
+    ctx->h[0] = 0x6a09e667;
+    ctx->h[1] = 0xbb67ae85;
+    ctx->h[2] = 0x3c6ef372;
+    ctx->h[3] = 0xa54ff53a;
+    ctx->h[4] = 0x510e527f;
+    ctx->h[5] = 0x9b05688c;
+    ctx->h[6] = 0x1f83d9ab;
+    ctx->h[7] = 0x5be0cd19;
+    ctx->block_used = 0;
+    ctx->total_length = 0;
+}
+
+void sha256_update(sha256 *ctx, const void *data, size_t length)
+{
+    const unsigned char *in = data;
+    ctx->total_length += length;
+
+    while (length > 0) {
+        size_t n = SHA256_BLOCK_LENGTH - ctx->block_used;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(ctx->block + ctx->block_used, in, n);
+        ctx->block_used += n;
+        in += n;
+        length -= n;
+
+        if (ctx->block_used == SHA256_BLOCK_LENGTH) {
+            sha256_compress(ctx->h, ctx->block);
+            ctx->block_used = 0;
+        }
+    }
+}
+
+/*
+ * Writes the digest and wipes the context. The context must be initialized
+ * again before it is reused.
+ */
+void sha256_final(sha256 *ctx, unsigned char digest[SHA256_DIGEST_LENGTH])
+{
+    uint64_t bits = ctx->total_length * 8;
+
+    ctx->block[ctx->block_used++] = 0x80;
+    if (ctx->block_used > SHA256_BLOCK_LENGTH - 8) {
+        memset(ctx->block + ctx->block_used, 0, SHA256_BLOCK_LENGTH - ctx->block_used);
+        sha256_compress(ctx->h, ctx->block);
+        ctx->block_used = 0;
+    }
+    memset(ctx->block + ctx->block_used, 0, SHA256_BLOCK_LENGTH - 8 - ctx->block_used);
+    for (int i = 0; i < 8; i++) {
+        ctx->block[SHA256_BLOCK_LENGTH - 1 - i] = (bits >> (8 * i)) & 0xFF;
+    }
+    sha256_compress(ctx->h, ctx->block);
+
+    for (int i = 0; i < 8; i++) {
+        store32_be(digest + 4 * i, ctx->h[i]);
+    }
+
+    memset_s(ctx, 0, sizeof(*ctx));
+}
@@ -0,0 +1,21 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_BLOCK_LENGTH 64
+#define SHA256_DIGEST_LENGTH 32
+
+typedef struct Sha256 {
+    uint32_t h[8];
+    unsigned char block[SHA256_BLOCK_LENGTH];
+    size_t block_used;
+    uint64_t total_length;
+} sha256;
+
+void sha256_init(sha256 *ctx);
+void sha256_update(sha256 *ctx, const void *data, size_t length);
+void sha256_final(sha256 *ctx, unsigned char digest[SHA256_DIGEST_LENGTH]);
+
+#endif
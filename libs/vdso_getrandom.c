@@ -0,0 +1,185 @@
+/*
+ * Calls the getrandom() function that Linux 6.11+ exports through the vDSO.
+ *
+ * License
+ * --------
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright
+ * and related and neighboring rights to this software to the public domain
+ * worldwide. This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ * Explanation
+ * ------------
+ *
+ * The vDSO getrandom() produces the same kernel-quality random bytes as the
+ * getrandom(2) system call, but runs in userspace using a per-thread state
+ * that the kernel tells us how to allocate. That makes small requests (one
+ * password) much cheaper than a system call.
+ *
+ * Our libc may be too old to use it for us, so we find the symbol ourselves by
+ * walking the vDSO's ELF dynamic symbol table, the same way the kernel's
+ * selftests do. If anything about that fails (old kernel, unknown
+ * architecture, no AT_SYSINFO_EHDR), vdso_getrandom_init() returns 0 and the
+ * caller should use the getrandom(2) system call instead.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <string.h>
+#include <elf.h>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+
+#include "vdso_getrandom.h"
+
+#if UINTPTR_MAX > 0xFFFFFFFFu
+typedef Elf64_Ehdr vdso_ehdr;
+typedef Elf64_Phdr vdso_phdr;
+typedef Elf64_Shdr vdso_shdr;
+typedef Elf64_Sym vdso_sym;
+#else
+typedef Elf32_Ehdr vdso_ehdr;
+typedef Elf32_Phdr vdso_phdr;
+typedef Elf32_Shdr vdso_shdr;
+typedef Elf32_Sym vdso_sym;
+#endif
+
+/* From include/uapi/linux/random.h, which our kernel headers may predate. */
+struct vgetrandom_opaque_params {
+    uint32_t size_of_opaque_state;
+    uint32_t mmap_prot;
+    uint32_t mmap_flags;
+    uint32_t reserved[13];
+};
+
+static uintptr_t vdso_find_symbol(void);
+
+/*
+ * Returns the address of the vDSO's getrandom(), or 0 if there isn't one.
+ */
+static uintptr_t vdso_find_symbol(void)
+{
+    uintptr_t base = (uintptr_t)getauxval(AT_SYSINFO_EHDR);
+    if (base == 0) {
+        return 0;
+    }
+
+    const vdso_ehdr *ehdr = (const vdso_ehdr *)base;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) {
+        return 0;
+    }
+
+    /* Symbol values are relative to where the first PT_LOAD wanted to be. */
+    const vdso_phdr *phdr = (const vdso_phdr *)(base + ehdr->e_phoff);
+    uintptr_t load_offset = 0;
+    int found_load = 0;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == PT_LOAD) {
+            load_offset = base + phdr[i].p_offset - phdr[i].p_vaddr;
+            found_load = 1;
+            break;
+        }
+    }
+    if (!found_load) {
+        return 0;
+    }
+
+    const vdso_shdr *shdr = (const vdso_shdr *)(base + ehdr->e_shoff);
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        if (shdr[i].sh_type != SHT_DYNSYM || shdr[i].sh_entsize == 0) {
+            continue;
+        }
+        const vdso_sym *symbols = (const vdso_sym *)(base + shdr[i].sh_offset);
+        const char *names = (const char *)(base + shdr[shdr[i].sh_link].sh_offset);
+        size_t count = shdr[i].sh_size / shdr[i].sh_entsize;
+        for (size_t j = 0; j < count; j++) {
+            const char *name = names + symbols[j].st_name;
+            /* x86 and LoongArch use the first name; arm64, powerpc and s390
+             * use the second. */
+            if ((strcmp(name, "__vdso_getrandom") == 0 || strcmp(name, "__kernel_getrandom") == 0) &&
+                symbols[j].st_shndx != SHN_UNDEF && symbols[j].st_value != 0) {
+                return load_offset + symbols[j].st_value;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Finds the vDSO getrandom() and allocates a state for it.
+ * Returns 1 if it is usable, 0 if the caller should fall back to getrandom(2).
+ */
+int vdso_getrandom_init(vdso_getrandom *vdso)
+{
+    struct vgetrandom_opaque_params params;
+
+    vdso->function = NULL;
+    vdso->state = NULL;
+    vdso->state_length = 0;
+    vdso->mapping_length = 0;
+
+    uintptr_t address = vdso_find_symbol();
+    if (address == 0) {
+        return 0;
+    }
+    vdso_getrandom_function function = (vdso_getrandom_function)address;
+
+    /* Asking with these special arguments makes it describe its state. */
+    memset(&params, 0, sizeof(params));
+    if (function(NULL, 0, 0, &params, ~(size_t)0) != 0 || params.size_of_opaque_state == 0) {
+        return 0;
+    }
+
+    /* One state, in its own pages, mapped the way the kernel asks. */
+    size_t page = (size_t)getauxval(AT_PAGESZ);
+    if (page == 0) {
+        page = 4096;
+    }
+    size_t mapping_length = (params.size_of_opaque_state + page - 1) / page * page;
+    void *state = mmap(NULL, mapping_length, params.mmap_prot, params.mmap_flags, -1, 0);
+    if (state == MAP_FAILED) {
+        return 0;
+    }
+
+    vdso->function = function;
+    vdso->state = state;
+    vdso->state_length = params.size_of_opaque_state;
+    vdso->mapping_length = mapping_length;
+    return 1;
+}
+
+/*
+ * Fills 'out' with 'length' random bytes.
+ * Returns 0 on failure, 1 on success.
+ */
+int vdso_getrandom_fill(vdso_getrandom *vdso, unsigned char *out, size_t length)
+{
+    while (length > 0) {
+        ssize_t got = vdso->function(out, length, 0, vdso->state, vdso->state_length);
+        if (got <= 0) {
+            return 0;
+        }
+        out += got;
+        length -= (size_t)got;
+    }
+    return 1;
+}
+
+/*
+ * Releases the state. The kernel wipes its key material itself.
+ */
+void vdso_getrandom_deinit(vdso_getrandom *vdso)
+{
+    if (vdso->state != NULL) {
+        munmap(vdso->state, vdso->mapping_length);
+    }
+    vdso->function = NULL;
+    vdso->state = NULL;
+    vdso->state_length = 0;
+    vdso->mapping_length = 0;
+}
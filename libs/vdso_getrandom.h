@@ -0,0 +1,21 @@
+#ifndef VDSO_GETRANDOM_H
+#define VDSO_GETRANDOM_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef ssize_t (*vdso_getrandom_function)(void *buffer, size_t length, unsigned int flags,
+                                           void *opaque_state, size_t opaque_length);
+
+typedef struct VdsoGetrandom {
+    vdso_getrandom_function function;
+    void *state;
+    size_t state_length;
+    size_t mapping_length;
+} vdso_getrandom;
+
+int vdso_getrandom_init(vdso_getrandom *vdso);
+int vdso_getrandom_fill(vdso_getrandom *vdso, unsigned char *out, size_t length);
+void vdso_getrandom_deinit(vdso_getrandom *vdso);
+
+#endif
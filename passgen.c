@@ -25,12 +25,22 @@
  *
  */
 
+/* For O_DIRECT and fallocate(). */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
 #include <limits.h>
 #include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /* Constant time integer functions by Samuel Neves */
 #include "libs/ct32.h"
@@ -40,9 +50,64 @@
 #include "libs/wordlist.h"
 /* An implementation of memset() that the compiler won't optimize out. */
 #include "libs/memset_s.h"
+/* Buffered reads from /dev/urandom or a userspace generator. */
+#include "libs/entropy.h"
+/* The userspace generators, included here for their self-tests. */
+#include "libs/chacha20.h"
+#include "libs/chacha_drbg.h"
+#include "libs/aes_ctr_drbg.h"
+#include "libs/sha256.h"
+/* Several uniform characters from each 64-bit random number. */
+#include "libs/radix_sampler.h"
+/* Constant-time lookups of many characters at once. */
+#include "libs/ct_lookup.h"
+/* Constant-time selection of a row (a word) from a table. */
+#include "libs/ct_table.h"
+#if !defined(__x86_64__)
+/* The same from a bitsliced table, which is faster without SIMD. */
+#include "libs/ct_bitslice.h"
+#endif
+/* Pinning -j workers to NUMA nodes. */
+#include "libs/numa_nodes.h"
+/* Big, locked output buffers written with write() and writev(). */
+#include "libs/output.h"
+/* The header of --binary output. */
+#include "libs/binary_format.h"
 
 #define PASSWORD_LENGTH 64
 #define WORD_COUNT 10
+/* Word passwords are made this many at a time, so their lookups can share
+ * sweeps over the wordlist. */
+#define WORD_BATCH 16
+/* WORD_COUNT words and the '.'s between them. */
+#define PASSPHRASE_MAX_LENGTH (WORD_COUNT * WORDLIST_MAX_LENGTH + WORD_COUNT - 1)
+/* The longest line of output: a password or passphrase and its newline. */
+#define LINE_MAX_LENGTH ((PASSPHRASE_MAX_LENGTH > PASSWORD_LENGTH ? PASSPHRASE_MAX_LENGTH : PASSWORD_LENGTH) + 1)
+/* How passwords are written out: one per line, or as --binary's fixed-width
+ * records of characters or (--indices) of indices into the character set. */
+#define FORMAT_TEXT 0
+#define FORMAT_BINARY 1
+#define FORMAT_INDICES 2
+/* Every password from a character set takes this many bytes of output: with
+ * its newline as text, and without one as a binary record. */
+#define RECORD_LENGTH(format) ((format) == FORMAT_TEXT ? PASSWORD_LENGTH + 1 : PASSWORD_LENGTH)
+/* Passwords are made (and written out) this many at a time. A multiple of
+ * WORD_BATCH, so word passwords can share sweeps. */
+#define CHUNK_PASSWORDS 256
+/* The most -j workers we'll start. */
+#define MAX_JOBS 256
+/* Blocks of random bytes a --pipeline producer thread keeps ready. */
+#define PIPELINE_BLOCKS 4
+
+/* The wordlist layout lookup_words() sweeps (see there), which --numa copies
+ * to every node. */
+#if defined(__x86_64__)
+#define WORDLIST_TABLE (&words[0][0])
+#define WORDLIST_TABLE_LENGTH sizeof(words)
+#else
+#define WORDLIST_TABLE (&words_bitsliced[0][0])
+#define WORDLIST_TABLE_LENGTH sizeof(words_bitsliced)
+#endif
 
 #define CHARSET_HEX "0123456789ABCDEF"
 #define CHARSET_ALPHANUMERIC "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
@@ -54,10 +119,23 @@ int getRandom(void* buffer, unsigned long bufferlength);
 int getRandomUnsignedLong(unsigned long *random);
 void showHelp(void);
 unsigned long getLeastCoveringMask(unsigned long toRepresent);
-int getPassword(const char *set, unsigned long setLength, unsigned char *password, unsigned long passwordLength);
-int showRandomWords(void);
+int getRandomFrom(entropy_pool *pool, void* buffer, unsigned long bufferlength);
+int getPassword(entropy_pool *pool, const char *set, unsigned long setLength, unsigned char *password,
+                unsigned long passwordLength);
+int getRandomWords(entropy_pool *pool, const unsigned char *wordlist, unsigned int threads, int count,
+                   unsigned char *out, size_t *length);
+int getPasswords(entropy_pool *pool, const unsigned char *wordlist, unsigned int threads, const char *set,
+                 int format, int count, unsigned char *out, size_t *length);
+int runJobs(output *out, unsigned char *map, const char *set, int format, int numberOfPasswords,
+            unsigned int jobs, const entropy_source *source, int mixCpu, int numa, int pipeline, int showStats);
+int writeMapped(int fd, const unsigned char *header, size_t headerLength, const char *set, int format,
+                int numberOfPasswords, unsigned int jobs, const entropy_source *source, int mixCpu, int numa,
+                int pipeline, int showStats);
 int runtimeTests(void);
-uint32_t lookup_word(unsigned char *buf, uint32_t index);
+int openOutput(const char *path, int direct, int mapped);
+void showOutputError(const char *message);
+int lookup_words(const unsigned char *wordlist, unsigned char *rows, const uint32_t *indices, uint32_t count,
+                 unsigned int threads);
 
 static struct option long_options[] = {
     {"help",              no_argument,       NULL, 'h' },
@@ -68,24 +146,110 @@ static struct option long_options[] = {
     {"lower",             no_argument,       NULL, 'l' },
     {"words",             no_argument,       NULL, 'w' },
     {"password-count",    required_argument, NULL, 'p' },
+    {"source",            required_argument, NULL, 's' },
+    {"stats",             no_argument,       NULL, 'S' },
+    {"mix-cpu",           no_argument,       NULL, 'r' },
+    {"jobs",              required_argument, NULL, 'j' },
+    {"numa",              no_argument,       NULL, 'N' },
+    {"pipeline",          no_argument,       NULL, 'P' },
+    {"atomic",            no_argument,       NULL, 'A' },
+    {"no-vmsplice",       no_argument,       NULL, 'V' },
+    {"output",            required_argument, NULL, 'o' },
+    {"direct",            no_argument,       NULL, 'D' },
+    {"preallocate",       no_argument,       NULL, 'F' },
+    {"mmap",              no_argument,       NULL, 'M' },
+    {"binary",            no_argument,       NULL, 'b' },
+    {"indices",           no_argument,       NULL, 'i' },
     /* This skips the self test -- don't do it unless you're testing. */
     {"dont-use-this",     no_argument,       NULL, 'z' },
     {NULL, 0, NULL, 0 }
 };
 
+/* Every random byte we use comes out of this pool (see getRandom()). */
+static entropy_pool random_pool;
+
+/* The file the passwords go to (--output), or NULL for stdout. */
+static const char *outputPath = NULL;
+
+/* What the -j workers are making, and how they hand it to the writer. */
+typedef struct PasswordJob {
+    /* The character set, or NULL for word passwords. */
+    const char *set;
+    int format;
+    int numberOfPasswords;
+    unsigned int jobs;
+    const entropy_source *source;
+    int mixCpu;
+    /* Set to give each worker's pool a producer thread. */
+    int pipeline;
+    /* Set to pin workers to nodes (see numa_nodes.c). */
+    int numa;
+    numa_nodes nodes;
+    /* Each node's copy of the wordlist, made by its first worker. */
+    unsigned char *wordlists[NUMA_NODES_MAX];
+    pthread_mutex_t lock;
+    /* Signalled whenever a chunk becomes ready or is written out. */
+    pthread_cond_t changed;
+    /* Set when the writer gives up, so workers stop making chunks. */
+    int stop;
+    /* With --mmap, the file's records, which workers fill in themselves. */
+    unsigned char *map;
+} password_job;
+
+/*
+ * Worker 'index' makes chunks index, index + jobs, index + 2 * jobs, ...
+ * with its own entropy pool. It has two chunk buffers, so it can make the
+ * next chunk while the writer is still waiting for (or writing) this one.
+ * The pool and buffers are allocated by the worker itself, on its own node.
+ * With --mmap, it makes one contiguous range of chunks right in the file
+ * instead, and there's no writer (see writeMapped()).
+ */
+typedef struct PasswordWorker {
+    pthread_t thread;
+    password_job *job;
+    unsigned int index;
+    /* Which of job->nodes it runs on, with --numa. */
+    unsigned int node;
+    unsigned char *chunks[2];
+    size_t lengths[2];
+    int ready[2];
+    int failed[2];
+    /* The pool's statistics, copied out when the worker is done. */
+    unsigned long bytes_read;
+    cpu_random_stats cpu_stats;
+    entropy_producer_stats producer_stats;
+    unsigned long passwords;
+} password_worker;
+
+static void *passwordWorker(void *argument);
+static void finishWorker(password_worker *worker, entropy_pool *pool);
+
 int main(int argc, char* argv[])
 {
     /* Options */
-    const char *set;
+    const char *set = NULL;
     int numberOfPasswords = 1;
-    int generateWordPassword = 0;
     int skipSelfTest = 0;
+    const entropy_source *entropySource = &entropy_source_urandom;
+    int showStats = 0;
+    int mixCpu = 0;
+    int jobs = 1;
+    int numa = 0;
+    int pipeline = 0;
+    int atomic = 0;
+    int vmsplice = 1;
+    int direct = 0;
+    int preallocate = 0;
+    int mapped = 0;
+    int format = FORMAT_TEXT;
 
     /* Variables used while parsing. */
     int optionCharacter = 0;
     int isPasswordTypeSet = 0;
     int isPasswordCountSet = 0;
-    while((optionCharacter = getopt_long(argc, argv, "hzxndlwap:", long_options, NULL)) != -1) {
+    int isSourceSet = 0;
+    int isJobsSet = 0;
+    while((optionCharacter = getopt_long(argc, argv, "hzxndlwap:s:Srj:NPAVo:DFMbi", long_options, NULL)) != -1) {
             switch(optionCharacter)
             {
                 case 'h': /* help */
@@ -142,7 +306,7 @@ int main(int argc, char* argv[])
                         showHelp();
                         return EXIT_FAILURE;
                     }
-                    generateWordPassword = 1;
+                    set = NULL;
                     isPasswordTypeSet = 1;
                     break;
 
@@ -163,6 +327,90 @@ int main(int argc, char* argv[])
                     }
                     break;
 
+                case 's': /* entropy source */
+                    if (isSourceSet) {
+                        showHelp();
+                        return EXIT_FAILURE;
+                    }
+                    entropySource = entropy_source_find(optarg);
+                    if (entropySource == NULL) {
+                        showHelp();
+                        return EXIT_FAILURE;
+                    }
+                    isSourceSet = 1;
+                    break;
+
+                case 'S': /* print statistics to stderr */
+                    showStats = 1;
+                    break;
+
+                case 'r': /* mix RDSEED/RDRAND into generator seeds */
+                    mixCpu = 1;
+                    break;
+
+                case 'j': /* worker threads */
+                    if (isJobsSet) {
+                        showHelp();
+                        return EXIT_FAILURE;
+                    }
+                    if (sscanf(optarg, "%10d", &jobs) != 1 || jobs < 0 || jobs > MAX_JOBS) {
+                        showHelp();
+                        return EXIT_FAILURE;
+                    }
+                    /* 0 means one per online CPU. */
+                    if (jobs == 0) {
+                        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                        jobs = cpus < 1 ? 1 : (cpus > MAX_JOBS ? MAX_JOBS : (int)cpus);
+                    }
+                    isJobsSet = 1;
+                    break;
+
+                case 'N': /* pin workers to NUMA nodes */
+                    numa = 1;
+                    break;
+
+                case 'P': /* fetch random bytes in another thread */
+                    pipeline = 1;
+                    break;
+
+                case 'A': /* all passwords or none */
+                    atomic = 1;
+                    break;
+
+                case 'V': /* always copy output with write() */
+                    vmsplice = 0;
+                    break;
+
+                case 'o': /* write to a file */
+                    if (outputPath != NULL) {
+                        showHelp();
+                        return EXIT_FAILURE;
+                    }
+                    outputPath = optarg;
+                    break;
+
+                case 'D': /* bypass the page cache */
+                    direct = 1;
+                    break;
+
+                case 'F': /* allocate the file's space up front */
+                    preallocate = 1;
+                    break;
+
+                case 'M': /* workers fill a mapping of the file */
+                    mapped = 1;
+                    break;
+
+                case 'b': /* header and records instead of lines */
+                    if (format == FORMAT_TEXT) {
+                        format = FORMAT_BINARY;
+                    }
+                    break;
+
+                case 'i': /* records of indices into the set */
+                    format = FORMAT_INDICES;
+                    break;
+
                 case 'z': /* skip self test - for test.rb */
                     skipSelfTest = 1;
                     break;
@@ -179,37 +427,227 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    /* The test source's output is the same every time. Only allow it when
+     * we're obviously being tested. */
+    if (entropySource == &entropy_source_test && !skipSelfTest) {
+        fprintf(stderr, "ERROR: The test source is not random. It is only for testing.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* CPU randomness only goes into generator seeds. */
+    if (mixCpu && !entropySource->seeded) {
+        fprintf(stderr, "ERROR: --mix-cpu only works with the chacha20, aes-ctr and drbg sources.\n");
+        return EXIT_FAILURE;
+    }
+    if ((direct || preallocate) && outputPath == NULL) {
+        fprintf(stderr, "ERROR: --direct and --preallocate only work with --output.\n");
+        return EXIT_FAILURE;
+    }
+    /* Atomic output is written all at once with writev(), which can't keep
+     * to O_DIRECT's alignment. */
+    if (direct && atomic) {
+        fprintf(stderr, "ERROR: --direct doesn't work with --atomic.\n");
+        return EXIT_FAILURE;
+    }
+    if (mapped && outputPath == NULL) {
+        fprintf(stderr, "ERROR: --mmap only works with --output.\n");
+        return EXIT_FAILURE;
+    }
+    /* The records have to be the same length to know where each one goes. */
+    if (mapped && set == NULL) {
+        fprintf(stderr, "ERROR: --mmap doesn't work with --words.\n");
+        return EXIT_FAILURE;
+    }
+    /* Binary records are fixed-width, too. */
+    if (format != FORMAT_TEXT && set == NULL) {
+        fprintf(stderr, "ERROR: --binary and --indices don't work with --words.\n");
+        return EXIT_FAILURE;
+    }
+    if (mapped && direct) {
+        fprintf(stderr, "ERROR: --direct doesn't work with --mmap.\n");
+        return EXIT_FAILURE;
+    }
+    /* --mmap sizes the file itself. */
+    if (mapped) {
+        preallocate = 0;
+    }
+    if (mixCpu && !cpu_random_has_rdseed() && !cpu_random_has_rdrand()) {
+        fprintf(stderr, "WARNING: This CPU has neither RDSEED nor RDRAND. Seeding from the kernel only.\n");
+        mixCpu = 0;
+    }
+
+    entropy_pool_init(&random_pool, entropySource);
+    random_pool.mix_cpu = mixCpu;
+
     /* We run unit tests on EVERY execution just to make sure nothing is
      * horribly wrong. There's an option to skip it, which is used for testing
      * purposes (see test.rb). */
     if (!skipSelfTest && !runtimeTests()) {
         fprintf(stderr, "ERROR: Runtime self-tests failed. SOMETHING IS WRONG\n");
+        entropy_pool_deinit(&random_pool);
         return EXIT_FAILURE;
     }
 
-    if (generateWordPassword) {
-        for (int i = 0; i < numberOfPasswords; i++) {
-            if (!showRandomWords()) {
-                fprintf(stderr, "Error getting random data.\n");
-                return EXIT_FAILURE;
-            }
+    /* Don't count the bytes used by the self-tests in the statistics. */
+    unsigned long bytesBeforePasswords = random_pool.bytes_read;
+
+    /* Binary output starts with a header saying what's in it. */
+    unsigned char header[BINARY_FORMAT_MAX_HEADER];
+    size_t headerLength = 0;
+    if (format != FORMAT_TEXT) {
+        binary_format_header info;
+        if (!binary_format_init(&info, set, PASSWORD_LENGTH, numberOfPasswords, format == FORMAT_INDICES)) {
+            entropy_pool_deinit(&random_pool);
+            return EXIT_FAILURE;
         }
-    } else {
-        unsigned char result[PASSWORD_LENGTH];
+        headerLength = binary_format_write(&info, header);
+    }
 
-        for(int i = 0; i < numberOfPasswords; i++) {
-            if(getPassword(set, strlen(set), result, PASSWORD_LENGTH)) {
-                fwrite(result, sizeof(unsigned char), PASSWORD_LENGTH, stdout);
-                printf("\n");
+    int outputFd = STDOUT_FILENO;
+    if (outputPath != NULL) {
+        outputFd = openOutput(outputPath, direct, mapped);
+        if (outputFd < 0) {
+            fprintf(stderr, "Error opening %s: %s\n", outputPath, strerror(errno));
+            entropy_pool_deinit(&random_pool);
+            return EXIT_FAILURE;
+        }
+    }
+    if (preallocate) {
+        /* Word passwords vary in length, so for them this is an upper bound.
+         * The file is cut to what was written at the end. */
+        off_t size = (off_t)headerLength + (off_t)numberOfPasswords * (set == NULL ? LINE_MAX_LENGTH : RECORD_LENGTH(format));
+        if (fallocate(outputFd, 0, 0, size) != 0) {
+            fprintf(stderr, "WARNING: Couldn't preallocate %s: %s\n", outputPath, strerror(errno));
+            preallocate = 0;
+        }
+    }
+
+    /* With -j (or --mmap), each worker starts its own producer instead. */
+    if (pipeline && jobs == 1 && !numa && !mapped && !entropy_pool_start_producer(&random_pool, PIPELINE_BLOCKS)) {
+        fputs(set == NULL ? "Error getting random data.\n" :
+                            "Error getting random data or allocating memory.\n", stderr);
+        if (outputPath != NULL) {
+            close(outputFd);
+        }
+        entropy_pool_deinit(&random_pool);
+        return EXIT_FAILURE;
+    }
+
+    output out;
+    int success = 1;
+    unsigned long mappedBytes = 0;
+    output_init(&out, outputFd, atomic);
+    if (mapped) {
+        /* Nothing goes through 'out': the workers fill the file themselves. */
+    } else if (outputPath != NULL) {
+        if (!output_try_io_uring(&out) && direct && !atomic) {
+            fprintf(stderr, "WARNING: io_uring isn't available. Writing %s through the page cache.\n",
+                    outputPath);
+        }
+    } else if (vmsplice) {
+        output_try_vmsplice(&out);
+    }
+
+    if (mapped) {
+        success = writeMapped(outputFd, header, headerLength, set, format, numberOfPasswords, jobs, entropySource,
+                              mixCpu, numa, pipeline, showStats);
+        mappedBytes = success ? headerLength + (unsigned long)numberOfPasswords * RECORD_LENGTH(format) : 0;
+    } else if (headerLength > 0 && !output_append(&out, header, headerLength)) {
+        showOutputError("Error writing output or allocating memory.\n");
+        success = 0;
+    } else if (jobs > 1 || numa) {
+        success = runJobs(&out, NULL, set, format, numberOfPasswords, jobs, entropySource, mixCpu, numa, pipeline,
+                          showStats);
+    } else {
+        /* The passwords are made right in the output buffer. */
+        for (int i = 0; i < numberOfPasswords && success; i += CHUNK_PASSWORDS) {
+            int count = numberOfPasswords - i < CHUNK_PASSWORDS ? numberOfPasswords - i : CHUNK_PASSWORDS;
+            size_t length = 0;
+            unsigned char *chunk = output_reserve(&out, (size_t)count * LINE_MAX_LENGTH);
+            if (chunk == NULL) {
+                showOutputError("Error writing output or allocating memory.\n");
+                success = 0;
+            } else if (!getPasswords(&random_pool, WORDLIST_TABLE, 0, set, format, count, chunk, &length)) {
+                fputs(set == NULL ? "Error getting random data.\n" :
+                                    "Error getting random data or allocating memory.\n", stderr);
+                success = 0;
             } else {
-                memset_s(result, 0, PASSWORD_LENGTH);
-                fprintf(stderr, "Error getting random data or allocating memory.\n");
-                return EXIT_FAILURE;
+                output_advance(&out, length);
             }
-            memset_s(result, 0, PASSWORD_LENGTH);
         }
     }
 
+    /* Without --atomic, the passwords made before a failure still go out,
+     * as they always have. */
+    if (success && !output_commit(&out)) {
+        showOutputError("Error writing output.\n");
+        success = 0;
+    } else if (!success) {
+        output_flush(&out);
+    }
+    unsigned long bytesWritten = out.bytes_written;
+    unsigned long writeCalls = out.write_calls;
+    unsigned long spliceCalls = out.splice_calls;
+    unsigned long ringWrites = out.ring_writes;
+    output_deinit(&out);
+
+    if (outputPath != NULL) {
+        /* Don't leave preallocated space (zeros) past the passwords. */
+        if (preallocate && ftruncate(outputFd, (off_t)bytesWritten) != 0 && success) {
+            fprintf(stderr, "Error writing %s: %s\n", outputPath, strerror(errno));
+            success = 0;
+        }
+        /* Some file systems only report write errors here. */
+        if (close(outputFd) != 0 && success) {
+            fprintf(stderr, "Error writing %s: %s\n", outputPath, strerror(errno));
+            success = 0;
+        }
+    }
+
+    if (!success) {
+        entropy_pool_deinit(&random_pool);
+        return EXIT_FAILURE;
+    }
+
+    /* The producer's half of the statistics is only there once it stops. */
+    entropy_pool_stop_producer(&random_pool);
+
+    if (showStats) {
+        fprintf(stderr, "Entropy source: %s\n", entropy_pool_description(&random_pool));
+        fprintf(stderr, "Random bytes per password: %.2f\n",
+                (double)(random_pool.bytes_read - bytesBeforePasswords) / numberOfPasswords);
+        if (mixCpu) {
+            const cpu_random_stats *cpu = &random_pool.cpu_stats;
+            fprintf(stderr, "CPU randomness: %lu RDSEED words (%lu retries, %lu failures), "
+                            "%lu RDRAND words (%lu failures)\n",
+                    cpu->rdseed_words, cpu->rdseed_retries, cpu->rdseed_failures,
+                    cpu->rdrand_words, cpu->rdrand_failures);
+        }
+        if (mapped) {
+            fprintf(stderr, "Output: %lu bytes through a shared mapping\n", mappedBytes);
+        } else if (spliceCalls > 0) {
+            fprintf(stderr, "Output: %lu bytes in %lu writes and %lu vmsplices\n",
+                    bytesWritten, writeCalls, spliceCalls);
+        } else if (ringWrites > 0) {
+            fprintf(stderr, "Output: %lu bytes in %lu writes and %lu io_uring writes\n",
+                    bytesWritten, writeCalls, ringWrites);
+        } else {
+            fprintf(stderr, "Output: %lu bytes in %lu writes\n", bytesWritten, writeCalls);
+        }
+        if (pipeline) {
+            const entropy_producer_stats *producer = &random_pool.producer_stats;
+            /* If the reader waits more often than the producer, the entropy
+             * source is what limits us; otherwise making passwords is. */
+            fprintf(stderr, "Entropy pipeline: %lu blocks, average queue depth %.2f of %u, "
+                            "%lu reader stalls, %lu producer stalls (bottleneck: %s)\n",
+                    producer->blocks_produced,
+                    producer->blocks_taken > 0 ? (double)producer->depth_total / producer->blocks_taken : 0.0,
+                    producer->ring_blocks, producer->reader_stalls, producer->producer_stalls,
+                    producer->reader_stalls > producer->producer_stalls ? "entropy source" : "passwords");
+        }
+    }
+
+    entropy_pool_deinit(&random_pool);
     return EXIT_SUCCESS;
 }
 
@@ -227,37 +665,98 @@ void showHelp(void)
 
     puts("Where <optional arguments> can be:");
     puts("  -p, --password-count N\t\tSpecify number of passwords to generate");
+    puts("  -s, --source NAME\t\t\tWhere random bytes come from:");
+    puts("\t\t\t\t\t  urandom   - read /dev/urandom (default)");
+    puts("\t\t\t\t\t  chacha20  - ChaCha20 generator seeded by the kernel");
+    puts("\t\t\t\t\t  aes-ctr   - AES-256 CTR_DRBG (needs AES-NI)");
+    puts("\t\t\t\t\t  drbg      - the fastest of the two generators");
+    puts("\t\t\t\t\t  getrandom - getrandom(), via the vDSO if possible");
+    puts("  -r, --mix-cpu\t\t\t\tAlso hash RDSEED/RDRAND output into generator seeds");
+    puts("  -S, --stats\t\t\t\tPrint statistics (e.g. entropy source) to stderr");
+    puts("  -j, --jobs N\t\t\t\tGenerate with N threads, each with its own entropy");
+    puts("\t\t\t\t\t  pool (0 = one per CPU). The output is in order.");
+    puts("  -N, --numa\t\t\t\tPin workers to NUMA nodes, with their memory and a");
+    puts("\t\t\t\t\t  copy of the wordlist on their own node");
+    puts("  -P, --pipeline\t\t\tFetch random bytes in another thread, ahead of use");
+    puts("  -A, --atomic\t\t\t\tPrint nothing at all unless every password is made");
+    puts("  -V, --no-vmsplice\t\t\tCopy output into pipes instead of splicing it");
+    puts("  -o, --output FILE\t\t\tWrite the passwords to FILE (made readable only by");
+    puts("\t\t\t\t\t  you) instead of stdout, with io_uring if possible");
+    puts("  -D, --direct\t\t\t\tWrite FILE with O_DIRECT, bypassing the page cache");
+    puts("  -F, --preallocate\t\t\tAllocate FILE's space before writing to it");
+    puts("  -M, --mmap\t\t\t\tHave the -j workers fill their own parts of FILE");
+    puts("\t\t\t\t\t  through a mapping of it (not for --words). FILE");
+    puts("\t\t\t\t\t  is emptied if anything fails.");
+    puts("  -b, --binary\t\t\t\tWrite a header, then fixed-width records with no");
+    puts("\t\t\t\t\t  newlines (see libs/binary_format.c; not for --words)");
+    puts("  -i, --indices\t\t\t\tLike --binary, but each byte is a character's");
+    puts("\t\t\t\t\t  index in the character set");
     puts("WARNING: If automated, you MUST check that the exit status is 0.");
 }
 
-int getPassword(const char *set, unsigned long setLength, unsigned char *password, unsigned long passwordLength)
+/*
+ * Opens the file at 'path' for the passwords, creating or emptying it. A new
+ * file is only readable by us. With 'direct', it's opened with O_DIRECT if the
+ * file system supports that. With 'mapped', it's opened for reading too, as
+ * a shared, writable mmap() needs. Returns the descriptor, or -1 on failure.
+ */
+int openOutput(const char *path, int direct, int mapped)
 {
-    unsigned long bufLen = passwordLength;
-    unsigned long bufIdx = 0;
-    unsigned char *rndBuf = (unsigned char*)malloc(bufLen);
+    int flags = (mapped ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC | O_CLOEXEC;
 
-    if (rndBuf == NULL) {
-        return 0;
+    if (direct) {
+        int fd = open(path, flags | O_DIRECT, 0600);
+        if (fd >= 0 || errno != EINVAL) {
+            return fd;
+        }
+        fprintf(stderr, "WARNING: %s doesn't support --direct. Writing through the page cache.\n", path);
     }
+    return open(path, flags, 0600);
+}
 
-    if (setLength < 1 || setLength > 256) {
-        free(rndBuf);
+/*
+ * Says why the output failed. For a file, that's errno. On stdout it's
+ * 'message', as it always has been.
+ */
+void showOutputError(const char *message)
+{
+    if (outputPath != NULL) {
+        fprintf(stderr, "Error writing %s: %s\n", outputPath, strerror(errno));
+    } else {
+        fputs(message, stderr);
+    }
+}
+
+int getPassword(entropy_pool *pool, const char *set, unsigned long setLength, unsigned char *password,
+                unsigned long passwordLength)
+{
+    radix_sampler sampler;
+    uint32_t symbols[RADIX_SAMPLER_MAX_BATCH];
+
+    if (setLength < 1 || setLength > 256 || !radix_sampler_init(&sampler, setLength)) {
         return 0;
     }
-    unsigned char bitMask = getLeastCoveringMask(setLength - 1ul) & 0xFF;
 
-    if(!getRandom(rndBuf, bufLen)) {
-        memset_s(rndBuf, 0, bufLen);
-        free(rndBuf);
+    /* Each 64-bit random number gives sampler.k characters (unless it's
+     * rejected), so this is enough for the whole password most of the time. */
+    unsigned long bufLen = (passwordLength + sampler.k - 1) / sampler.k;
+    unsigned long bufCount = 0;
+    unsigned long bufIdx = 0;
+    uint64_t *rndBuf = (uint64_t*)malloc(bufLen * sizeof(uint64_t));
+
+    if (rndBuf == NULL) {
         return 0;
     }
 
     unsigned long i = 0;
     while(i < passwordLength) {
-        // Read more random bytes if necessary.
-        if(bufIdx >= bufLen) {
-            if(!getRandom(rndBuf, bufLen)) {
-                memset_s(rndBuf, 0, bufLen);
+        // Read more random numbers if necessary, but only as many as the rest
+        // of the password needs.
+        if(bufIdx >= bufCount) {
+            bufCount = (passwordLength - i + sampler.k - 1) / sampler.k;
+            if(!getRandomFrom(pool, rndBuf, bufCount * sizeof(uint64_t))) {
+                memset_s(symbols, 0, sizeof(symbols));
+                memset_s(rndBuf, 0, bufLen * sizeof(uint64_t));
                 free(rndBuf);
                 return 0;
             }
@@ -265,93 +764,561 @@ int getPassword(const char *set, unsigned long setLength, unsigned char *passwor
             bufIdx = 0;
         }
 
-        unsigned char c = rndBuf[bufIdx++];
-        c = c & bitMask;
-
-        // Discard the random byte if it isn't in range.
-        if(c < setLength) {
-            password[i] = invariant_time_lookup((const unsigned char*)set, setLength, c);
-            i++;
+        // Discard the random number if it would give biased characters.
+        // Otherwise, keep the indices in 'password' until they're all there.
+        if(radix_sampler_draw(&sampler, rndBuf[bufIdx++], symbols)) {
+            for (uint32_t j = 0; j < sampler.k && i < passwordLength; j++) {
+                password[i] = (unsigned char)symbols[j];
+                i++;
+            }
         }
     }
 
-    memset_s(rndBuf, 0, bufLen);
+    // Turn all of the indices into characters at once, unless the caller
+    // wants the indices (set is NULL).
+    if (set != NULL) {
+        ct_lookup_block((const unsigned char*)set, setLength, password, password, passwordLength);
+    }
+
+    memset_s(symbols, 0, sizeof(symbols));
+    memset_s(rndBuf, 0, bufLen * sizeof(uint64_t));
     free(rndBuf);
     return 1;
 }
 
-int showRandomWords(void)
+/*
+ * Makes 'count' (at most WORD_BATCH) word passwords with random numbers from
+ * 'pool' and words from 'wordlist' (WORDLIST_TABLE or a copy of it), and
+ * appends them, one per line, to out + *length. Up to 'threads' threads (0
+ * for one per CPU) may sweep the wordlist.
+ */
+int getRandomWords(entropy_pool *pool, const unsigned char *wordlist, unsigned int threads, int count,
+                   unsigned char *out, size_t *length)
 {
-    unsigned int words_added = 0;
-    unsigned long random = 0;
-    unsigned char word[WORDLIST_MAX_LENGTH];
-    uint32_t word_length = 0;
-    ct_string str;
-    ct_string_init(&str);
+    uint32_t total_words = count * WORD_COUNT;
+    uint32_t words_added = 0;
+    uint64_t random[WORD_BATCH * WORD_COUNT];
+    unsigned long randomCount = 0;
+    unsigned long randomIdx = 0;
+    radix_sampler sampler;
+    uint32_t indices[WORD_BATCH * WORD_COUNT + RADIX_SAMPLER_MAX_BATCH];
+    unsigned char rows[WORD_BATCH * WORD_COUNT][WORDLIST_MAX_LENGTH + 1];
+    unsigned char passphrase[CT_STRING_BUFFER_LENGTH(PASSPHRASE_MAX_LENGTH)];
+    unsigned char final[PASSPHRASE_MAX_LENGTH];
+    int success = 1;
+
+    if (count < 1 || count > WORD_BATCH) {
+        return 0;
+    }
 
-    while (words_added < WORD_COUNT) {
-        if (!getRandomUnsignedLong(&random)) {
-            return 0;
+    /* Each 64-bit random number gives several word indices (4 for a list of
+     * 7236 words), instead of one masked index per number. */
+    if (!radix_sampler_init(&sampler, WORDLIST_WORD_COUNT)) {
+        return 0;
+    }
+
+    while (words_added < total_words) {
+        // Read more random numbers if necessary, but only as many as the rest
+        // of the words need.
+        if (randomIdx >= randomCount) {
+            randomCount = (total_words - words_added + sampler.k - 1) / sampler.k;
+            if (!getRandomFrom(pool, random, randomCount * sizeof(uint64_t))) {
+                memset_s(random, 0, sizeof(random));
+                memset_s(indices, 0, sizeof(indices));
+                return 0;
+            }
+            randomIdx = 0;
         }
-        random = random & getLeastCoveringMask(WORDLIST_WORD_COUNT - 1);
 
-        if (random < WORDLIST_WORD_COUNT) {
-            word_length = lookup_word(word, random);
+        // Discard the random number if it would give biased indices. The
+        // indices array has room for a whole draw past the last word.
+        if (radix_sampler_draw(&sampler, random[randomIdx++], indices + words_added)) {
+            words_added += sampler.k;
+        }
+    }
+
+    /* Look up all of the words, sweeping the wordlist once for every batch
+     * of them. */
+    if (!lookup_words(wordlist, &rows[0][0], indices, total_words, threads)) {
+        success = 0;
+    }
+
+    /* Every passphrase is built in the same buffer, which is big enough for
+     * the longest one, and wiped in between. */
+    ct_string str;
+    ct_string_init_buffer(&str, passphrase, PASSPHRASE_MAX_LENGTH);
+
+    for (int p = 0; p < count && success; p++) {
+        ct_string_reset(&str);
+
+        for (uint32_t w = 0; w < WORD_COUNT && success; w++) {
+            const unsigned char *row = rows[p * WORD_COUNT + w];
 
             /* Concatenate the '.' between words if it isn't the first word. */
-            if (words_added > 0) {
-                if (!ct_string_concat(&str, (const unsigned char *)".", 1, 1)) {
-                    return 0;
-                }
+            if (w > 0 && !ct_string_concat(&str, (const unsigned char *)".", 1, 1)) {
+                success = 0;
             }
 
-            /* Concatenate the word itself. */
-            if (!ct_string_concat(&str, word, WORDLIST_MAX_LENGTH, word_length)) {
+            /* Concatenate the word itself. The first byte is its length. */
+            if (success && !ct_string_concat(&str, row + 1, WORDLIST_MAX_LENGTH, row[0])) {
+                success = 0;
+            }
+        }
+
+        if (success) {
+            uint32_t total_length = ct_string_allocated_length(&str);
+            ct_string_finalize(&str, final, '.');
+            memcpy(out + *length, final, total_length);
+            out[*length + total_length] = '\n';
+            *length += total_length + 1;
+        }
+    }
+
+    ct_string_deinit(&str);
+    memset_s(final, 0, sizeof(final));
+
+    memset_s(random, 0, sizeof(random));
+    memset_s(indices, 0, sizeof(indices));
+    memset_s(rows, 0, sizeof(rows));
+
+    return success;
+}
+
+/*
+ * Makes 'count' passwords from 'set' (or word passwords from 'wordlist', swept
+ * by up to 'threads' threads, if 'set' is NULL) with random numbers from
+ * 'pool', and writes them to 'out' in 'format': one per line, or (for a set)
+ * as binary records.
+ * 'out' must have room for count * LINE_MAX_LENGTH bytes. Sets *length to
+ * the number of bytes written, which for a set is exactly count *
+ * RECORD_LENGTH(format). Returns 1 on success, 0 on failure.
+ */
+int getPasswords(entropy_pool *pool, const unsigned char *wordlist, unsigned int threads, const char *set,
+                 int format, int count, unsigned char *out, size_t *length)
+{
+    *length = 0;
+
+    if (set == NULL) {
+        for (int i = 0; i < count; i += WORD_BATCH) {
+            int batch = count - i < WORD_BATCH ? count - i : WORD_BATCH;
+            if (!getRandomWords(pool, wordlist, threads, batch, out, length)) {
                 return 0;
             }
+        }
+        return 1;
+    }
 
-            words_added++;
+    unsigned long setLength = strlen(set);
+    /* --indices leaves each character as its position in the set. */
+    const char *symbols = format == FORMAT_INDICES ? NULL : set;
+    for (int i = 0; i < count; i++) {
+        if (!getPassword(pool, symbols, setLength, out + *length, PASSWORD_LENGTH)) {
+            return 0;
+        }
+        *length += PASSWORD_LENGTH;
+        if (format == FORMAT_TEXT) {
+            out[*length] = '\n';
+            *length += 1;
         }
+    }
+    return 1;
+}
 
+/*
+ * Makes 'numberOfPasswords' passwords (see getPasswords()) with 'jobs'
+ * threads, each with its own 'source' pool, and adds them to 'out' in order:
+ * chunk i comes from worker i % jobs. With 'numa', the workers are
+ * spread over the NUMA nodes and pinned to them, and (with 'showStats') each
+ * node's throughput is printed. With 'pipeline', each worker's pool has a
+ * producer thread. The workers' random bytes, CPU randomness and producer
+ * statistics are added to random_pool's. With 'map', 'out' isn't used: each
+ * worker makes its own range of chunks right in 'map' (see writeMapped()).
+ * Prints an error and returns 0 on failure.
+ */
+int runJobs(output *out, unsigned char *map, const char *set, int format, int numberOfPasswords,
+            unsigned int jobs, const entropy_source *source, int mixCpu, int numa, int pipeline, int showStats)
+{
+    int chunkCount = (numberOfPasswords + CHUNK_PASSWORDS - 1) / CHUNK_PASSWORDS;
+    password_job *job;
+    password_worker *workers;
+    unsigned int started = 0;
+    int success = 1;
+    struct timespec start, end;
+
+    /* There's no point in a worker with nothing to do. */
+    if (jobs > (unsigned int)chunkCount) {
+        jobs = chunkCount;
     }
 
-    uint32_t total_length = ct_string_allocated_length(&str);
+    /* The job is big (it has the node list), so it isn't on the stack. */
+    job = calloc(1, sizeof(password_job));
+    workers = calloc(jobs, sizeof(password_worker));
+    if (job == NULL || workers == NULL) {
+        free(job);
+        free(workers);
+        fprintf(stderr, "Error allocating memory.\n");
+        return 0;
+    }
+
+    job->set = set;
+    job->format = format;
+    job->numberOfPasswords = numberOfPasswords;
+    job->jobs = jobs;
+    job->source = source;
+    job->mixCpu = mixCpu;
+    job->pipeline = pipeline;
+    job->numa = numa;
+    job->stop = 0;
+    job->map = map;
+
+    if (numa && !numa_nodes_init(&job->nodes)) {
+        /* We can still generate, just without pinning. */
+        fprintf(stderr, "WARNING: Couldn't find the NUMA nodes. Not pinning workers.\n");
+        job->numa = 0;
+    }
 
-    unsigned char *final = malloc(total_length);
-    if (final == NULL) {
+    if (pthread_mutex_init(&job->lock, NULL) != 0) {
+        free(job);
+        free(workers);
+        fprintf(stderr, "Error starting worker threads.\n");
+        return 0;
+    }
+    if (pthread_cond_init(&job->changed, NULL) != 0) {
+        pthread_mutex_destroy(&job->lock);
+        free(job);
+        free(workers);
+        fprintf(stderr, "Error starting worker threads.\n");
         return 0;
     }
 
-    ct_string_finalize(&str, final, '.');
-    fwrite(final, sizeof(unsigned char), total_length, stdout);
-    printf("\n");
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    memset_s(&random, 0, sizeof(random));
-    memset_s(word, 0, WORDLIST_MAX_LENGTH);
-    memset_s(final, 0, total_length);
+    for (unsigned int w = 0; w < jobs; w++) {
+        workers[w].job = job;
+        workers[w].index = w;
+        workers[w].node = job->numa ? numa_nodes_for_worker(&job->nodes, w) : 0;
+        if (pthread_create(&workers[w].thread, NULL, passwordWorker, &workers[w]) != 0) {
+            fprintf(stderr, "Error starting worker threads.\n");
+            success = 0;
+            break;
+        }
+        started++;
+    }
 
-    ct_string_deinit(&str);
-    free(final);
+    /* Write the chunks out in order, as they become ready. */
+    for (int c = 0; map == NULL && c < chunkCount && success; c++) {
+        password_worker *worker = &workers[c % jobs];
+        int slot = (c / jobs) % 2;
 
-    return 1;
+        pthread_mutex_lock(&job->lock);
+        while (!worker->ready[slot]) {
+            pthread_cond_wait(&job->changed, &job->lock);
+        }
+        pthread_mutex_unlock(&job->lock);
+
+        if (worker->failed[slot]) {
+            fputs(set == NULL ? "Error getting random data.\n" :
+                                "Error getting random data or allocating memory.\n", stderr);
+            success = 0;
+            break;
+        }
+
+        if (!output_append(out, worker->chunks[slot], worker->lengths[slot])) {
+            showOutputError("Error writing output or allocating memory.\n");
+            success = 0;
+        }
+        memset_s(worker->chunks[slot], 0, worker->lengths[slot]);
+        if (!success) {
+            break;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        worker->ready[slot] = 0;
+        pthread_cond_broadcast(&job->changed);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->stop = 1;
+    pthread_cond_broadcast(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+
+    for (unsigned int w = 0; w < started; w++) {
+        pthread_join(workers[w].thread, NULL);
+        /* With a map, each worker only says how it went at the end. */
+        if (map != NULL && success && workers[w].failed[0]) {
+            fputs("Error getting random data or allocating memory.\n", stderr);
+            success = 0;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (unsigned int w = 0; w < jobs; w++) {
+        random_pool.bytes_read += workers[w].bytes_read;
+        random_pool.cpu_stats.rdseed_words += workers[w].cpu_stats.rdseed_words;
+        random_pool.cpu_stats.rdseed_retries += workers[w].cpu_stats.rdseed_retries;
+        random_pool.cpu_stats.rdseed_failures += workers[w].cpu_stats.rdseed_failures;
+        random_pool.cpu_stats.rdrand_words += workers[w].cpu_stats.rdrand_words;
+        random_pool.cpu_stats.rdrand_failures += workers[w].cpu_stats.rdrand_failures;
+        random_pool.producer_stats.ring_blocks = workers[w].producer_stats.ring_blocks;
+        random_pool.producer_stats.blocks_produced += workers[w].producer_stats.blocks_produced;
+        random_pool.producer_stats.blocks_taken += workers[w].producer_stats.blocks_taken;
+        random_pool.producer_stats.depth_total += workers[w].producer_stats.depth_total;
+        random_pool.producer_stats.reader_stalls += workers[w].producer_stats.reader_stalls;
+        random_pool.producer_stats.producer_stalls += workers[w].producer_stats.producer_stalls;
+        for (int slot = 0; slot < 2; slot++) {
+            if (workers[w].chunks[slot] != NULL) {
+                /* A chunk that was never written out still has passwords. */
+                memset_s(workers[w].chunks[slot], 0, (size_t)CHUNK_PASSWORDS * LINE_MAX_LENGTH);
+                free(workers[w].chunks[slot]);
+            }
+        }
+    }
+
+    if (job->numa && showStats) {
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        for (unsigned int n = 0; n < job->nodes.count; n++) {
+            unsigned int nodeWorkers = 0;
+            unsigned long passwords = 0;
+            for (unsigned int w = 0; w < jobs; w++) {
+                if (workers[w].node == n) {
+                    nodeWorkers++;
+                    passwords += workers[w].passwords;
+                }
+            }
+            fprintf(stderr, "Node %d: %u workers, %lu passwords, %.0f passwords/s\n",
+                    job->nodes.ids[n], nodeWorkers, passwords, seconds > 0 ? passwords / seconds : 0.0);
+        }
+    }
+
+    for (unsigned int n = 0; n < NUMA_NODES_MAX; n++) {
+        free(job->wordlists[n]);
+    }
+    pthread_cond_destroy(&job->changed);
+    pthread_mutex_destroy(&job->lock);
+    free(job);
+    free(workers);
+    return success;
 }
 
-uint32_t lookup_word(unsigned char *buf, uint32_t index)
+static void *passwordWorker(void *argument)
 {
-    uint32_t length = 0;
-    for (uint32_t i = 0; i < WORDLIST_MAX_LENGTH; i++) {
-        buf[i] = 0;
+    password_worker *worker = argument;
+    password_job *job = worker->job;
+    int chunkCount = (job->numberOfPasswords + CHUNK_PASSWORDS - 1) / CHUNK_PASSWORDS;
+    const unsigned char *wordlist = WORDLIST_TABLE;
+    /* The workers keep the CPUs busy already, so each one sweeps the
+     * wordlist by itself instead of starting threads of its own. */
+    const unsigned int sweepThreads = 1;
+    entropy_pool pool;
+
+    if (job->numa) {
+        /* Pin first, so everything we touch from here on is on our node. If
+         * it fails we're only slower, not wrong. */
+        numa_nodes_pin(&job->nodes, worker->node);
+
+        if (job->set == NULL) {
+            pthread_mutex_lock(&job->lock);
+            if (job->wordlists[worker->node] == NULL) {
+                job->wordlists[worker->node] = malloc(WORDLIST_TABLE_LENGTH);
+                if (job->wordlists[worker->node] != NULL) {
+                    memcpy(job->wordlists[worker->node], WORDLIST_TABLE, WORDLIST_TABLE_LENGTH);
+                }
+            }
+            if (job->wordlists[worker->node] != NULL) {
+                wordlist = job->wordlists[worker->node];
+            }
+            pthread_mutex_unlock(&job->lock);
+        }
     }
 
-    for (uint32_t i = 0; i < WORDLIST_WORD_COUNT; i++) {
-        uint32_t mask = ct_mask_u32(ct_eq_u32(i, index));
-        for (uint32_t j = 0; j < WORDLIST_MAX_LENGTH; j++) {
-            buf[j] |= words[i][j+1] & mask;
+    /* The pool's buffer is mapped on its first read (or when the producer
+     * starts), which is ours too. The producer inherits our pinning. */
+    entropy_pool_init(&pool, job->source);
+    pool.mix_cpu = job->mixCpu;
+    pool.stream = worker->index;
+    int started = !job->pipeline || entropy_pool_start_producer(&pool, PIPELINE_BLOCKS);
+
+    if (job->map != NULL) {
+        /* Our share of the records, straight into the file. No one else
+         * touches them, so there's nothing to wait for. */
+        int first = (int)((int64_t)chunkCount * worker->index / job->jobs);
+        int last = (int)((int64_t)chunkCount * (worker->index + 1) / job->jobs);
+        int ok = started;
+        for (int c = first; c < last && ok; c++) {
+            int count = job->numberOfPasswords - c * CHUNK_PASSWORDS;
+            size_t length = 0;
+            if (count > CHUNK_PASSWORDS) {
+                count = CHUNK_PASSWORDS;
+            }
+            ok = getPasswords(&pool, wordlist, sweepThreads, job->set, job->format, count,
+                              job->map + (size_t)c * CHUNK_PASSWORDS * RECORD_LENGTH(job->format), &length);
+            if (ok) {
+                worker->passwords += count;
+            }
         }
-        length |= words[i][0] & mask;
+        worker->failed[0] = !ok;
+        finishWorker(worker, &pool);
+        return NULL;
+    }
+
+    worker->chunks[0] = malloc((size_t)CHUNK_PASSWORDS * LINE_MAX_LENGTH);
+    worker->chunks[1] = malloc((size_t)CHUNK_PASSWORDS * LINE_MAX_LENGTH);
+    if (!started || worker->chunks[0] == NULL || worker->chunks[1] == NULL) {
+        /* Our first chunk is always in the first buffer. */
+        pthread_mutex_lock(&job->lock);
+        worker->failed[0] = 1;
+        worker->ready[0] = 1;
+        pthread_cond_broadcast(&job->changed);
+        pthread_mutex_unlock(&job->lock);
+        entropy_pool_deinit(&pool);
+        return NULL;
     }
 
-    return length;
+    for (int c = worker->index; c < chunkCount; c += job->jobs) {
+        int slot = (c / job->jobs) % 2;
+        int count = job->numberOfPasswords - c * CHUNK_PASSWORDS;
+        if (count > CHUNK_PASSWORDS) {
+            count = CHUNK_PASSWORDS;
+        }
+
+        /* Wait for the writer to finish with this buffer's last chunk. */
+        pthread_mutex_lock(&job->lock);
+        while (worker->ready[slot] && !job->stop) {
+            pthread_cond_wait(&job->changed, &job->lock);
+        }
+        int stop = job->stop;
+        pthread_mutex_unlock(&job->lock);
+        if (stop) {
+            break;
+        }
+
+        int ok = getPasswords(&pool, wordlist, sweepThreads, job->set, job->format, count, worker->chunks[slot],
+                              &worker->lengths[slot]);
+        if (ok) {
+            worker->passwords += count;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        worker->failed[slot] = !ok;
+        worker->ready[slot] = 1;
+        pthread_cond_broadcast(&job->changed);
+        pthread_mutex_unlock(&job->lock);
+        if (!ok) {
+            break;
+        }
+    }
+
+    finishWorker(worker, &pool);
+    return NULL;
+}
+
+/*
+ * Stops the worker's producer, copies its pool's statistics out for
+ * runJobs(), and wipes the pool.
+ */
+static void finishWorker(password_worker *worker, entropy_pool *pool)
+{
+    entropy_pool_stop_producer(pool);
+    worker->bytes_read = pool->bytes_read;
+    worker->cpu_stats = pool->cpu_stats;
+    worker->producer_stats = pool->producer_stats;
+    entropy_pool_deinit(pool);
+}
+
+/*
+ * Makes 'numberOfPasswords' passwords from 'set' right in the file 'fd' (see
+ * --mmap), after 'headerLength' bytes of 'header' (for --binary). Every one
+ * is RECORD_LENGTH(format) bytes, so where each goes is known up front: the
+ * file is sized to fit them all and mapped, and runJobs() gives each of
+ * 'jobs' workers its own range of records to fill. They share no lock
+ * and nothing is copied. Then the mapping is flushed with msync() and the
+ * file with fsync(). The workers' ranges are filled at the same time, so a
+ * failure would leave holes between them; instead, the file is emptied.
+ * Prints an error and returns 0 on failure.
+ */
+int writeMapped(int fd, const unsigned char *header, size_t headerLength, const char *set, int format,
+                int numberOfPasswords, unsigned int jobs, const entropy_source *source, int mixCpu, int numa,
+                int pipeline, int showStats)
+{
+    uint64_t size = headerLength + (uint64_t)numberOfPasswords * RECORD_LENGTH(format);
+    unsigned char *map = MAP_FAILED;
+    struct stat info;
+    int success = 1;
+
+    /* A pipe or a device can't be sized and mapped like this. */
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        fprintf(stderr, "ERROR: --mmap only works with regular files.\n");
+        return 0;
+    }
+
+    if ((size_t)size != size) {
+        fprintf(stderr, "Error writing %s: %s\n", outputPath, strerror(EFBIG));
+        success = 0;
+    }
+
+    /* The blocks have to be there before we write through the mapping. If
+     * the disk filled up then, we'd get SIGBUS instead of an error. */
+    if (success && fallocate(fd, 0, 0, (off_t)size) != 0) {
+        if (errno == EOPNOTSUPP && ftruncate(fd, (off_t)size) == 0) {
+            fprintf(stderr, "WARNING: Couldn't preallocate %s. Running out of space will crash.\n",
+                    outputPath);
+        } else {
+            fprintf(stderr, "Error writing %s: %s\n", outputPath, strerror(errno));
+            success = 0;
+        }
+    }
+
+    if (success) {
+        map = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "Error mapping %s: %s\n", outputPath, strerror(errno));
+            success = 0;
+        }
+    }
+
+    if (success) {
+#ifdef MADV_DONTDUMP
+        madvise(map, (size_t)size, MADV_DONTDUMP);
+#endif
+        memcpy(map, header, headerLength);
+        success = runJobs(NULL, map + headerLength, set, format, numberOfPasswords, jobs, source, mixCpu, numa,
+                          pipeline, showStats);
+        if (success && msync(map, (size_t)size, MS_SYNC) != 0) {
+            fprintf(stderr, "Error writing %s: %s\n", outputPath, strerror(errno));
+            success = 0;
+        }
+        munmap(map, (size_t)size);
+    }
+
+    if (success && fsync(fd) != 0) {
+        fprintf(stderr, "Error writing %s: %s\n", outputPath, strerror(errno));
+        success = 0;
+    }
+
+    if (!success && ftruncate(fd, 0) != 0) {
+        fprintf(stderr, "WARNING: Couldn't empty %s: %s\n", outputPath, strerror(errno));
+    }
+    return success;
+}
+
+int lookup_words(const unsigned char *wordlist, unsigned char *rows, const uint32_t *indices, uint32_t count,
+                 unsigned int threads)
+{
+    /* Both read the whole wordlist, whichever words we want. With SIMD the
+     * row-major sweep is faster; with only scalar code the bitsliced one is.
+     * `make benchmark` compares them. */
+#if defined(__x86_64__)
+    const ct_table table = { wordlist, WORDLIST_WORD_COUNT, WORDLIST_MAX_LENGTH + 1 };
+    /* Split between threads only if the list is big enough to be worth it. */
+    return ct_table_select_many_threaded(&table, indices, count, rows, threads);
+#else
+    const ct_bitsliced_table table = {
+        wordlist, WORDLIST_WORD_COUNT, WORDLIST_MAX_LENGTH + 1, WORDLIST_PLANE_LENGTH
+    };
+    return ct_bitslice_select_many(&table, indices, count, rows);
+#endif
 }
 
 unsigned long getLeastCoveringMask(unsigned long toRepresent)
@@ -367,27 +1334,22 @@ unsigned long getLeastCoveringMask(unsigned long toRepresent)
  * Fills 'buffer' with cryptographically secure random bytes.
  * buffer - gets filled with random bytes.
  * bufferlength - length of buffer
+ *
+ * The bytes come from 'random_pool', which reads /dev/urandom (or runs the
+ * generator chosen with --source) in large chunks instead of opening the
+ * device on every call.
  */
 int getRandom(void* buffer, unsigned long bufferlength)
 {
-    FILE* random;
-
-    random = fopen("/dev/urandom", "rb");
-    if(random == NULL) {
-        return 0;
-    }
-
-    size_t read = fread(buffer, sizeof(unsigned char), bufferlength, random);
-    if(read != bufferlength) {
-        fclose(random);
-        return 0;
-    }
-
-    if (fclose(random) != 0) {
-        return 0;
-    }
+    return getRandomFrom(&random_pool, buffer, bufferlength);
+}
 
-    return 1;
+/*
+ * Like getRandom(), but with bytes from 'pool' (e.g. a -j worker's own).
+ */
+int getRandomFrom(entropy_pool *pool, void* buffer, unsigned long bufferlength)
+{
+    return entropy_pool_read(pool, buffer, bufferlength);
 }
 
 int getRandomUnsignedLong(unsigned long *random)
@@ -441,7 +1403,7 @@ int runtimeTests(void)
 
     /* Test that the first and last character in the set can be selected. */
     unsigned char buffer2[128];
-    getPassword("AB", 2, buffer2, sizeof(buffer2));
+    getPassword(&random_pool, "AB", 2, buffer2, sizeof(buffer2));
     unsigned int a_count = 0, b_count = 0;
     for (size_t i = 0; i < sizeof(buffer2); i++) {
         if (buffer2[i] == 'A') { a_count++; }
@@ -452,6 +1414,29 @@ int runtimeTests(void)
         return 0;
     }
 
+    /* Without a set, the indices are left as they are (for --indices). */
+    getPassword(&random_pool, NULL, 3, buffer2, sizeof(buffer2));
+    unsigned int index_counts[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < sizeof(buffer2); i++) {
+        if (buffer2[i] > 2) { return 0; }
+        index_counts[buffer2[i]]++;
+    }
+    if (index_counts[0] == 0 || index_counts[1] == 0 || index_counts[2] == 0) {
+        return 0;
+    }
+
+    /* The binary format's header must read back as it was written. */
+    binary_format_header written, read;
+    unsigned char header[BINARY_FORMAT_MAX_HEADER];
+    if (!binary_format_init(&written, CHARSET_ASCII, PASSWORD_LENGTH, 0x123456789ULL, 1)) {
+        return 0;
+    }
+    size_t header_length = binary_format_write(&written, header);
+    if (header_length % BINARY_FORMAT_ALIGN != 0 || !binary_format_read(&read, header, header_length) ||
+        memcmp(&read, &written, sizeof(read)) != 0) {
+        return 0;
+    }
+
     /* Make sure memset_s zeroes the memory. */
     buffer2[0] = -1;
     buffer2[3] = -1;
@@ -497,5 +1482,303 @@ int runtimeTests(void)
     }
     ct_string_deinit(&str);
 
+    /* The same again in a fixed buffer, twice, with a reset in between, and
+     * make sure it won't go past the end of the buffer. */
+    unsigned char str_buffer[CT_STRING_BUFFER_LENGTH(17)];
+    ct_string_init_buffer(&str, str_buffer, 17);
+    for (int round = 0; round < 2; round++) {
+        ct_string_reset(&str);
+        if (!ct_string_concat(&str, (const unsigned char *)"ABCDEF", 6, 3) ||
+            !ct_string_concat(&str, (const unsigned char *)"GHIJKL", 6, round + 1) ||
+            !ct_string_concat(&str, (const unsigned char *)"12345", 5, 5) ||
+            ct_string_concat(&str, (const unsigned char *)".", 1, 1)) {
+            return 0;
+        }
+        ct_string_finalize(&str, str_result, 'Z');
+        if (memcmp(str_result, round == 0 ? "ABCG12345ZZZZZZZZ" : "ABCGH12345ZZZZZZZ", 17) != 0) {
+            return 0;
+        }
+    }
+    ct_string_deinit(&str);
+    if (!ct_string_init_capacity(&str, 6) || !ct_string_concat(&str, (const unsigned char *)"ABCDEF", 6, 6) ||
+        ct_string_concat(&str, (const unsigned char *)".", 1, 1)) {
+        return 0;
+    }
+    ct_string_deinit(&str);
+
+    /* The barrel shifter must build exactly the same string as trying every
+     * offset, with shifts past powers of 2, and so must every SIMD kernel,
+     * for both the concatenations and the padding. (tools/kernel_tests tries
+     * many random lengths.) */
+    const uint32_t str_lengths[][2] = { { 3, 2 }, { 17, 17 }, { 5, 1 }, { 33, 20 } };
+    unsigned char str_pieces[33];
+    unsigned char str_expected[3 + 17 + 5 + 33];
+    unsigned char str_fast[sizeof(str_expected)];
+    for (size_t i = 0; i < sizeof(str_pieces); i++) {
+        str_pieces[i] = (unsigned char)('!' + i);
+    }
+    ct_string str_reference;
+    ct_string_init(&str_reference);
+    for (size_t i = 0; i < sizeof(str_lengths) / sizeof(str_lengths[0]); i++) {
+        if (!ct_string_concat_reference(&str_reference, str_pieces, str_lengths[i][0], str_lengths[i][1])) {
+            return 0;
+        }
+    }
+    ct_string_finalize_with(ct_string_kernel_at(0), &str_reference, str_expected, '.');
+    ct_string_deinit(&str_reference);
+    const ct_string_kernel *str_kernel;
+    for (size_t k = 0; (str_kernel = ct_string_kernel_at(k)) != NULL; k++) {
+        if (!ct_string_kernel_supported(str_kernel)) {
+            continue;
+        }
+        ct_string_init(&str);
+        for (size_t i = 0; i < sizeof(str_lengths) / sizeof(str_lengths[0]); i++) {
+            if (!ct_string_concat_with(str_kernel, &str, str_pieces, str_lengths[i][0], str_lengths[i][1])) {
+                return 0;
+            }
+        }
+        if (ct_string_allocated_length(&str) != sizeof(str_expected)) {
+            return 0;
+        }
+        ct_string_finalize_with(str_kernel, &str, str_fast, '.');
+        if (memcmp(str_expected, str_fast, sizeof(str_expected)) != 0) {
+            return 0;
+        }
+        ct_string_deinit(&str);
+    }
+
+    /* Test ChaCha20 against the test vector in RFC 7539 section 2.3.2. */
+    const unsigned char chacha_key[32] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+    };
+    const unsigned char chacha_nonce[12] = {
+        0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x4a, 0x00, 0x00, 0x00, 0x00
+    };
+    const unsigned char chacha_expected[64] = {
+        0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+        0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+        0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+        0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e
+    };
+    unsigned char chacha_block[64];
+    chacha20_block(chacha_key, 1, chacha_nonce, chacha_block);
+    if (memcmp(chacha_block, chacha_expected, sizeof(chacha_expected)) != 0) {
+        return 0;
+    }
+
+    /* Test the fast-key-erasure generator against RFC 7539 appendix A.1,
+     * test vectors #1 and #2 (blocks 0 and 1 of the all-zero key and nonce).
+     * Seeded with zeros, the first 32 bytes of block 0 become the new key
+     * and the rest of block 0 and the start of block 1 are output. */
+    const unsigned char drbg_block0[64] = {
+        0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90, 0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+        0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a, 0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+        0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d, 0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+        0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c, 0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86
+    };
+    const unsigned char drbg_block1[64] = {
+        0x9f, 0x07, 0xe7, 0xbe, 0x55, 0x51, 0x38, 0x7a, 0x98, 0xba, 0x97, 0x7c, 0x73, 0x2d, 0x08, 0x0d,
+        0xcb, 0x0f, 0x29, 0xa0, 0x48, 0xe3, 0x65, 0x69, 0x12, 0xc6, 0x53, 0x3e, 0x32, 0xee, 0x7a, 0xed,
+        0x29, 0xb7, 0x21, 0x76, 0x9c, 0xe6, 0x4e, 0x43, 0xd5, 0x71, 0x33, 0xb0, 0x74, 0xd8, 0x39, 0xd5,
+        0x31, 0xed, 0x1f, 0x28, 0x51, 0x0a, 0xfb, 0x45, 0xac, 0xe1, 0x0a, 0x1f, 0x4b, 0x79, 0x4d, 0x6f
+    };
+    unsigned char drbg_seed[CHACHA_DRBG_SEED_LENGTH] = { 0 };
+    chacha_drbg drbg;
+    chacha_drbg_init(&drbg, drbg_seed);
+    chacha_drbg_generate(&drbg, chacha_block, 64);
+    if (memcmp(chacha_block, drbg_block0 + 32, 32) != 0 ||
+            memcmp(chacha_block + 32, drbg_block1, 32) != 0 ||
+            memcmp(drbg.key, drbg_block0, 32) != 0) {
+        return 0;
+    }
+
+    /* Reseeding XORs the seed into the key and then ratchets it like an
+     * empty output. Reseeding the all-zero key with zeros must ratchet it to
+     * the start of block 0, and so must reseeding that key with itself. */
+    chacha_drbg_init(&drbg, drbg_seed);
+    chacha_drbg_reseed(&drbg, drbg_seed);
+    if (memcmp(drbg.key, drbg_block0, 32) != 0) {
+        return 0;
+    }
+    memcpy(drbg_seed, drbg_block0, sizeof(drbg_seed));
+    chacha_drbg_reseed(&drbg, drbg_seed);
+    if (memcmp(drbg.key, drbg_block0, 32) != 0) {
+        return 0;
+    }
+    chacha_drbg_wipe(&drbg);
+
+    if (aes_ctr_drbg_supported()) {
+        /* Test AES-256 against the example in FIPS-197 Appendix C.3. */
+        const unsigned char aes_plaintext[16] = {
+            0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+        };
+        const unsigned char aes_expected[16] = {
+            0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89
+        };
+        unsigned char aes_block[16];
+        aes256_encrypt_block(chacha_key, aes_plaintext, aes_block);
+        if (memcmp(aes_block, aes_expected, sizeof(aes_expected)) != 0) {
+            return 0;
+        }
+
+        /* Test the CTR_DRBG against the NIST CAVP CTR_DRBG test vectors,
+         * [AES-256 no df], [PredictionResistance = False], COUNT = 0: no
+         * nonce, personalization string or additional input; instantiate,
+         * generate 64 bytes, and check the next 64. Then check the reseed:
+         * without a derivation function, instantiating is a reseed of an
+         * all-zero key and V, so a zeroed state reseeded with the same
+         * entropy must give the same output. */
+        const unsigned char ctr_drbg_entropy[AES_CTR_DRBG_SEED_LENGTH] = {
+            0xdf, 0x5d, 0x73, 0xfa, 0xa4, 0x68, 0x64, 0x9e, 0xdd, 0xa3, 0x3b, 0x5c, 0xca, 0x79, 0xb0, 0xb0,
+            0x56, 0x00, 0x41, 0x9c, 0xcb, 0x7a, 0x87, 0x9d, 0xdf, 0xec, 0x9d, 0xb3, 0x2e, 0xe4, 0x94, 0xe5,
+            0x53, 0x1b, 0x51, 0xde, 0x16, 0xa3, 0x0f, 0x76, 0x92, 0x62, 0x47, 0x4c, 0x73, 0xbe, 0xc0, 0x10
+        };
+        const unsigned char ctr_drbg_expected[64] = {
+            0xd1, 0xc0, 0x7c, 0xd9, 0x5a, 0xf8, 0xa7, 0xf1, 0x10, 0x12, 0xc8, 0x4c, 0xe4, 0x8b, 0xb8, 0xcb,
+            0x87, 0x18, 0x9e, 0x99, 0xd4, 0x0f, 0xcc, 0xb1, 0x77, 0x1c, 0x61, 0x9b, 0xdf, 0x82, 0xab, 0x22,
+            0x80, 0xb1, 0xdc, 0x2f, 0x25, 0x81, 0xf3, 0x91, 0x64, 0xf7, 0xac, 0x0c, 0x51, 0x04, 0x94, 0xb3,
+            0xa4, 0x3c, 0x41, 0xb7, 0xdb, 0x17, 0x51, 0x4c, 0x87, 0xb1, 0x07, 0xae, 0x79, 0x3e, 0x01, 0xc5
+        };
+        aes_ctr_drbg ctr_drbg;
+        aes_ctr_drbg_init(&ctr_drbg, ctr_drbg_entropy);
+        aes_ctr_drbg_generate(&ctr_drbg, chacha_block, 64);
+        aes_ctr_drbg_generate(&ctr_drbg, chacha_block, 64);
+        if (memcmp(chacha_block, ctr_drbg_expected, 64) != 0) {
+            return 0;
+        }
+        memset(ctr_drbg.key, 0, sizeof(ctr_drbg.key));
+        memset(ctr_drbg.v, 0, sizeof(ctr_drbg.v));
+        aes_ctr_drbg_reseed(&ctr_drbg, ctr_drbg_entropy);
+        aes_ctr_drbg_generate(&ctr_drbg, chacha_block, 64);
+        aes_ctr_drbg_generate(&ctr_drbg, chacha_block, 64);
+        if (memcmp(chacha_block, ctr_drbg_expected, 64) != 0) {
+            return 0;
+        }
+        aes_ctr_drbg_wipe(&ctr_drbg);
+    }
+
+    /* Test the batch sampler: hex digits come straight out of the bits, all
+     * ones gives all nines, and zero is rejected for digits (it's below
+     * 2^64 mod 10^18). */
+    radix_sampler sampler;
+    uint32_t symbols[RADIX_SAMPLER_MAX_BATCH];
+    if (!radix_sampler_init(&sampler, 16) || sampler.k != 16 || sampler.threshold != 0) {
+        return 0;
+    }
+    if (!radix_sampler_draw(&sampler, UINT64_C(0x0123456789ABCDEF), symbols)) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < 16; i++) {
+        if (symbols[i] != i) {
+            return 0;
+        }
+    }
+    if (!radix_sampler_init(&sampler, 10) || sampler.k != 18) {
+        return 0;
+    }
+    if (!radix_sampler_draw(&sampler, UINT64_MAX, symbols)) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < 18; i++) {
+        if (symbols[i] != 9) {
+            return 0;
+        }
+    }
+    if (radix_sampler_draw(&sampler, 0, symbols)) {
+        return 0;
+    }
+    if (!radix_sampler_init(&sampler, 1) || radix_sampler_init(&sampler, 0)) {
+        return 0;
+    }
+
+    /* Test every SIMD lookup kernel against invariant_time_lookup(), for 255
+     * different indices (many of them out of range) and table lengths around
+     * the vector and row sizes. */
+    const uint32_t lookup_lengths[] = { 1, 2, 15, 16, 17, 26, 31, 32, 33, 62, 94, 255, 256 };
+    unsigned char lookup_table[CT_LOOKUP_MAX_LENGTH];
+    unsigned char lookup_indices[CT_LOOKUP_MAX_LENGTH];
+    unsigned char lookup_out[CT_LOOKUP_MAX_LENGTH];
+    for (size_t i = 0; i < CT_LOOKUP_MAX_LENGTH; i++) {
+        lookup_table[i] = (unsigned char)(i * 167 + 13);
+        lookup_indices[i] = (unsigned char)(i * 89 + 7);
+    }
+    const ct_lookup_kernel *kernel;
+    for (size_t k = 0; (kernel = ct_lookup_kernel_at(k)) != NULL; k++) {
+        if (!ct_lookup_kernel_supported(kernel)) {
+            continue;
+        }
+        for (size_t l = 0; l < sizeof(lookup_lengths) / sizeof(lookup_lengths[0]); l++) {
+            /* An odd count, so the kernels' partial blocks are tested too. */
+            kernel->lookup(lookup_table, lookup_lengths[l], lookup_indices, lookup_out, 255);
+            for (size_t i = 0; i < 255; i++) {
+                if (lookup_out[i] != invariant_time_lookup(lookup_table, lookup_lengths[l], lookup_indices[i])) {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    /* Test every SIMD row-selection kernel against the scalar one, on a few
+     * rows with indices at both ends and past the end. (tools/kernel_tests
+     * tries many more.) */
+    const uint32_t small_indices[] = { 0, 4, 5 };
+    const ct_table small_table = { &words[0][0], 5, WORDLIST_MAX_LENGTH + 1 };
+    unsigned char table_expected[WORDLIST_MAX_LENGTH + 1];
+    unsigned char table_out[WORDLIST_MAX_LENGTH + 1];
+    unsigned char table_many[3][WORDLIST_MAX_LENGTH + 1];
+    const ct_table_kernel *table_kernel;
+    for (size_t k = 0; (table_kernel = ct_table_kernel_at(k)) != NULL; k++) {
+        if (!ct_table_kernel_supported(table_kernel) || !table_kernel->handles(WORDLIST_MAX_LENGTH + 1)) {
+            continue;
+        }
+        table_kernel->select_many(&small_table, small_indices, 3, &table_many[0][0]);
+        for (size_t i = 0; i < 3; i++) {
+            ct_table_kernel_at(0)->select(&small_table, small_indices[i], table_expected);
+            table_kernel->select(&small_table, small_indices[i], table_out);
+            if (memcmp(table_out, table_expected, sizeof(table_out)) != 0 ||
+                memcmp(table_many[i], table_expected, sizeof(table_out)) != 0) {
+                return 0;
+            }
+        }
+    }
+
+    /* And make sure lookup_words() really picks the right row. */
+    const uint32_t word_indices[2] = { WORDLIST_WORD_COUNT - 1, 7 };
+    if (!lookup_words(WORDLIST_TABLE, &table_many[0][0], word_indices, 2, 0)) {
+        return 0;
+    }
+    if (memcmp(table_many[0], words[WORDLIST_WORD_COUNT - 1], sizeof(table_many[0])) != 0 ||
+        memcmp(table_many[1], words[7], sizeof(table_many[1])) != 0) {
+        return 0;
+    }
+
+    /* Test SHA-256 against the one- and two-block examples in FIPS 180-4,
+     * feeding the second one in a byte at a time. */
+    const unsigned char sha256_expected1[SHA256_DIGEST_LENGTH] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    const unsigned char sha256_expected2[SHA256_DIGEST_LENGTH] = {
+        0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+        0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1
+    };
+    const char *sha256_message = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    sha256 hash;
+    sha256_init(&hash);
+    sha256_update(&hash, "abc", 3);
+    sha256_final(&hash, chacha_block);
+    if (memcmp(chacha_block, sha256_expected1, SHA256_DIGEST_LENGTH) != 0) {
+        return 0;
+    }
+    sha256_init(&hash);
+    for (size_t i = 0; i < strlen(sha256_message); i++) {
+        sha256_update(&hash, sha256_message + i, 1);
+    }
+    sha256_final(&hash, chacha_block);
+    if (memcmp(chacha_block, sha256_expected2, SHA256_DIGEST_LENGTH) != 0) {
+        return 0;
+    }
+
     return 1;
 }
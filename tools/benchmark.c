@@ -0,0 +1,710 @@
+/*
+ * Micro-benchmarks for passgen's building blocks.
+ *
+ * Build and run with `make benchmark`. Numbers from an unoptimized build are
+ * not very meaningful, so consider `EXTRA_GCC_FLAGS=-O2 make benchmark`.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+/* For syscall(), to open perf counters. */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+
+#include "../libs/entropy.h"
+#include "../libs/chacha_drbg.h"
+#include "../libs/aes_ctr_drbg.h"
+#include "../libs/vdso_getrandom.h"
+#include "../libs/memset_s.h"
+#include "../libs/cpu_random.h"
+#include "../libs/ct_lookup.h"
+#include "../libs/ct_table.h"
+#include "../libs/ct_bitslice.h"
+#include "../libs/ct_packed.h"
+#include "../libs/ct_string.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+/* How many bytes each benchmark asks for, and in what size of request. */
+#define ENTROPY_BENCH_BYTES (64ul * 1024 * 1024)
+#define ENTROPY_BENCH_REQUEST 64
+
+/* Raw generator benchmarks run this many ENTROPY_POOL_SIZE requests. */
+#define GENERATOR_BENCH_REQUESTS 4096
+
+/* Latency benchmarks time this many single-password (64-byte) requests. */
+#define LATENCY_BENCH_CALLS 20000
+
+/* Reseed benchmarks time this many reseeds, with this many threads loading
+ * the kernel generator or the CPU's RDSEED. */
+#define RESEED_BENCH_CALLS 5000
+#define RESEED_BENCH_LOAD_THREADS 4
+
+/* Lookup benchmarks map this many 64-character passwords. */
+#define LOOKUP_BENCH_PASSWORDS 20000
+
+/* Table benchmarks select this many rows from a wordlist-sized table. */
+#define TABLE_BENCH_SELECTS 2000
+#define TABLE_BENCH_ROWS 7236
+/* TABLE_BENCH_ROWS bits, rounded up to a multiple of CT_BITSLICE_PLANE_ALIGNMENT bytes. */
+#define BITSLICE_BENCH_PLANE_LENGTH 960
+/* TABLE_BENCH_ROWS rounded up to a multiple of CT_PACKED_GROUP_ROWS. */
+#define PACKED_BENCH_ROWS 7264
+
+/* String benchmarks build this many 10-word passphrases of up to 15-letter
+ * words. */
+#define STRING_BENCH_PASSPHRASES 20000
+#define STRING_BENCH_WORDS 10
+#define STRING_BENCH_WORD_LENGTH 15
+
+/* Threaded table benchmarks sweep tables of up to this many rows. */
+#define THREADED_BENCH_MAX_ROWS (1u << 20)
+
+enum reseed_load { LOAD_NONE, LOAD_GETRANDOM, LOAD_RDSEED };
+
+static double now(void);
+static unsigned long long cycles(void);
+static void benchmarkEntropySource(const entropy_source *source);
+static void benchmarkGenerator(const char *name, int useAes);
+static int fopenRead(unsigned char *out, size_t length);
+static void benchmarkLatency(void);
+static void benchmarkFirstRead(const entropy_source *source);
+static void benchmarkLookup(const ct_lookup_kernel *kernel, uint32_t length);
+static void benchmarkTable(const ct_table_kernel *kernel);
+static void benchmarkBitslice(const ct_bitslice_kernel *kernel);
+static void benchmarkPacked(const ct_packed_kernel *kernel);
+static int openCacheCounter(uint32_t type, uint64_t config);
+static void benchmarkCacheMisses(int packed);
+static void benchmarkThreaded(uint32_t rowCount, unsigned int threads);
+static void benchmarkString(const ct_string_kernel *kernel);
+static void *loadThread(void *argument);
+static void benchmarkReseed(int mixCpu, enum reseed_load load);
+
+static int stopLoad;
+
+int main(void)
+{
+    const entropy_source *source;
+
+    puts("Entropy sources (64-byte requests, like one password):");
+    for (size_t i = 0; (source = entropy_source_at(i)) != NULL; i++) {
+        if (entropy_source_supported(source)) {
+            benchmarkEntropySource(source);
+        }
+    }
+
+    puts("Generators (32 KiB requests, no pool):");
+    benchmarkGenerator("chacha20", 0);
+    if (aes_ctr_drbg_supported()) {
+        benchmarkGenerator("aes-ctr", 1);
+    } else {
+        puts("  aes-ctr    not supported by this CPU");
+    }
+
+    puts("Latency of one 64-byte request:");
+    benchmarkLatency();
+
+    puts("Latency of the first request from a fresh pool (one password per process):");
+    for (size_t i = 0; (source = entropy_source_at(i)) != NULL; i++) {
+        if (entropy_source_supported(source)) {
+            benchmarkFirstRead(source);
+        }
+    }
+
+    puts("Constant-time lookup of one 64-character password:");
+    const ct_lookup_kernel *kernel;
+    for (size_t i = 0; (kernel = ct_lookup_kernel_at(i)) != NULL; i++) {
+        if (ct_lookup_kernel_supported(kernel)) {
+            benchmarkLookup(kernel, 16);
+            benchmarkLookup(kernel, 94);
+        } else {
+            printf("  %-10s not supported by this CPU\n", kernel->name);
+        }
+    }
+
+    printf("Constant-time selection of one row from %d 16-byte rows:\n", TABLE_BENCH_ROWS);
+    const ct_table_kernel *tableKernel;
+    for (size_t i = 0; (tableKernel = ct_table_kernel_at(i)) != NULL; i++) {
+        if (ct_table_kernel_supported(tableKernel)) {
+            benchmarkTable(tableKernel);
+        } else {
+            printf("  %-10s not supported by this CPU\n", tableKernel->name);
+        }
+    }
+
+    printf("Constant-time selection of one row from %d bitsliced 16-byte rows:\n", TABLE_BENCH_ROWS);
+    const ct_bitslice_kernel *bitsliceKernel;
+    for (size_t i = 0; (bitsliceKernel = ct_bitslice_kernel_at(i)) != NULL; i++) {
+        if (ct_bitslice_kernel_supported(bitsliceKernel)) {
+            benchmarkBitslice(bitsliceKernel);
+        } else {
+            printf("  %-10s not supported by this CPU\n", bitsliceKernel->name);
+        }
+    }
+
+    printf("Constant-time selection of one row from %d packed 10-byte rows:\n", PACKED_BENCH_ROWS);
+    const ct_packed_kernel *packedKernel;
+    for (size_t i = 0; (packedKernel = ct_packed_kernel_at(i)) != NULL; i++) {
+        if (ct_packed_kernel_supported(packedKernel)) {
+            benchmarkPacked(packedKernel);
+        } else {
+            printf("  %-10s not supported by this CPU\n", packedKernel->name);
+        }
+    }
+
+    puts("Cache misses per row selected (fastest kernel, 16 per sweep):");
+    benchmarkCacheMisses(0);
+    benchmarkCacheMisses(1);
+
+    puts("Constant-time concatenation and padding of one 10-word passphrase:");
+    const ct_string_kernel *stringKernel;
+    for (size_t i = 0; (stringKernel = ct_string_kernel_at(i)) != NULL; i++) {
+        if (ct_string_kernel_supported(stringKernel)) {
+            benchmarkString(stringKernel);
+        } else {
+            printf("  %-10s not supported by this CPU\n", stringKernel->name);
+        }
+    }
+
+    puts("Constant-time selection from big 16-byte-row tables, split between threads (16 per sweep):");
+    const uint32_t threadedRowCounts[] = { TABLE_BENCH_ROWS, 1u << 16, 1u << 18, THREADED_BENCH_MAX_ROWS };
+    for (size_t i = 0; i < sizeof(threadedRowCounts) / sizeof(threadedRowCounts[0]); i++) {
+        for (unsigned int threads = 1; threads <= 8; threads *= 2) {
+            benchmarkThreaded(threadedRowCounts[i], threads);
+        }
+    }
+
+    printf("Latency of one chacha20 reseed (%d threads of load):\n", RESEED_BENCH_LOAD_THREADS);
+    for (int mixCpu = 0; mixCpu <= 1; mixCpu++) {
+        if (mixCpu && !cpu_random_has_rdseed() && !cpu_random_has_rdrand()) {
+            puts("  --mix-cpu              not supported by this CPU");
+            break;
+        }
+        benchmarkReseed(mixCpu, LOAD_NONE);
+        benchmarkReseed(mixCpu, LOAD_GETRANDOM);
+        if (cpu_random_has_rdseed()) {
+            benchmarkReseed(mixCpu, LOAD_RDSEED);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long cycles(void)
+{
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void benchmarkEntropySource(const entropy_source *source)
+{
+    unsigned char request[ENTROPY_BENCH_REQUEST];
+    entropy_pool pool;
+    entropy_pool_init(&pool, source);
+
+    double start = now();
+    for (unsigned long done = 0; done < ENTROPY_BENCH_BYTES; done += sizeof(request)) {
+        if (!entropy_pool_read(&pool, request, sizeof(request))) {
+            printf("  %-10s FAILED\n", source->name);
+            entropy_pool_deinit(&pool);
+            return;
+        }
+    }
+    double elapsed = now() - start;
+
+    printf("  %-10s %8.1f MiB/s\n", source->name,
+           ENTROPY_BENCH_BYTES / elapsed / (1024 * 1024));
+
+    memset_s(request, 0, sizeof(request));
+    entropy_pool_deinit(&pool);
+}
+
+static void benchmarkGenerator(const char *name, int useAes)
+{
+    static unsigned char out[ENTROPY_POOL_SIZE];
+    unsigned char seed[AES_CTR_DRBG_SEED_LENGTH] = { 0 };
+    chacha_drbg chacha;
+    aes_ctr_drbg aes;
+
+    if (!useAes) {
+        chacha_drbg_init(&chacha, seed);
+    } else {
+        aes_ctr_drbg_init(&aes, seed);
+    }
+
+    double start = now();
+    unsigned long long start_cycles = cycles();
+    for (int i = 0; i < GENERATOR_BENCH_REQUESTS; i++) {
+        if (!useAes) {
+            chacha_drbg_generate(&chacha, out, sizeof(out));
+        } else {
+            aes_ctr_drbg_generate(&aes, out, sizeof(out));
+        }
+    }
+    unsigned long long elapsed_cycles = cycles() - start_cycles;
+    double elapsed = now() - start;
+
+    double bytes = (double)GENERATOR_BENCH_REQUESTS * sizeof(out);
+    printf("  %-10s %8.1f MiB/s", name, bytes / elapsed / (1024 * 1024));
+    if (elapsed_cycles > 0) {
+        printf("  %6.3f bytes/cycle", bytes / elapsed_cycles);
+    }
+    printf("\n");
+
+    memset_s(out, 0, sizeof(out));
+    if (!useAes) {
+        chacha_drbg_wipe(&chacha);
+    } else {
+        aes_ctr_drbg_wipe(&aes);
+    }
+}
+
+/* What getRandom() used to do on every call. */
+static int fopenRead(unsigned char *out, size_t length)
+{
+    FILE *random = fopen("/dev/urandom", "rb");
+    if (random == NULL) {
+        return 0;
+    }
+    size_t read = fread(out, 1, length, random);
+    fclose(random);
+    return read == length;
+}
+
+static void benchmarkLatency(void)
+{
+    unsigned char request[ENTROPY_BENCH_REQUEST];
+    vdso_getrandom vdso;
+    double start, elapsed;
+
+    start = now();
+    for (int i = 0; i < LATENCY_BENCH_CALLS; i++) {
+        if (!fopenRead(request, sizeof(request))) {
+            puts("  fopen/fread    FAILED");
+            return;
+        }
+    }
+    elapsed = now() - start;
+    printf("  %-22s %8.0f ns\n", "fopen/fread/fclose", elapsed / LATENCY_BENCH_CALLS * 1e9);
+
+    start = now();
+    for (int i = 0; i < LATENCY_BENCH_CALLS; i++) {
+        if (getrandom(request, sizeof(request), 0) != sizeof(request)) {
+            puts("  getrandom(2)   FAILED");
+            return;
+        }
+    }
+    elapsed = now() - start;
+    printf("  %-22s %8.0f ns\n", "getrandom(2)", elapsed / LATENCY_BENCH_CALLS * 1e9);
+
+    if (vdso_getrandom_init(&vdso)) {
+        start = now();
+        for (int i = 0; i < LATENCY_BENCH_CALLS; i++) {
+            if (!vdso_getrandom_fill(&vdso, request, sizeof(request))) {
+                puts("  vDSO getrandom FAILED");
+                return;
+            }
+        }
+        elapsed = now() - start;
+        printf("  %-22s %8.0f ns\n", "vDSO getrandom", elapsed / LATENCY_BENCH_CALLS * 1e9);
+        vdso_getrandom_deinit(&vdso);
+    } else {
+        printf("  %-22s not available on this kernel\n", "vDSO getrandom");
+    }
+
+    memset_s(request, 0, sizeof(request));
+}
+
+static void benchmarkFirstRead(const entropy_source *source)
+{
+    unsigned char request[ENTROPY_BENCH_REQUEST];
+    entropy_pool pool;
+    const int rounds = 200;
+    double total = 0;
+
+    for (int i = 0; i < rounds; i++) {
+        entropy_pool_init(&pool, source);
+        double start = now();
+        int ok = entropy_pool_read(&pool, request, sizeof(request));
+        total += now() - start;
+        if (!ok) {
+            printf("  %-22s FAILED\n", source->name);
+            entropy_pool_deinit(&pool);
+            return;
+        }
+        if (i == rounds - 1) {
+            printf("  %-22s %8.0f ns\n", entropy_pool_description(&pool), total / rounds * 1e9);
+        }
+        entropy_pool_deinit(&pool);
+    }
+
+    memset_s(request, 0, sizeof(request));
+}
+
+static void benchmarkLookup(const ct_lookup_kernel *kernel, uint32_t length)
+{
+    unsigned char table[CT_LOOKUP_MAX_LENGTH];
+    unsigned char indices[64];
+    unsigned char out[64];
+    unsigned int check = 0;
+
+    for (size_t i = 0; i < sizeof(table); i++) {
+        table[i] = (unsigned char)i;
+    }
+    for (size_t i = 0; i < sizeof(indices); i++) {
+        indices[i] = (unsigned char)(i * 7 % length);
+    }
+
+    double start = now();
+    unsigned long long start_cycles = cycles();
+    for (int i = 0; i < LOOKUP_BENCH_PASSWORDS; i++) {
+        kernel->lookup(table, length, indices, out, sizeof(out));
+        check += out[i % sizeof(out)];
+    }
+    unsigned long long elapsed_cycles = cycles() - start_cycles;
+    double elapsed = now() - start;
+
+    printf("  %-10s %3u entries %8.0f ns", kernel->name, length, elapsed / LOOKUP_BENCH_PASSWORDS * 1e9);
+    if (elapsed_cycles > 0) {
+        printf("  %8.1f cycles/char", (double)elapsed_cycles / LOOKUP_BENCH_PASSWORDS / sizeof(out));
+    }
+    /* Printing the check value keeps the compiler from dropping the loop. */
+    printf("  (check %u)\n", check % 10);
+}
+
+static void benchmarkTable(const ct_table_kernel *kernel)
+{
+    static unsigned char rows[TABLE_BENCH_ROWS * CT_TABLE_VECTOR_ROW_LENGTH];
+    ct_table table = { rows, TABLE_BENCH_ROWS, CT_TABLE_VECTOR_ROW_LENGTH };
+    unsigned char out[CT_TABLE_VECTOR_ROW_LENGTH];
+    unsigned int check = 0;
+
+    for (size_t i = 0; i < sizeof(rows); i++) {
+        rows[i] = (unsigned char)(i * 31);
+    }
+
+    double start = now();
+    unsigned long long start_cycles = cycles();
+    for (uint32_t i = 0; i < TABLE_BENCH_SELECTS; i++) {
+        kernel->select(&table, i * 7 % TABLE_BENCH_ROWS, out);
+        check += out[i % sizeof(out)];
+    }
+    unsigned long long elapsed_cycles = cycles() - start_cycles;
+    double elapsed = now() - start;
+
+    printf("  %-10s one at a time %8.0f ns/word", kernel->name, elapsed / TABLE_BENCH_SELECTS * 1e9);
+    if (elapsed_cycles > 0) {
+        printf("  %6.2f cycles/row", (double)elapsed_cycles / TABLE_BENCH_SELECTS / TABLE_BENCH_ROWS);
+    }
+    printf("  (check %u)\n", check % 10);
+
+    uint32_t indices[CT_TABLE_BATCH];
+    unsigned char many[CT_TABLE_BATCH * CT_TABLE_VECTOR_ROW_LENGTH];
+    start = now();
+    for (uint32_t i = 0; i < TABLE_BENCH_SELECTS; i += CT_TABLE_BATCH) {
+        for (uint32_t k = 0; k < CT_TABLE_BATCH; k++) {
+            indices[k] = (i + k) * 7 % TABLE_BENCH_ROWS;
+        }
+        kernel->select_many(&table, indices, CT_TABLE_BATCH, many);
+        check += many[i % sizeof(many)];
+    }
+    elapsed = now() - start;
+    printf("  %-10s %2d per sweep  %8.0f ns/word  (check %u)\n", kernel->name, CT_TABLE_BATCH,
+           elapsed / TABLE_BENCH_SELECTS * 1e9, check % 10);
+}
+
+static void benchmarkBitslice(const ct_bitslice_kernel *kernel)
+{
+    static unsigned char planes[CT_TABLE_VECTOR_ROW_LENGTH * 8 * BITSLICE_BENCH_PLANE_LENGTH];
+    ct_bitsliced_table table = { planes, TABLE_BENCH_ROWS, CT_TABLE_VECTOR_ROW_LENGTH, BITSLICE_BENCH_PLANE_LENGTH };
+    uint32_t indices[CT_BITSLICE_BATCH];
+    unsigned char many[CT_BITSLICE_BATCH * CT_TABLE_VECTOR_ROW_LENGTH];
+    unsigned int check = 0;
+
+    /* The same rows as benchmarkTable(), transposed. */
+    memset(planes, 0, sizeof(planes));
+    for (uint32_t r = 0; r < TABLE_BENCH_ROWS; r++) {
+        for (uint32_t c = 0; c < CT_TABLE_VECTOR_ROW_LENGTH; c++) {
+            unsigned char byte = (unsigned char)((r * CT_TABLE_VECTOR_ROW_LENGTH + c) * 31);
+            for (uint32_t b = 0; b < 8; b++) {
+                planes[(c * 8 + b) * BITSLICE_BENCH_PLANE_LENGTH + r / 8] |= ((byte >> b) & 1) << (r % 8);
+            }
+        }
+    }
+
+    for (uint32_t count = 1; count <= CT_BITSLICE_BATCH; count += CT_BITSLICE_BATCH - 1) {
+        double start = now();
+        for (uint32_t i = 0; i < TABLE_BENCH_SELECTS; i += count) {
+            for (uint32_t k = 0; k < count; k++) {
+                indices[k] = (i + k) * 7 % TABLE_BENCH_ROWS;
+            }
+            if (!ct_bitslice_select_many_with(kernel, &table, indices, count, many)) {
+                printf("  %-10s FAILED\n", kernel->name);
+                return;
+            }
+            check += many[i % sizeof(many)];
+        }
+        double elapsed = now() - start;
+        printf("  %-10s %2u per sweep  %8.0f ns/word  (check %u)\n", kernel->name, count,
+               elapsed / TABLE_BENCH_SELECTS * 1e9, check % 10);
+    }
+}
+
+static void benchmarkPacked(const ct_packed_kernel *kernel)
+{
+    static unsigned char rows[PACKED_BENCH_ROWS * CT_PACKED_ROW_LENGTH];
+    ct_packed_table table = { rows, PACKED_BENCH_ROWS };
+    uint32_t indices[CT_PACKED_BATCH];
+    unsigned char many[CT_PACKED_BATCH * CT_PACKED_ROW_LENGTH];
+    unsigned int check = 0;
+
+    for (size_t i = 0; i < sizeof(rows); i++) {
+        rows[i] = (unsigned char)(i * 31);
+    }
+
+    for (uint32_t count = 1; count <= CT_PACKED_BATCH; count += CT_PACKED_BATCH - 1) {
+        double start = now();
+        for (uint32_t i = 0; i < TABLE_BENCH_SELECTS; i += count) {
+            for (uint32_t k = 0; k < count; k++) {
+                indices[k] = (i + k) * 7 % TABLE_BENCH_ROWS;
+            }
+            kernel->select_many(&table, indices, count, many);
+            check += many[i % sizeof(many)];
+        }
+        double elapsed = now() - start;
+        printf("  %-10s %2u per sweep  %8.0f ns/word  (check %u)\n", kernel->name, count,
+               elapsed / TABLE_BENCH_SELECTS * 1e9, check % 10);
+    }
+}
+
+/* Returns a disabled perf counter for this thread, or -1 if there isn't one. */
+static int openCacheCounter(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Counts L1D read misses and last-level misses per row, row-major or packed. */
+static void benchmarkCacheMisses(int packed)
+{
+    static unsigned char rows[PACKED_BENCH_ROWS * CT_TABLE_VECTOR_ROW_LENGTH];
+    ct_table table = { rows, TABLE_BENCH_ROWS, CT_TABLE_VECTOR_ROW_LENGTH };
+    ct_packed_table packedTable = { rows, PACKED_BENCH_ROWS };
+    uint32_t indices[CT_TABLE_BATCH];
+    unsigned char many[CT_TABLE_BATCH * CT_TABLE_VECTOR_ROW_LENGTH];
+    const char *name = packed ? "packed" : "row-major";
+    int counters[2];
+    long long misses[2] = { 0, 0 };
+
+    for (size_t i = 0; i < sizeof(rows); i++) {
+        rows[i] = (unsigned char)(i * 31);
+    }
+
+    counters[0] = openCacheCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                   (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counters[1] = openCacheCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    for (int c = 0; c < 2; c++) {
+        if (counters[c] >= 0) {
+            ioctl(counters[c], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters[c], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    double start = now();
+    for (uint32_t i = 0; i < TABLE_BENCH_SELECTS; i += CT_TABLE_BATCH) {
+        for (uint32_t k = 0; k < CT_TABLE_BATCH; k++) {
+            indices[k] = (i + k) * 7 % TABLE_BENCH_ROWS;
+        }
+        if (packed) {
+            ct_packed_select_many(&packedTable, indices, CT_TABLE_BATCH, many);
+        } else {
+            ct_table_select_many(&table, indices, CT_TABLE_BATCH, many);
+        }
+    }
+    double elapsed = now() - start;
+
+    for (int c = 0; c < 2; c++) {
+        if (counters[c] >= 0) {
+            ioctl(counters[c], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counters[c], &misses[c], sizeof(misses[c])) != sizeof(misses[c])) {
+                misses[c] = -1;
+            }
+            close(counters[c]);
+        }
+    }
+
+    printf("  %-10s %8.0f ns/word", name, elapsed / TABLE_BENCH_SELECTS * 1e9);
+    if (counters[0] >= 0 && misses[0] >= 0) {
+        printf("  %8.1f L1D misses/word", (double)misses[0] / TABLE_BENCH_SELECTS);
+    } else {
+        printf("  L1D misses not available");
+    }
+    if (counters[1] >= 0 && misses[1] >= 0) {
+        printf("  %6.2f LLC misses/word\n", (double)misses[1] / TABLE_BENCH_SELECTS);
+    } else {
+        printf("  LLC misses not available\n");
+    }
+}
+
+static void benchmarkThreaded(uint32_t rowCount, unsigned int threads)
+{
+    static unsigned char rows[(size_t)THREADED_BENCH_MAX_ROWS * CT_TABLE_VECTOR_ROW_LENGTH];
+    ct_table table = { rows, rowCount, CT_TABLE_VECTOR_ROW_LENGTH };
+    uint32_t indices[CT_TABLE_BATCH];
+    unsigned char many[CT_TABLE_BATCH * CT_TABLE_VECTOR_ROW_LENGTH];
+    unsigned int check = 0;
+    /* Fewer sweeps of the bigger tables, for about the same total work. */
+    uint32_t sweeps = 1 + (uint32_t)(64ull * TABLE_BENCH_ROWS / rowCount);
+
+    for (size_t i = 0; i < sizeof(rows); i++) {
+        rows[i] = (unsigned char)(i * 31);
+    }
+
+    double start = now();
+    for (uint32_t s = 0; s < sweeps; s++) {
+        for (uint32_t k = 0; k < CT_TABLE_BATCH; k++) {
+            indices[k] = (s * CT_TABLE_BATCH + k) * 7919 % rowCount;
+        }
+        if (!ct_table_select_many_threaded(&table, indices, CT_TABLE_BATCH, many, threads)) {
+            printf("  %7u rows  %u threads  FAILED\n", rowCount, threads);
+            return;
+        }
+        check += many[s % sizeof(many)];
+    }
+    double elapsed = now() - start;
+
+    printf("  %7u rows  %u threads  %10.0f ns/word  %6.3f ns/row  (check %u)\n", rowCount, threads,
+           elapsed / sweeps / CT_TABLE_BATCH * 1e9, elapsed / sweeps / CT_TABLE_BATCH / rowCount * 1e9,
+           check % 10);
+}
+
+static void benchmarkString(const ct_string_kernel *kernel)
+{
+    const uint32_t capacity = STRING_BENCH_WORDS * STRING_BENCH_WORD_LENGTH + STRING_BENCH_WORDS - 1;
+    unsigned char buffer[CT_STRING_BUFFER_LENGTH(STRING_BENCH_WORDS * STRING_BENCH_WORD_LENGTH + STRING_BENCH_WORDS - 1)];
+    unsigned char final[sizeof(buffer) / 2];
+    const unsigned char word[STRING_BENCH_WORD_LENGTH] = "abcdefghijklmno";
+    unsigned int check = 0;
+    ct_string str;
+
+    ct_string_init_buffer(&str, buffer, capacity);
+    double start = now();
+    for (int p = 0; p < STRING_BENCH_PASSPHRASES; p++) {
+        ct_string_reset(&str);
+        for (int w = 0; w < STRING_BENCH_WORDS; w++) {
+            if (w > 0) {
+                ct_string_concat_with(kernel, &str, (const unsigned char *)".", 1, 1);
+            }
+            ct_string_concat_with(kernel, &str, word, sizeof(word), 3 + (p + w) % 13);
+        }
+        ct_string_finalize_with(kernel, &str, final, '.');
+        check += final[p % sizeof(final)];
+    }
+    double elapsed = now() - start;
+    ct_string_deinit(&str);
+
+    printf("  %-10s %8.0f ns/passphrase  (check %u)\n", kernel->name,
+           elapsed / STRING_BENCH_PASSPHRASES * 1e9, check % 10);
+}
+
+/* Keeps the kernel generator or RDSEED busy until stopLoad is set. */
+static void *loadThread(void *argument)
+{
+    enum reseed_load load = *(enum reseed_load *)argument;
+    unsigned char buffer[256];
+    cpu_random_stats stats;
+
+    memset(&stats, 0, sizeof(stats));
+    while (!__atomic_load_n(&stopLoad, __ATOMIC_RELAXED)) {
+        if (load == LOAD_GETRANDOM) {
+            entropy_kernel_bytes(buffer, sizeof(buffer));
+        } else {
+            cpu_random_fill(buffer, sizeof(buffer), &stats);
+        }
+    }
+    memset_s(buffer, 0, sizeof(buffer));
+    return NULL;
+}
+
+static void benchmarkReseed(int mixCpu, enum reseed_load load)
+{
+    static const char *const loadNames[] = { "idle", "getrandom load", "RDSEED load" };
+    pthread_t threads[RESEED_BENCH_LOAD_THREADS];
+    int started = 0;
+    entropy_pool pool;
+    char label[64];
+
+    entropy_pool_init(&pool, &entropy_source_chacha20);
+    pool.mix_cpu = mixCpu;
+    /* Open the pool first so only reseeds are timed. */
+    if (!entropy_pool_reseed(&pool)) {
+        puts("  reseed FAILED");
+        entropy_pool_deinit(&pool);
+        return;
+    }
+    memset(&pool.cpu_stats, 0, sizeof(pool.cpu_stats));
+
+    __atomic_store_n(&stopLoad, 0, __ATOMIC_RELAXED);
+    if (load != LOAD_NONE) {
+        for (; started < RESEED_BENCH_LOAD_THREADS; started++) {
+            if (pthread_create(&threads[started], NULL, loadThread, &load) != 0) {
+                break;
+            }
+        }
+    }
+
+    int ok = 1;
+    double start = now();
+    for (int i = 0; i < RESEED_BENCH_CALLS && ok; i++) {
+        ok = entropy_pool_reseed(&pool);
+    }
+    double elapsed = now() - start;
+
+    __atomic_store_n(&stopLoad, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    snprintf(label, sizeof(label), "%s, %s", mixCpu ? "mixed" : "kernel", loadNames[load]);
+    if (!ok) {
+        printf("  %-28s FAILED\n", label);
+    } else {
+        printf("  %-28s %8.0f ns", label, elapsed / RESEED_BENCH_CALLS * 1e9);
+        if (mixCpu) {
+            printf("  %.2f RDSEED retries, %.3f RDRAND fallbacks per reseed",
+                   (double)pool.cpu_stats.rdseed_retries / RESEED_BENCH_CALLS,
+                   (double)pool.cpu_stats.rdseed_failures / RESEED_BENCH_CALLS);
+        }
+        printf("\n");
+    }
+    entropy_pool_deinit(&pool);
+}
@@ -0,0 +1,40 @@
+# Times making a file of passwords and then reading all of it back, checking
+# every one, with tools/read_passwords, for text (one per line) and for
+# --binary and --indices records. Text has to be split into lines; binary
+# records are checked in place.
+#
+# Usage: ruby tools/benchmark_binary.rb [scale]
+#   scale multiplies the number of passwords generated (default 1).
+
+require 'tmpdir'
+require_relative 'benchmark_common'
+
+MODES = {
+  "hex"   => 2_000_000,
+  "ascii" => 1_000_000,
+}
+
+FORMATS = { "text" => "", "binary" => "--binary", "indices" => "--indices" }
+
+Dir.mktmpdir do |dir|
+  file = File.join(dir, "passwords")
+  table = BenchmarkTable.new(16, 14, ["generate", "ingest", "total", "size"])
+
+  MODES.each do |mode, count|
+    count = scaled(count)
+    FORMATS.each do |name, flags|
+      generate = time_command(passgen("--#{mode} -s drbg -p #{count} #{flags} -o #{file} 2>/dev/null"))
+      ingest = generate && time_command("tools/read_passwords #{file} 2>/dev/null")
+      if generate.nil? || ingest.nil? || ingest[1] !~ /^#{count} passwords .*: OK$/
+        table.row("#{mode} #{name}", [nil])
+        next
+      end
+      table.row("#{mode} #{name}", [
+        per_second(count, generate[0]), per_second(count, ingest[0]),
+        per_second(count, generate[0] + ingest[0]), "%.1f MB" % (File.size(file) / 1e6)
+      ])
+    end
+  end
+end
+
+puts "(passwords per second)"
@@ -0,0 +1,51 @@
+# What the tools/benchmark_*.rb scripts share: they time runs of the passgen
+# binary and print a table of the results. Each one only says what to run.
+
+# The first argument multiplies the number of passwords generated (default 1).
+SCALE = (ARGV[0] || 1).to_f
+
+# 'count' times SCALE, but at least 1.
+def scaled(count)
+  [(count * SCALE).to_i, 1].max
+end
+
+# The shell command that runs passgen with 'args'. -z skips the self-tests
+# (so they aren't timed) and allows the test source.
+def passgen(args)
+  "./passgen -z #{args}"
+end
+
+# Runs 'command' in a shell, and returns how long it took in seconds and its
+# output, or nil if it failed.
+def time_command(command)
+  start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  output = `#{command}`
+  elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+  return nil unless $?.exitstatus == 0
+  [elapsed, output]
+end
+
+# Passwords per second, for 'count' passwords in 'elapsed' seconds, or nil if
+# there's no time (because the run failed).
+def per_second(count, elapsed)
+  elapsed && "%.0f/s" % (count / elapsed)
+end
+
+# Prints a table one row at a time, with each cell right-aligned in 'width'
+# characters after a 'label_width' label.
+class BenchmarkTable
+  def initialize(label_width, width, headers)
+    @label_width = label_width
+    @width = width
+    printf("%-*s", @label_width, "")
+    headers.each { |header| printf("%*s", @width, header) }
+    puts ""
+  end
+
+  # Prints a row of 'cells', with "n/a" for any that are nil.
+  def row(label, cells)
+    printf("%-*s", @label_width, label)
+    cells.each { |cell| printf("%*s", @width, cell || "n/a") }
+    puts ""
+  end
+end
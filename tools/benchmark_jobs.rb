@@ -0,0 +1,37 @@
+# Times bulk generation with 1 to 64 worker threads (-j) by running the
+# passgen binary, to see how well it scales with the number of cores, with
+# and without pinning the workers to NUMA nodes (--numa).
+#
+# Usage: ruby tools/benchmark_jobs.rb [scale]
+#   scale multiplies the number of passwords generated (default 1).
+
+require_relative 'benchmark_common'
+
+MODES = {
+  "ascii" => 1_000_000,
+  "words" => 20_000,
+}
+
+SOURCES = ["urandom", "drbg"]
+
+JOBS = [1, 2, 4, 8, 16, 32, 64]
+
+PLACEMENTS = { "" => "", " numa" => "--numa" }
+
+nodes = Dir.glob("/sys/devices/system/node/node[0-9]*").count
+puts "#{`nproc`.strip} CPUs online, #{[nodes, 1].max} NUMA node(s)"
+table = BenchmarkTable.new(21, 12, JOBS.map { |jobs| "-j #{jobs}" })
+
+MODES.each do |mode, count|
+  count = scaled(count)
+  SOURCES.each do |source|
+    PLACEMENTS.each do |name, placement|
+      table.row("#{mode} #{source}#{name}", JOBS.map do |jobs|
+        run = time_command(passgen("--#{mode} -s #{source} -p #{count} -j #{jobs} #{placement} 2>/dev/null"))
+        per_second(count, run && run[1].lines.count == count && run[0])
+      end)
+    end
+  end
+end
+
+puts "(passwords per second)"
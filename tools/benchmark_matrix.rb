@@ -0,0 +1,36 @@
+# Times every password type against every entropy source by running the
+# passgen binary, so the numbers include everything a real run does.
+#
+# Usage: ruby tools/benchmark_matrix.rb [scale]
+#   scale multiplies the number of passwords generated (default 1).
+
+require_relative 'benchmark_common'
+
+MODES = {
+  "hex"   => 100_000,
+  "alpha" => 100_000,
+  "ascii" => 100_000,
+  "digit" => 100_000,
+  "lower" => 100_000,
+  # Word passwords scan the whole wordlist for every word, so they're slow.
+  "words" => 200,
+}
+
+SOURCES = ["urandom", "getrandom", "chacha20", "aes-ctr", "test"]
+
+# Each mode is timed as it is, and with a producer thread fetching the random
+# bytes ahead of time.
+VARIANTS = { "" => "", " +P" => "--pipeline" }
+
+table = BenchmarkTable.new(11, 14, SOURCES)
+MODES.each do |mode, count|
+  count = scaled(count)
+  VARIANTS.each do |name, flags|
+    table.row(mode + name, SOURCES.map do |source|
+      run = time_command(passgen("--#{mode} -s #{source} -p #{count} #{flags} 2>/dev/null"))
+      per_second(count, run && run[1].lines.count == count && run[0])
+    end)
+  end
+end
+
+puts "(passwords per second)"
@@ -0,0 +1,44 @@
+# Times writing a file of passwords three ways: one stream to stdout
+# redirected to the file (the writer gets every chunk in order), --output
+# (the same stream, written with io_uring), and --mmap (the -j workers fill
+# their own records of a mapping of the file, with no writer at all). Every
+# run ends with the file on disk: --mmap does its own msync() and fsync(),
+# and the others are followed by a sync of the file so it's fair.
+#
+# Usage: ruby tools/benchmark_mmap.rb [scale]
+#   scale multiplies the number of passwords generated (default 1).
+
+require 'tmpdir'
+require_relative 'benchmark_common'
+
+MODES = {
+  "hex"   => 2_000_000,
+  "ascii" => 1_000_000,
+}
+
+JOBS = [1, 2, 4, 8]
+
+SINKS = {
+  "stdout" => ->(file) { "> #{file}" },
+  "output" => ->(file) { "-o #{file}" },
+  "mmap"   => ->(file) { "-M -o #{file}" },
+}
+
+Dir.mktmpdir do |dir|
+  file = File.join(dir, "passwords")
+  puts "#{`nproc`.strip} CPUs online"
+  table = BenchmarkTable.new(14, 12, JOBS.map { |jobs| "-j #{jobs}" })
+
+  MODES.each do |mode, count|
+    count = scaled(count)
+    SINKS.each do |name, sink|
+      table.row("#{mode} #{name}", JOBS.map do |jobs|
+        run = time_command(passgen("--#{mode} -s drbg -p #{count} -j #{jobs} #{sink.call(file)} 2>/dev/null") +
+                           " && sync #{file}")
+        per_second(count, run && File.size(file) == count * 65 && run[0])
+      end)
+    end
+  end
+end
+
+puts "(passwords per second, including getting them to the disk)"
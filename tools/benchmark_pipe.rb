@@ -0,0 +1,28 @@
+# Times streaming passwords through a pipe into `cat >/dev/null`, with the
+# output spliced into the pipe (the default) and copied with write(2)
+# (--no-vmsplice).
+#
+# Usage: ruby tools/benchmark_pipe.rb [scale]
+#   scale multiplies the number of passwords generated (default 1).
+
+require_relative 'benchmark_common'
+
+MODES = {
+  "hex"   => 2_000_000,
+  "ascii" => 2_000_000,
+  "words" => 20_000,
+}
+
+VARIANTS = { "vmsplice" => "", "write" => "--no-vmsplice" }
+
+table = BenchmarkTable.new(8, 16, VARIANTS.keys)
+MODES.each do |mode, count|
+  count = scaled(count)
+  table.row(mode, VARIANTS.values.map do |flags|
+    # The test source is the cheapest, so the output side shows the most.
+    run = time_command(passgen("--#{mode} -s test -p #{count} #{flags} | cat >/dev/null"))
+    run && "%.1f MB/s" % (count * (mode == "words" ? 80 : 65) / run[0] / 1e6)
+  end)
+end
+
+puts "(approximate output throughput into the pipe)"
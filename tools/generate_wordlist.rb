@@ -16,6 +16,18 @@ print <<-eos
  * Each item in this array represents one word in the wordlist. The first byte
  * of each entry is the length of the word, followed by the word characters,
  * followed by padding with 'Z' to make all entries equal length.
+ *
+ * The same entries are also stored bitsliced: bit b of byte c of word i is bit
+ * i of plane c*8+b. Bit i of a plane is bit i%8 of its byte i/8, and each plane
+ * is padded with zeros to a multiple of 64 bytes. passgen only sweeps this copy
+ * where it doesn't use the row-major SIMD one, so it's left out on x86-64
+ * unless WORDLIST_BITSLICED is defined.
+ *
+ * And packed: 4 bits of length, then 5 bits per letter ('a' is 0), least
+ * significant bit first, with the letters past the end of the word zero. The
+ * packed array is padded with all-zero entries to a multiple of 32. passgen
+ * doesn't read it, so it's only here if WORDLIST_PACKED is defined, and only
+ * if every word is at most 15 letters a-z.
  */
 
 eos
@@ -28,6 +40,18 @@ File.open(WORDLIST, 'r') do |wl|
   puts "#define WORDLIST_MAX_LENGTH #{max_word_length}"
   puts ""
 
+  # Each plane has one bit per word, padded to a multiple of 64 bytes.
+  plane_length = (lines.count + 511) / 512 * 64
+  puts "#define WORDLIST_PLANE_LENGTH #{plane_length}"
+  puts ""
+
+  # Packed entries are 4 + 5 * 15 = 79 bits, in 10 bytes, so they only fit
+  # words of at most 15 letters a-z. Nothing passgen needs depends on it.
+  packable = max_word_length <= 15 && lines.all? { |l| l =~ /\A[a-z]*\z/ }
+  packed_rows = (lines.count + 31) / 32 * 32
+
+  entries = []
+
   # Start the big wordlist array.
   puts "const unsigned char words[WORDLIST_WORD_COUNT][WORDLIST_MAX_LENGTH+1] = {"
 
@@ -39,7 +63,8 @@ File.open(WORDLIST, 'r') do |wl|
     end
 
     # Start the word array with a byte for the length (without padding).
-    print "    { %3d," % [line.length]
+    length = line.length
+    print "    { %3d," % [length]
 
     # Pad the word with 'Z' until it's as long as the longest word.
     line = line.ljust(max_word_length, "Z")
@@ -58,10 +83,57 @@ File.open(WORDLIST, 'r') do |wl|
 
     # Close the word array.
     puts "},"
+
+    entries << [length] + bytes
   end
 
   # End the big wordlist array.
   puts "};"
+  puts ""
+
+  # The bitsliced copy, one plane per bit of each byte of the entries.
+  puts "#if !defined(__x86_64__) || defined(WORDLIST_BITSLICED)"
+  puts "const unsigned char words_bitsliced[(WORDLIST_MAX_LENGTH+1)*8][WORDLIST_PLANE_LENGTH] = {"
+  (max_word_length + 1).times do |c|
+    8.times do |b|
+      plane = Array.new(plane_length, 0)
+      entries.each_with_index do |entry, i|
+        plane[i / 8] |= 1 << (i % 8) if (entry[c] >> b) & 1 == 1
+      end
+      puts "    {"
+      plane.each_slice(16) do |slice|
+        puts "        " + slice.map { |x| "%3d," % [x] }.join(" ")
+      end
+      puts "    },"
+    end
+  end
+  puts "};"
+  puts "#endif"
+  puts ""
+
+  # The packed copy, if the words fit. Without WORDLIST_PACKED_ROWS, the
+  # tools that use it skip it.
+  puts "#ifdef WORDLIST_PACKED"
+  if packable
+    puts "#define WORDLIST_PACKED_ROWS #{packed_rows}"
+    puts "#define WORDLIST_PACKED_LENGTH 10"
+    puts "const unsigned char words_packed[WORDLIST_PACKED_ROWS][WORDLIST_PACKED_LENGTH] = {"
+    packed_rows.times do |i|
+      bits = 0
+      if i < entries.count
+        length = entries[i][0]
+        bits = length
+        entries[i][1, length].each_with_index do |c, j|
+          bits |= (c - 'a'.ord) << (4 + 5 * j)
+        end
+      end
+      puts "    {" + (0...10).map { |b| "%3d," % [(bits >> (8 * b)) & 0xFF] }.join(" ") + " },"
+    end
+    puts "};"
+  else
+    puts "/* Some words are longer than 15 letters or not all a-z. */"
+  end
+  puts "#endif"
 end
 
 puts ""
@@ -0,0 +1,333 @@
+/*
+ * Checks every SIMD kernel this CPU supports against the scalar one.
+ *
+ * passgen's runtime self-tests only try each kernel on a few rows, since they
+ * run every time it does. These go over the whole wordlist, with many more
+ * indices and lengths. Run them with `make test`.
+ *
+ * Usage: tools/kernel_tests [SEED]
+ *
+ * The string tests use random lengths from SEED, which is 1 if it's left out.
+ * A failure prints the seed, so it can be run again with the same lengths.
+ *
+ * Exits with 0 if everything matched, 1 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* passgen only needs the bitsliced wordlist where it has no SIMD sweep, and
+ * never reads the packed one, but we test them both everywhere. */
+#define WORDLIST_BITSLICED
+#define WORDLIST_PACKED
+
+#include "../libs/wordlist.h"
+#include "../libs/ct_table.h"
+#include "../libs/ct_bitslice.h"
+#include "../libs/ct_packed.h"
+#include "../libs/ct_string.h"
+
+/* Indices into the wordlist: at both ends, past the end, and around the
+ * shorter tables testTableKernels() makes of it. */
+static const uint32_t wordlist_indices[] = {
+    0, 1, 2, 3, 4, 5, 1000, 7232, 7233, 7234, 7235, 7236, 7237, UINT32_MAX
+};
+#define WORDLIST_INDEX_COUNT (sizeof(wordlist_indices) / sizeof(wordlist_indices[0]))
+
+/* String tests build this many strings, the nth from n pieces of up to
+ * STRING_TEST_MAX_PIECE bytes. */
+#define STRING_TEST_ROUNDS 50
+#define STRING_TEST_MAX_PIECE 64
+
+static int testTableKernels(void);
+static int testThreaded(void);
+static int testBitslice(void);
+#ifdef WORDLIST_PACKED_ROWS
+static int testPacked(void);
+#endif
+static int testStringKernels(uint32_t seed);
+static int testStringKernel(const ct_string_kernel *kernel, uint32_t seed);
+static int report(const char *name, int passed);
+static int parseSeed(const char *arg, uint32_t *seed);
+
+int main(int argc, char *argv[])
+{
+    uint32_t seed = 1;
+    int passed = 1;
+
+    if (argc > 2 || (argc == 2 && !parseSeed(argv[1], &seed))) {
+        fprintf(stderr, "Usage: %s [SEED]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    passed &= report("Table kernels", testTableKernels());
+    passed &= report("Threaded sweep", testThreaded());
+    passed &= report("Bitsliced wordlist", testBitslice());
+#ifdef WORDLIST_PACKED_ROWS
+    passed &= report("Packed wordlist", testPacked());
+#else
+    /* The words don't fit the packed encoding (see generate_wordlist.rb). */
+    printf("Packed wordlist: skipped\n");
+#endif
+    passed &= report("String kernels", testStringKernels(seed));
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Tests every SIMD row-selection kernel against the scalar one, on the
+ * wordlist and on shorter tables that leave rows over at the end, with indices
+ * at both ends and past the end. Returns 1 if they all agree.
+ */
+static int testTableKernels(void)
+{
+    const uint32_t row_counts[] = { 1, 2, 3, 5, 7233, 7234, 7235, WORDLIST_WORD_COUNT };
+    const uint32_t *indices = wordlist_indices;
+    const size_t index_count = WORDLIST_INDEX_COUNT;
+    unsigned char expected[WORDLIST_MAX_LENGTH + 1];
+    unsigned char out[WORDLIST_MAX_LENGTH + 1];
+    unsigned char many[WORDLIST_INDEX_COUNT][WORDLIST_MAX_LENGTH + 1];
+    const ct_table_kernel *kernel;
+    int passed = 1;
+
+    for (size_t k = 0; (kernel = ct_table_kernel_at(k)) != NULL; k++) {
+        if (!ct_table_kernel_supported(kernel) || !kernel->handles(WORDLIST_MAX_LENGTH + 1)) {
+            continue;
+        }
+        for (size_t r = 0; r < sizeof(row_counts) / sizeof(row_counts[0]); r++) {
+            ct_table table = { &words[0][0], row_counts[r], WORDLIST_MAX_LENGTH + 1 };
+            /* The batched version does them all in one sweep. */
+            kernel->select_many(&table, indices, index_count, &many[0][0]);
+            for (size_t i = 0; i < index_count; i++) {
+                ct_table_kernel_at(0)->select(&table, indices[i], expected);
+                kernel->select(&table, indices[i], out);
+                if (memcmp(out, expected, sizeof(out)) != 0 || memcmp(many[i], expected, sizeof(out)) != 0) {
+                    fprintf(stderr, "%s: row %u of %u is wrong.\n", kernel->name, indices[i], row_counts[r]);
+                    passed = 0;
+                }
+            }
+        }
+    }
+    return passed;
+}
+
+/*
+ * Tests that splitting a big table between threads gives the same rows, with
+ * indices in every slice and at the slice boundaries. Returns 1 if they match.
+ */
+static int testThreaded(void)
+{
+    /* Enough rows for 4 threads; any more would be clamped to 4. */
+    const uint32_t row_count = 4 * CT_TABLE_ROWS_PER_THREAD + 3;
+    const uint32_t indices[] = {
+        0, 1, CT_TABLE_ROWS_PER_THREAD, CT_TABLE_ROWS_PER_THREAD + 1, 2 * CT_TABLE_ROWS_PER_THREAD + 2,
+        3 * CT_TABLE_ROWS_PER_THREAD + 2, 4 * CT_TABLE_ROWS_PER_THREAD + 2, 4 * CT_TABLE_ROWS_PER_THREAD + 3,
+        UINT32_MAX
+    };
+    const size_t index_count = sizeof(indices) / sizeof(indices[0]);
+    unsigned char expected[sizeof(indices) / sizeof(indices[0])][CT_TABLE_VECTOR_ROW_LENGTH];
+    unsigned char out[sizeof(indices) / sizeof(indices[0])][CT_TABLE_VECTOR_ROW_LENGTH];
+    int passed = 1;
+
+    unsigned char *rows = malloc((size_t)row_count * CT_TABLE_VECTOR_ROW_LENGTH);
+    if (rows == NULL) {
+        fprintf(stderr, "Couldn't allocate the table.\n");
+        return 0;
+    }
+    for (size_t i = 0; i < (size_t)row_count * CT_TABLE_VECTOR_ROW_LENGTH; i++) {
+        rows[i] = (unsigned char)(i * 167 + i / 4099);
+    }
+
+    ct_table table = { rows, row_count, CT_TABLE_VECTOR_ROW_LENGTH };
+    ct_table_select_many(&table, indices, index_count, &expected[0][0]);
+    for (unsigned int threads = 2; threads <= 4; threads++) {
+        if (!ct_table_select_many_threaded(&table, indices, index_count, &out[0][0], threads)) {
+            fprintf(stderr, "Couldn't start %u threads.\n", threads);
+            passed = 0;
+        } else if (memcmp(out, expected, sizeof(out)) != 0) {
+            fprintf(stderr, "%u threads selected the wrong rows.\n", threads);
+            passed = 0;
+        }
+    }
+
+    free(rows);
+    return passed;
+}
+
+/*
+ * Tests that every bitslice kernel selects the same rows from the bitsliced
+ * copy of the wordlist as the scalar kernel does from the row-major one.
+ * Returns 1 if they all agree.
+ */
+static int testBitslice(void)
+{
+    const ct_table table = { &words[0][0], WORDLIST_WORD_COUNT, WORDLIST_MAX_LENGTH + 1 };
+    const ct_bitsliced_table bitsliced = {
+        &words_bitsliced[0][0], WORDLIST_WORD_COUNT, WORDLIST_MAX_LENGTH + 1, WORDLIST_PLANE_LENGTH
+    };
+    unsigned char expected[WORDLIST_MAX_LENGTH + 1];
+    unsigned char many[WORDLIST_INDEX_COUNT][WORDLIST_MAX_LENGTH + 1];
+    const ct_bitslice_kernel *kernel;
+    int passed = 1;
+
+    for (size_t k = 0; (kernel = ct_bitslice_kernel_at(k)) != NULL; k++) {
+        if (!ct_bitslice_kernel_supported(kernel)) {
+            continue;
+        }
+        if (!ct_bitslice_select_many_with(kernel, &bitsliced, wordlist_indices, WORDLIST_INDEX_COUNT,
+                                          &many[0][0])) {
+            fprintf(stderr, "%s: couldn't select the rows.\n", kernel->name);
+            passed = 0;
+            continue;
+        }
+        for (size_t i = 0; i < WORDLIST_INDEX_COUNT; i++) {
+            ct_table_kernel_at(0)->select(&table, wordlist_indices[i], expected);
+            if (memcmp(many[i], expected, sizeof(expected)) != 0) {
+                fprintf(stderr, "%s: row %u is wrong.\n", kernel->name, wordlist_indices[i]);
+                passed = 0;
+            }
+        }
+    }
+    return passed;
+}
+
+#ifdef WORDLIST_PACKED_ROWS
+/*
+ * Tests that every packed word unpacks to the same entry, and that every
+ * packed kernel selects the same rows as the scalar one. Returns 1 if they
+ * all agree.
+ */
+static int testPacked(void)
+{
+    const ct_packed_table table = { &words_packed[0][0], WORDLIST_PACKED_ROWS };
+    const unsigned char zero[CT_PACKED_ROW_LENGTH] = { 0 };
+    unsigned char expected[CT_PACKED_ROW_LENGTH];
+    unsigned char many[WORDLIST_INDEX_COUNT][CT_PACKED_ROW_LENGTH];
+    unsigned char out[WORDLIST_MAX_LENGTH + 1];
+    const ct_packed_kernel *kernel;
+    int passed = 1;
+
+    for (uint32_t i = 0; i < WORDLIST_WORD_COUNT; i++) {
+        ct_packed_unpack(words_packed[i], WORDLIST_MAX_LENGTH, out);
+        if (memcmp(out, words[i], sizeof(out)) != 0) {
+            fprintf(stderr, "Word %u doesn't unpack to itself.\n", i);
+            passed = 0;
+        }
+    }
+
+    for (size_t k = 0; (kernel = ct_packed_kernel_at(k)) != NULL; k++) {
+        if (!ct_packed_kernel_supported(kernel)) {
+            continue;
+        }
+        kernel->select_many(&table, wordlist_indices, WORDLIST_INDEX_COUNT, &many[0][0]);
+        for (size_t i = 0; i < WORDLIST_INDEX_COUNT; i++) {
+            ct_packed_kernel_at(0)->select_many(&table, &wordlist_indices[i], 1, expected);
+            int same = memcmp(many[i], expected, sizeof(expected)) == 0;
+            /* Past the end of the list there's only padding, or nothing. */
+            if (wordlist_indices[i] < WORDLIST_WORD_COUNT) {
+                ct_packed_unpack(many[i], WORDLIST_MAX_LENGTH, out);
+                same &= memcmp(out, words[wordlist_indices[i]], sizeof(out)) == 0;
+            } else {
+                same &= memcmp(many[i], zero, sizeof(zero)) == 0;
+            }
+            if (!same) {
+                fprintf(stderr, "%s: row %u is wrong.\n", kernel->name, wordlist_indices[i]);
+                passed = 0;
+            }
+        }
+    }
+    return passed;
+}
+#endif
+
+/*
+ * Tests the barrel shifter and every SIMD string kernel with
+ * testStringKernel(). Returns 1 if they all pass.
+ */
+static int testStringKernels(uint32_t seed)
+{
+    const ct_string_kernel *kernel;
+    int passed = 1;
+
+    for (size_t k = 0; (kernel = ct_string_kernel_at(k)) != NULL; k++) {
+        if (ct_string_kernel_supported(kernel)) {
+            passed &= testStringKernel(kernel, seed);
+        }
+    }
+    return passed;
+}
+
+/*
+ * Tests that 'kernel' builds the same strings as ct_string_concat_reference(),
+ * which tries every offset, and pads them the same as the scalar kernel, with
+ * random lengths from 'seed'. Returns 1 if they all match.
+ */
+static int testStringKernel(const ct_string_kernel *kernel, uint32_t seed)
+{
+    unsigned char pieces[STRING_TEST_MAX_PIECE];
+    unsigned char expected[STRING_TEST_ROUNDS * STRING_TEST_MAX_PIECE];
+    unsigned char out[sizeof(expected)];
+    uint32_t state = seed;
+    int passed = 1;
+
+    for (size_t i = 0; i < sizeof(pieces); i++) {
+        pieces[i] = (unsigned char)('!' + i);
+    }
+
+    for (int round = 0; round < STRING_TEST_ROUNDS && passed; round++) {
+        ct_string str;
+        ct_string reference;
+        ct_string_init(&str);
+        ct_string_init(&reference);
+        for (int piece = 0; piece < 1 + round && passed; piece++) {
+            state = state * 1103515245 + 12345;
+            uint32_t max_length = 1 + (state >> 16) % STRING_TEST_MAX_PIECE;
+            uint32_t actual_length = 1 + (state >> 8) % max_length;
+            if (!ct_string_concat_with(kernel, &str, pieces, max_length, actual_length) ||
+                !ct_string_concat_reference(&reference, pieces, max_length, actual_length)) {
+                fprintf(stderr, "%s: out of memory.\n", kernel->name);
+                passed = 0;
+            }
+        }
+        if (passed) {
+            uint32_t length = ct_string_allocated_length(&reference);
+            ct_string_finalize_with(ct_string_kernel_at(0), &reference, expected, '.');
+            ct_string_finalize_with(kernel, &str, out, '.');
+            if (ct_string_allocated_length(&str) != length || memcmp(expected, out, length) != 0) {
+                fprintf(stderr, "%s: string %d from seed %u is wrong.\n", kernel->name, round, seed);
+                passed = 0;
+            }
+        }
+        ct_string_deinit(&str);
+        ct_string_deinit(&reference);
+    }
+    return passed;
+}
+
+/*
+ * Prints whether the test called 'name' passed, and returns 'passed'.
+ */
+static int report(const char *name, int passed)
+{
+    printf("%s: %s\n", name, passed ? "OK" : "FAILED");
+    return passed;
+}
+
+/*
+ * Parses a seed (0 to 4294967295). Returns 1 on success, 0 if it isn't one.
+ */
+static int parseSeed(const char *arg, uint32_t *seed)
+{
+    char *end;
+
+    if (arg[0] < '0' || arg[0] > '9') {
+        return 0;
+    }
+    unsigned long long value = strtoull(arg, &end, 10);
+    if (*end != '\0' || value > UINT32_MAX) {
+        return 0;
+    }
+    *seed = (uint32_t)value;
+    return 1;
+}
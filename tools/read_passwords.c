@@ -0,0 +1,197 @@
+/*
+ * Reads a file of passwords from passgen the way a program ingesting them
+ * would, checks every one, and prints what it found.
+ *
+ * Usage: tools/read_passwords FILE [N...]
+ *
+ * FILE can be passgen's text output (one password per line) or --binary or
+ * --indices output (see libs/binary_format.c). Text lines must be printable
+ * ASCII and all the same length. Binary records must only hold characters
+ * from the header's set (or indices into it), and there must be exactly as
+ * many as the header says. Each N prints the Nth password (from 0): a binary
+ * file is indexed directly, a text file has to be scanned for it.
+ *
+ * Exits with 0 if the file is fine, 1 otherwise.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../libs/binary_format.h"
+
+static int read_binary(const unsigned char *data, size_t size, int argc, char *argv[]);
+static int read_text(const unsigned char *data, size_t size, int argc, char *argv[]);
+static int parse_index(const char *arg, unsigned long long *index);
+
+int main(int argc, char *argv[])
+{
+    struct stat info;
+    void *map = NULL;
+    const unsigned char *data = NULL;
+    int ok;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s FILE [N...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    size_t size = (size_t)info.st_size;
+    if (size > 0) {
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror(argv[1]);
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        data = map;
+        posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+    }
+
+    if (size >= BINARY_FORMAT_MAGIC_LENGTH && memcmp(data, BINARY_FORMAT_MAGIC, BINARY_FORMAT_MAGIC_LENGTH) == 0) {
+        ok = read_binary(data, size, argc - 2, argv + 2);
+    } else {
+        ok = read_text(data, size, argc - 2, argv + 2);
+    }
+
+    if (size > 0) {
+        munmap(map, size);
+    }
+    close(fd);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Checks a binary file and prints the passwords asked for. Returns 1 if it's
+ * fine, 0 otherwise.
+ */
+static int read_binary(const unsigned char *data, size_t size, int argc, char *argv[])
+{
+    binary_format_header header;
+    unsigned char allowed[256];
+    int indices;
+
+    if (!binary_format_read(&header, data, size)) {
+        fprintf(stderr, "Bad header.\n");
+        return 0;
+    }
+    indices = (header.flags & BINARY_FORMAT_INDICES) != 0;
+
+    unsigned long long records = (size - header.header_length) / header.record_length;
+    if ((size - header.header_length) % header.record_length != 0 || records != header.count) {
+        fprintf(stderr, "Holds %llu of %llu records. It was cut short or has extra bytes.\n",
+                records, (unsigned long long)header.count);
+        return 0;
+    }
+
+    memset(allowed, 0, sizeof(allowed));
+    for (uint32_t i = 0; i < header.charset_length; i++) {
+        allowed[indices ? i : header.charset[i]] = 1;
+    }
+
+    /* One pass over every byte of every record, in place. */
+    const unsigned char *record = data + header.header_length;
+    const unsigned char *end = data + size;
+    unsigned char bad = 0;
+    for (const unsigned char *p = record; p < end; p++) {
+        bad |= (unsigned char)!allowed[*p];
+    }
+    if (bad) {
+        fprintf(stderr, "A record holds a symbol that isn't in the character set.\n");
+        return 0;
+    }
+
+    for (int a = 0; a < argc; a++) {
+        unsigned long long index;
+        if (!parse_index(argv[a], &index) || index >= records) {
+            fprintf(stderr, "There's no password %s.\n", argv[a]);
+            return 0;
+        }
+        const unsigned char *password = record + index * header.record_length;
+        for (uint32_t i = 0; i < header.record_length; i++) {
+            putchar(indices ? header.charset[password[i]] : password[i]);
+        }
+        putchar('\n');
+    }
+
+    printf("%llu passwords of %u %s from a set of %u: OK\n", records, header.record_length,
+           indices ? "indices" : "characters", header.charset_length);
+    return 1;
+}
+
+/*
+ * Checks a text file and prints the passwords asked for. Returns 1 if it's
+ * fine, 0 otherwise.
+ */
+static int read_text(const unsigned char *data, size_t size, int argc, char *argv[])
+{
+    unsigned long long lines = 0;
+    size_t length = 0;
+    size_t start = 0;
+
+    if (size == 0 || data[size - 1] != '\n') {
+        fprintf(stderr, "The last line doesn't end with a newline.\n");
+        return 0;
+    }
+
+    /* Find every line, as a program reading them one by one would. */
+    while (start < size) {
+        const unsigned char *newline = memchr(data + start, '\n', size - start);
+        size_t line = (size_t)(newline - (data + start));
+        if (lines == 0) {
+            length = line;
+        }
+        if (line == 0 || line != length) {
+            fprintf(stderr, "Line %llu is %zu characters long, not %zu.\n", lines + 1, line, length);
+            return 0;
+        }
+        for (size_t i = 0; i < line; i++) {
+            if (data[start + i] < ' ' || data[start + i] > '~') {
+                fprintf(stderr, "Line %llu has a character that isn't printable ASCII.\n", lines + 1);
+                return 0;
+            }
+        }
+        start += line + 1;
+        lines++;
+    }
+
+    for (int a = 0; a < argc; a++) {
+        unsigned long long index;
+        if (!parse_index(argv[a], &index) || index >= lines) {
+            fprintf(stderr, "There's no password %s.\n", argv[a]);
+            return 0;
+        }
+        /* Every line has been checked to be the same length. */
+        start = (size_t)index * (length + 1);
+        fwrite(data + start, 1, length + 1, stdout);
+    }
+
+    printf("%llu passwords of %zu characters: OK\n", lines, length);
+    return 1;
+}
+
+/*
+ * Parses a password number. Returns 1 on success, 0 if it isn't one.
+ */
+static int parse_index(const char *arg, unsigned long long *index)
+{
+    char *end;
+
+    if (arg[0] < '0' || arg[0] > '9') {
+        return 0;
+    }
+    *index = strtoull(arg, &end, 10);
+    return *end == '\0';
+}
@@ -1,3 +1,6 @@
+require 'digest'
+require 'tmpdir'
+
 
 class String
   def is_broken
@@ -19,6 +22,10 @@ CHARSETS = [
 
 puts "This will take a few minutes..."
 
+# Test every SIMD kernel against the scalar one.
+output = `tools/kernel_tests 2>&1`
+"Kernel Tests".is_broken unless $?.exitstatus == 0
+
 CHARSETS.each do |charset|
   output = `./passgen #{charset[:long]} 2>&1`
   "#{charset[:long]} Exit Status".is_broken unless $?.exitstatus == 0
@@ -37,6 +44,8 @@ output = `fakechroot sh -c "chroot ./ /passgen -x 2>&1"`
 output = `fakechroot sh -c "chroot ./ /passgen -x -z 2>&1"`
 "URANDOM Exit Status".is_broken unless $?.exitstatus == 1
 "URANDOM Output".is_broken unless output === "Error getting random data or allocating memory.\n"
+output = `fakechroot sh -c "chroot ./ /passgen -x -z -A -p 1000 2>/dev/null"`
+"URANDOM Atomic Output".is_broken unless $?.exitstatus == 1 && output.empty?
 
 # Test multiple ASCII password output
 output = `./passgen -a -p 213 2>&1`
@@ -48,6 +57,230 @@ output = `./passgen -w -p 213 2>&1`
 "Word Multiple Exit Status".is_broken unless $?.exitstatus == 0
 "Word Multiple Output".is_broken unless /\A((([a-z]+)\.){9}[a-z]+\.*\n){213}\z/ =~ output
 
+# Test the ChaCha20 entropy source.
+output = `./passgen -a -s chacha20 -p 213 2>&1`
+"ChaCha20 Source Exit Status".is_broken unless $?.exitstatus == 0
+"ChaCha20 Source Output".is_broken unless /\A([ -~]{64}\n){213}\z/ =~ output
+
+# Test the automatically chosen userspace generator (AES-CTR or ChaCha20).
+output = `./passgen -a -s drbg -p 213 2>&1`
+"DRBG Source Exit Status".is_broken unless $?.exitstatus == 0
+"DRBG Source Output".is_broken unless /\A([ -~]{64}\n){213}\z/ =~ output
+
+# Test the getrandom source (vDSO or system call, whichever is available).
+output = `./passgen -a -s getrandom -p 213 2>/dev/null`
+"Getrandom Source Exit Status".is_broken unless $?.exitstatus == 0
+"Getrandom Source Output".is_broken unless /\A([ -~]{64}\n){213}\z/ =~ output
+output = `./passgen -a -s getrandom --stats 2>&1 >/dev/null`
+"Getrandom Stats Output".is_broken unless /^Entropy source: getrandom \((vDSO|system call)\)$/ =~ output
+
+# Test the deterministic test source: same output every time, and refused
+# unless the self-tests are being skipped.
+output = `./passgen -x -s test -z -p 3 2>&1`
+"Test Source Exit Status".is_broken unless $?.exitstatus == 0
+"Test Source Output".is_broken unless /\A([0-9A-F]{64}\n){3}\z/ =~ output
+"Test Source Determinism".is_broken unless output == `./passgen -x -s test -z -p 3 2>&1`
+output = `./passgen -x -s test 2>&1`
+"Test Source Without -z Exit Status".is_broken unless $?.exitstatus == 1
+
+# Hex characters are 4 bits each and are never rejected, so a 64-character
+# password takes exactly 32 random bytes.
+output = `./passgen -x -p 10 --stats 2>&1 >/dev/null`
+"Random Bytes Per Password".is_broken unless /^Random bytes per password: 32\.00$/ =~ output
+
+# Test mixing CPU randomness into the generators' seeds. It's only allowed for
+# sources that have a seed.
+output = `./passgen -a -s drbg --mix-cpu -p 213 2>/dev/null`
+"Mix CPU Exit Status".is_broken unless $?.exitstatus == 0
+"Mix CPU Output".is_broken unless /\A([ -~]{64}\n){213}\z/ =~ output
+output = `./passgen -a -s chacha20 -r --stats 2>&1 >/dev/null`
+"Mix CPU Stats Output".is_broken unless /^CPU randomness: \d+ RDSEED words/ =~ output || /neither RDSEED nor RDRAND/ =~ output
+output = `./passgen -a -s urandom --mix-cpu 2>&1`
+"Mix CPU Without Seed Exit Status".is_broken unless $?.exitstatus == 1
+
+# Test generating with several worker threads. Their chunks are written out in
+# order, so with the test source the output is still the same every time.
+output = `./passgen -a -j 4 -p 2000 2>&1`
+"Jobs Exit Status".is_broken unless $?.exitstatus == 0
+"Jobs Output".is_broken unless /\A([ -~]{64}\n){2000}\z/ =~ output
+output = `./passgen -w -j 3 -p 700 2>&1`
+"Word Jobs Exit Status".is_broken unless $?.exitstatus == 0
+"Word Jobs Output".is_broken unless /\A((([a-z]+)\.){9}[a-z]+\.*\n){700}\z/ =~ output
+output = `./passgen -x -s test -z -j 4 -p 1000 2>&1`
+"Jobs Determinism".is_broken unless output == `./passgen -x -s test -z -j 4 -p 1000 2>&1`
+"Jobs Fixture".is_broken unless Digest::SHA256.hexdigest(output) ==
+                                "ecd3fb71da64a48b0c0faf021b7b8eec75b8bf54b8dd1de5fcf4b093bf432cf0"
+
+# Each worker's test source is seeded with its number, and chunk c (of 256
+# passwords) with -j N is worker c % N's (c / N)th. So every chunk is
+# different, worker 0's are a single stream's, and the same worker's chunks
+# turn up in the same places with any -j.
+chunks4 = `./passgen -x -s test -z -j 4 -p 2048 2>&1`.lines.each_slice(256).to_a
+chunks2 = `./passgen -x -s test -z -j 2 -p 2048 2>&1`.lines.each_slice(256).to_a
+"Jobs Distinct Chunks".is_broken unless chunks4.uniq.count == 8
+"Jobs First Worker".is_broken unless chunks4[0] + chunks4[4] == `./passgen -x -s test -z -p 512 2>&1`.lines
+"Jobs Chunk Order".is_broken unless chunks4[1] == chunks2[1] && chunks4[5] == chunks2[3] &&
+                                    chunks4[4] == chunks2[2]
+output = `./passgen -x -j 0 -p 1000 --stats 2>&1 >/dev/null`
+"Jobs Random Bytes Per Password".is_broken unless /^Random bytes per password: 32\.00$/ =~ output
+output = `./passgen -x -j -1 2>&1`
+"Jobs (Negative) Exit Status".is_broken unless $?.exitstatus == 1
+
+# Test pinning the workers to NUMA nodes. Every node with workers reports its
+# throughput.
+output = `./passgen -w -N -j 3 -p 700 2>&1`
+"NUMA Exit Status".is_broken unless $?.exitstatus == 0
+"NUMA Output".is_broken unless /\A((([a-z]+)\.){9}[a-z]+\.*\n){700}\z/ =~ output
+output = `./passgen -x -s test -z -N -j 4 -p 1000 2>&1`
+"NUMA Determinism".is_broken unless output == `./passgen -x -s test -z -j 4 -p 1000 2>&1`
+output = `./passgen -x -N -j 2 -p 1000 --stats 2>&1 >/dev/null`
+"NUMA Stats Output".is_broken unless /^Node \d+: \d+ workers, \d+ passwords, \d+ passwords\/s$/ =~ output
+
+# Test fetching the random bytes in a producer thread. It hands out the same
+# bytes in the same order, so the test source's output doesn't change.
+output = `./passgen -a -P -p 2000 2>&1`
+"Pipeline Exit Status".is_broken unless $?.exitstatus == 0
+"Pipeline Output".is_broken unless /\A([ -~]{64}\n){2000}\z/ =~ output
+output = `./passgen -w --pipeline -j 2 -p 700 2>&1`
+"Pipeline Jobs Exit Status".is_broken unless $?.exitstatus == 0
+"Pipeline Jobs Output".is_broken unless /\A((([a-z]+)\.){9}[a-z]+\.*\n){700}\z/ =~ output
+output = `./passgen -a -s getrandom -P -p 213 2>/dev/null`
+"Pipeline Unbuffered Source Output".is_broken unless /\A([ -~]{64}\n){213}\z/ =~ output
+output = `./passgen -x -s test -z -P -p 1000 2>&1`
+"Pipeline Determinism".is_broken unless output == `./passgen -x -s test -z -p 1000 2>&1`
+output = `./passgen -x -P -p 1000 --stats 2>&1 >/dev/null`
+"Pipeline Stats Output".is_broken unless /^Entropy pipeline: \d+ blocks, average queue depth [\d.]+ of 4, \d+ reader stalls, \d+ producer stalls/ =~ output
+"Pipeline Random Bytes Per Password".is_broken unless /^Random bytes per password: 32\.00$/ =~ output
+
+# Test the output layer. 20000 hex passwords are 1300000 bytes, more than one
+# output block: normally that's written as each block fills up, and with
+# --atomic it's all written at the end with one writev().
+output = `./passgen -x -p 20000 --stats 2>&1 >/dev/null`
+"Output Stats".is_broken unless /^Output: 1300000 bytes in 2 writes$/ =~ output
+output = `./passgen -x -A -p 20000 --stats 2>&1 >/dev/null`
+"Atomic Output Stats".is_broken unless /^Output: 1300000 bytes in 1 writes$/ =~ output
+output = `./passgen -a --atomic -p 20000 2>&1`
+"Atomic Exit Status".is_broken unless $?.exitstatus == 0
+"Atomic Output".is_broken unless /\A([ -~]{64}\n){20000}\z/ =~ output
+output = `./passgen -w -A -j 3 -p 700 2>&1`
+"Atomic Jobs Output".is_broken unless /\A((([a-z]+)\.){9}[a-z]+\.*\n){700}\z/ =~ output
+
+# Test vmsplice. Backticks read through a pipe, so output is spliced into it
+# by default. It must match the write() fallback (--no-vmsplice) exactly.
+output = `./passgen -x -s test -z -p 100000 2>&1`
+"Vmsplice Output".is_broken unless output == `./passgen -x -s test -z -p 100000 -V 2>&1`
+output = `./passgen -w -s test -z -j 2 -p 3000 2>&1`
+"Vmsplice Jobs Output".is_broken unless output == `./passgen -w -s test -z -j 2 -p 3000 --no-vmsplice 2>&1`
+output = `(./passgen -x -p 20000 --stats | cat >/dev/null) 2>&1`
+"Vmsplice Stats".is_broken unless /^Output: 1300000 bytes in 0 writes and \d+ vmsplices$/ =~ output
+output = `(./passgen -x -V -p 20000 --stats | cat >/dev/null) 2>&1`
+"No Vmsplice Stats".is_broken unless /^Output: 1300000 bytes in \d+ writes$/ =~ output
+
+# Test --output. The file must hold exactly what stdout would have, however
+# it's written (io_uring if the kernel allows it, O_DIRECT if the file system
+# does), and only we may read it.
+Dir.mktmpdir do |dir|
+  file = File.join(dir, "passwords")
+  expected = `./passgen -x -s test -z -p 100000 2>&1`
+  output = `./passgen -x -s test -z -p 100000 -o #{file} --stats 2>&1`
+  "Output File Exit Status".is_broken unless $?.exitstatus == 0
+  "Output File Stats".is_broken unless /^Output: 6500000 bytes in \d+ writes( and \d+ io_uring writes)?$/ =~ output
+  "Output File".is_broken unless File.binread(file) == expected
+  "Output File Mode".is_broken unless File.stat(file).mode & 0777 == 0600
+  `./passgen -x -s test -z -p 100000 --output #{file} --direct --preallocate 2>&1`
+  "Direct Output File Exit Status".is_broken unless $?.exitstatus == 0
+  "Direct Output File".is_broken unless File.binread(file) == expected
+  # Preallocation overestimates for words, so the file has to be cut down.
+  expected = `./passgen -w -s test -z -j 2 -p 3000 2>&1`
+  `./passgen -w -s test -z -j 2 -p 3000 -o #{file} -D -F 2>&1`
+  "Word Output File".is_broken unless File.binread(file) == expected
+  output = `./passgen -x -A -p 100 -o #{file} 2>&1`
+  "Atomic Output File".is_broken unless output == "" && /\A([0-9A-F]{64}\n){100}\z/ =~ File.binread(file)
+end
+
+# Test --mmap. One worker fills the file in the same order as stdout; several
+# fill their own ranges of it. If anything fails, the file is left empty.
+Dir.mktmpdir do |dir|
+  file = File.join(dir, "passwords")
+  expected = `./passgen -x -s test -z -p 100000 2>&1`
+  output = `./passgen -x -s test -z -p 100000 -M -o #{file} --stats 2>&1`
+  "Mmap Exit Status".is_broken unless $?.exitstatus == 0
+  "Mmap Stats".is_broken unless /^Output: 6500000 bytes through a shared mapping$/ =~ output
+  "Mmap Output".is_broken unless File.binread(file) == expected
+  `./passgen -a -s drbg -z -j 3 -p 10001 --mmap --output #{file} 2>&1`
+  "Mmap Jobs Exit Status".is_broken unless $?.exitstatus == 0
+  "Mmap Jobs Output".is_broken unless /\A([ -~]{64}\n){10001}\z/ =~ File.binread(file)
+  output = `trap '' XFSZ; ulimit -f 1000; ./passgen -x -p 100000 -M -o #{file} 2>&1`
+  "Mmap Failure Exit Status".is_broken unless $?.exitstatus == 1
+  "Mmap Failure Error".is_broken unless /^Error writing #{Regexp.escape(file)}: / =~ output
+  "Mmap Failure Empties File".is_broken unless File.size(file) == 0
+end
+output = `./passgen -w -M -o /dev/null 2>&1`
+"Mmap Words Exit Status".is_broken unless $?.exitstatus == 1
+output = `./passgen -x -M 2>&1`
+"Mmap Without Output Exit Status".is_broken unless $?.exitstatus == 1
+output = `./passgen -x -M -o /dev/null 2>&1`
+"Mmap Device Exit Status".is_broken unless $?.exitstatus == 1
+
+# Test --binary and --indices. The header is checked field by field here, and
+# the records must be the same passwords as the text output, without the
+# newlines (or as indices into the set).
+output = `./passgen -a -s test -z -p 1000 2>&1`
+expected = output.delete("\n")
+binary = `./passgen -a -s test -z -p 1000 --binary 2>&1`
+"Binary Exit Status".is_broken unless $?.exitstatus == 0
+magic, version, header_length, flags, record_length, charset_length, zero, count = binary.unpack("a8VVVVVVQ<")
+"Binary Header".is_broken unless magic == "PASSGENB" && version == 1 && header_length == 192 && flags == 0 &&
+                                record_length == 64 && charset_length == 94 && zero == 0 && count == 1000
+charset = binary[40, charset_length]
+"Binary Charset".is_broken unless charset == (33..126).map(&:chr).join
+"Binary Header Padding".is_broken unless binary[40 + charset_length...header_length] =~ /\A\0*\z/
+"Binary Records".is_broken unless binary[header_length..-1] == expected
+indices = `./passgen -a -s test -z -p 1000 -i 2>&1`
+"Indices Header".is_broken unless indices.unpack("x16V")[0] == 1 && indices[0...16] == binary[0...16]
+"Indices Records".is_broken unless indices[header_length..-1].bytes.map { |i| charset[i] }.join == expected
+output = `./passgen -a -s test -z -j 3 -p 1000 -b 2>&1`
+"Binary Jobs".is_broken unless output[header_length..-1] == `./passgen -a -s test -z -j 3 -p 1000 2>&1`.delete("\n")
+output = `./passgen -w -b 2>&1`
+"Binary Words Exit Status".is_broken unless $?.exitstatus == 1
+
+# Test tools/read_passwords on every format, and with --mmap.
+Dir.mktmpdir do |dir|
+  file = File.join(dir, "passwords")
+  `./passgen -x -s test -z -p 500 -o #{file} 2>&1`
+  output = `tools/read_passwords #{file} 0 499 2>&1`
+  lines = `./passgen -x -s test -z -p 500 2>&1`.lines
+  "Read Text".is_broken unless $?.exitstatus == 0 && output == lines[0] + lines[499] + "500 passwords of 64 characters: OK\n"
+  `./passgen -x -s test -z -p 500 -b -o #{file} 2>&1`
+  output = `tools/read_passwords #{file} 0 499 2>&1`
+  "Read Binary".is_broken unless $?.exitstatus == 0 &&
+                                 output == lines[0] + lines[499] + "500 passwords of 64 characters from a set of 16: OK\n"
+  `./passgen -x -s test -z -p 500 -i -M -o #{file} 2>&1`
+  output = `tools/read_passwords #{file} 0 499 2>&1`
+  "Read Mapped Indices".is_broken unless $?.exitstatus == 0 &&
+                                         output == lines[0] + lines[499] + "500 passwords of 64 indices from a set of 16: OK\n"
+  File.truncate(file, File.size(file) - 64)
+  output = `tools/read_passwords #{file} 2>&1`
+  "Read Short Binary".is_broken unless $?.exitstatus == 1 && /^Holds 499 of 500 records/ =~ output
+  File.binwrite(file, "abc\nabcd\n")
+  `tools/read_passwords #{file} 2>&1`
+  "Read Bad Text".is_broken unless $?.exitstatus == 1
+end
+output = `./passgen -x -p 10 -o /dev/full 2>&1`
+"Full Output File Exit Status".is_broken unless $?.exitstatus == 1
+"Full Output File Error".is_broken unless output == "Error writing /dev/full: No space left on device\n"
+output = `./passgen -x -o /nonexistent/passwords 2>&1`
+"Missing Output File Exit Status".is_broken unless $?.exitstatus == 1
+"Missing Output File Error".is_broken unless /^Error opening \/nonexistent\/passwords: / =~ output
+output = `./passgen -x -D 2>&1`
+"Direct Without Output Exit Status".is_broken unless $?.exitstatus == 1
+output = `./passgen -x -D -A -o /dev/null 2>&1`
+"Direct Atomic Exit Status".is_broken unless $?.exitstatus == 1
+
+# Test an unknown entropy source.
+output = `./passgen -a -s nonexistent 2>&1`
+"Unknown Source Exit Status".is_broken unless $?.exitstatus == 1
+
 # Test negative password count.
 output = `./passgen -a -p -2 2>&1`
 "Multiple (Negative) Exit Status".is_broken unless $?.exitstatus == 1